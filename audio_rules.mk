@@ -17,30 +17,41 @@ $(MID_BUILDDIR)/%.o: $(MID_ASM_DIR)/%.s
 	$(AS) $(ASFLAGS) -I sound -o $@ $<
 
 # Compressed cries
-$(CRY_BIN_DIR)/%.bin: $(CRY_SUBDIR)/%.wav
 # NOTE: If using ipatix's High Quality Audio Mixer, remove "--no-pad" below.
-	$(WAV2AGB) -b -c -l 1 --no-pad $< $@
+CRY_WAV2AGB_FLAGS := -b -c -l 1 --no-pad
+
+# Every cry is converted by one `wav2agb --batch` run, which writes each .bin next to its .wav
+# (so CRY_BIN_DIR must be CRY_SUBDIR) and leaves outputs whose contents didn't change untouched.
+# As with mapjson, the stamp records when it last ran; a missing .bin is converted on its own.
+CRY_WAVS := $(wildcard $(CRY_SUBDIR)/*.wav)
+CRY_BINS := $(CRY_WAVS:$(CRY_SUBDIR)/%.wav=$(CRY_BIN_DIR)/%.bin)
+CRY_STAMP := $(BUILD_DIR)/cries.stamp
+
+$(CRY_BINS): $(CRY_STAMP)
+	@test -f $@ || $(WAV2AGB) $(CRY_WAV2AGB_FLAGS) $(@:$(CRY_BIN_DIR)/%.bin=$(CRY_SUBDIR)/%.wav) $@
+
+$(CRY_STAMP): $(CRY_WAVS)
+	@mkdir -p $(@D)
+	@$(WAV2AGB) --batch $(CRY_WAV2AGB_FLAGS) $(CRY_WAVS)
+	@echo "$(WAV2AGB) --batch $(CRY_WAV2AGB_FLAGS) <CRY_WAVS>"
+	@touch $@
 
 # Uncompressed sounds
 $(SOUND_BIN_DIR)/%.bin: sound/%.wav 
 	$(WAV2AGB) -b $< $@
 
-# For each line in midi.cfg, we do some trickery to convert it into a make rule for the `.mid` file described on the line
-# Data following the colon in said file corresponds to arguments passed into mid2agb
+# Every song listed in midi.cfg is converted by one `mid2agb -C` run, which passes each song the options
+# on its line, writes its .s next to its .mid (so MID_ASM_DIR must be MID_SUBDIR) and leaves outputs
+# whose contents didn't change untouched, so only songs whose .mid or line changed are reassembled.
+# As with the cries, the stamp records when it last ran; a missing .s is converted on its own.
 MID_CFG_PATH := $(MID_SUBDIR)/midi.cfg
+MID_ASMS := $(MID_SRCS:$(MID_SUBDIR)/%.mid=$(MID_ASM_DIR)/%.s)
+MID_STAMP := $(BUILD_DIR)/songs.stamp
+
+$(MID_ASMS): $(MID_STAMP)
+	@test -f $@ || $(MID) -C $(MID_CFG_PATH) $@
 
-# $1: Source path no extension, $2 Options
-define MID_RULE
-$(MID_ASM_DIR)/$1.s: $(MID_SUBDIR)/$1.mid $(MID_CFG_PATH)
-	$(MID) $$< $$@ $2
-endef
-#                            source path,                             remaining text (options)
-define MID_EXPANSION
-	$(eval $(call MID_RULE,$(basename $(patsubst %:,%,$(word 1,$1))),$(wordlist 2,999,$1)))
-endef
-
-$(foreach line,$(shell cat $(MID_CFG_PATH) | sed "s/ /__SPACE__/g"),$(call MID_EXPANSION,$(subst __SPACE__, ,$(line))))
-
-# Warn users building without a .cfg - build will fail at link time
-$(MID_ASM_DIR)/%.s: $(MID_SUBDIR)/%.mid
-	$(warning $< does not have an associated entry in midi.cfg! It cannot be built)
+$(MID_STAMP): $(MID_SRCS) $(MID_CFG_PATH)
+	@mkdir -p $(@D)
+	$(MID) -C $(MID_CFG_PATH)
+	@touch $@
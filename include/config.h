@@ -47,6 +47,20 @@
 // Uncomment to fix some identified minor bugs
 //#define BUGFIX
 
+// Uncomment to queue DMA3 requests by priority, running palette and OAM
+// uploads before other transfers, and to merge requests that continue the
+// previous one. Changes the ROM, so it no longer matches.
+//#define DMA3_PRIORITY_QUEUE
+
+// Uncomment to upload only the palettes that changed since the last frame,
+// instead of all of palette RAM. Changes the ROM, so it no longer matches.
+//#define DIRTY_PALETTE_UPLOADS
+
+// Uncomment to blend palettes for software fades through lookup tables in
+// IWRAM instead of splitting every color into channels. Gives the same
+// colors. Changes the ROM, so it no longer matches.
+//#define FAST_PALETTE_FADES
+
 // Various undefined behavior bugs may or may not prevent compilation with
 // newer compilers. So always fix them when using a modern compiler.
 #if MODERN || defined(BUGFIX)
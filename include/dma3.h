@@ -52,4 +52,21 @@ s16 RequestDma3Copy(const void *src, void *dest, u16 size, u8 mode);
 s16 RequestDma3Fill(s32 value, void *dest, u16 size, u8 mode);
 s16 CheckForSpaceForDma3Request(s16 index);
 
+#ifdef DMA3_PRIORITY_QUEUE
+// What ProcessDma3Requests did in the last VBlank, to see how close the
+// queued transfers come to overrunning it.
+struct Dma3FrameStats
+{
+    u32 bytes;          // bytes transferred
+    u32 peakBytes;      // most bytes transferred in one VBlank since ClearDma3Requests
+    u16 requests;       // requests run
+    u16 deferred;       // requests left for a later VBlank
+    u16 merged;         // requests merged into a queued one since the previous VBlank
+    u16 rejected;       // requests refused since the previous VBlank because their queue was full
+    u16 overrunFrames;  // VBlanks that left requests queued since ClearDma3Requests
+};
+
+const struct Dma3FrameStats *GetDma3FrameStats(void);
+#endif
+
 #endif // GUARD_DMA3_H
@@ -80,6 +80,25 @@ void TintPalette_GrayScale2(u16 *palette, u16 count);
 void TintPalette_SepiaTone(u16 *palette, u16 count);
 void TintPalette_CustomTone(u16 *palette, u16 count, u16 rTone, u16 gTone, u16 bTone);
 
+// Anything that writes gPlttBufferFaded directly must mark what it changed,
+// so that TransferPlttBuffer uploads it. offset is in colors, size in bytes.
+#ifdef DIRTY_PALETTE_UPLOADS
+struct PlttUploadStats
+{
+    u16 bytes;        // bytes uploaded by the last TransferPlttBuffer
+    u8 transfers;     // DMA transfers it used
+    bool8 fullCopy;   // whether it copied the whole buffer
+    u32 totalBytes;   // bytes uploaded since power on
+};
+
+void MarkPlttBufferDirty(u16 offset, u16 size);
+void MarkPalettesDirty(u32 selectedPalettes);
+const struct PlttUploadStats *GetPlttUploadStats(void);
+#else
+#define MarkPlttBufferDirty(offset, size)
+#define MarkPalettesDirty(selectedPalettes)
+#endif
+
 static inline void SetBackdropFromColor(u16 color)
 {
   FillPalette(color, 0, PLTT_SIZEOF(1));
@@ -1,32 +1,58 @@
 # JSON files are run through jsonproc, which is a tool that converts JSON data to an output file
 # based on an Inja template. https://github.com/pantor/inja
 
-AUTO_GEN_TARGETS += $(DATA_SRC_SUBDIR)/wild_encounters.h
-$(DATA_SRC_SUBDIR)/wild_encounters.h: $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.json.txt
-	$(JSONPROC) $^ $@
+# Each JSON file is parsed once by a single jsonproc run that renders all of its templates.
+# jsonproc leaves outputs whose contents didn't change untouched, so a stamp records when it
+# last ran (as with mapjson in map_data_rules.mk); a missing output is regenerated.
+WILD_ENCOUNTERS_STAMP := $(BUILD_DIR)/wild_encounters.stamp
+WILD_ENCOUNTERS_OUTPUTS := $(DATA_SRC_SUBDIR)/wild_encounters.h include/constants/wild_encounter.h
+WILD_ENCOUNTERS_JSONPROC = $(JSONPROC) $(DATA_SRC_SUBDIR)/wild_encounters.json \
+	$(DATA_SRC_SUBDIR)/wild_encounters.json.txt $(DATA_SRC_SUBDIR)/wild_encounters.h \
+	$(DATA_SRC_SUBDIR)/wild_encounters.constants.json.txt include/constants/wild_encounter.h
+
+AUTO_GEN_TARGETS += $(WILD_ENCOUNTERS_OUTPUTS)
+$(WILD_ENCOUNTERS_OUTPUTS): $(WILD_ENCOUNTERS_STAMP)
+	@test -f $@ || $(WILD_ENCOUNTERS_JSONPROC)
+
+$(WILD_ENCOUNTERS_STAMP): $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.json.txt $(DATA_SRC_SUBDIR)/wild_encounters.constants.json.txt
+	@mkdir -p $(@D)
+	$(WILD_ENCOUNTERS_JSONPROC)
+	@touch $@
 
 $(C_BUILDDIR)/wild_encounter.o: c_dep += $(DATA_SRC_SUBDIR)/wild_encounters.h
 
-AUTO_GEN_TARGETS += include/constants/wild_encounter.h
-include/constants/wild_encounter.h: $(DATA_SRC_SUBDIR)/wild_encounters.json $(DATA_SRC_SUBDIR)/wild_encounters.constants.json.txt
-	$(JSONPROC) $^ $@
+REGION_MAP_SECTIONS_STAMP := $(BUILD_DIR)/region_map_sections.stamp
+REGION_MAP_SECTIONS_OUTPUTS := $(DATA_SRC_SUBDIR)/region_map/region_map_entries.h include/constants/region_map_sections.h
+REGION_MAP_SECTIONS_JSONPROC = $(JSONPROC) $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json \
+	$(DATA_SRC_SUBDIR)/region_map/region_map_sections.json.txt $(DATA_SRC_SUBDIR)/region_map/region_map_entries.h \
+	$(DATA_SRC_SUBDIR)/region_map/region_map_sections.constants.json.txt include/constants/region_map_sections.h
 
-AUTO_GEN_TARGETS += $(DATA_SRC_SUBDIR)/region_map/region_map_entries.h
-$(DATA_SRC_SUBDIR)/region_map/region_map_entries.h: $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json.txt
-	$(JSONPROC) $^ $@
+AUTO_GEN_TARGETS += $(REGION_MAP_SECTIONS_OUTPUTS)
+$(REGION_MAP_SECTIONS_OUTPUTS): $(REGION_MAP_SECTIONS_STAMP)
+	@test -f $@ || $(REGION_MAP_SECTIONS_JSONPROC)
+
+$(REGION_MAP_SECTIONS_STAMP): $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json.txt $(DATA_SRC_SUBDIR)/region_map/region_map_sections.constants.json.txt
+	@mkdir -p $(@D)
+	$(REGION_MAP_SECTIONS_JSONPROC)
+	@touch $@
 
 $(C_BUILDDIR)/region_map.o: c_dep += $(DATA_SRC_SUBDIR)/region_map/region_map_entries.h
 
-AUTO_GEN_TARGETS += include/constants/region_map_sections.h
-include/constants/region_map_sections.h: $(DATA_SRC_SUBDIR)/region_map/region_map_sections.json $(DATA_SRC_SUBDIR)/region_map/region_map_sections.constants.json.txt
-	$(JSONPROC) $^ $@
+HEAL_LOCATIONS_STAMP := $(BUILD_DIR)/heal_locations.stamp
+HEAL_LOCATIONS_OUTPUTS := $(DATA_SRC_SUBDIR)/heal_locations.h include/constants/heal_locations.h
+HEAL_LOCATIONS_JSONPROC = $(JSONPROC) $(DATA_SRC_SUBDIR)/heal_locations.json \
+	$(DATA_SRC_SUBDIR)/heal_locations.json.txt $(DATA_SRC_SUBDIR)/heal_locations.h \
+	$(DATA_SRC_SUBDIR)/heal_locations.constants.json.txt include/constants/heal_locations.h
+
+AUTO_GEN_TARGETS += $(HEAL_LOCATIONS_OUTPUTS)
+$(HEAL_LOCATIONS_OUTPUTS): $(HEAL_LOCATIONS_STAMP)
+	@test -f $@ || $(HEAL_LOCATIONS_JSONPROC)
 
-AUTO_GEN_TARGETS += $(DATA_SRC_SUBDIR)/heal_locations.h
-$(DATA_SRC_SUBDIR)/heal_locations.h: $(DATA_SRC_SUBDIR)/heal_locations.json $(DATA_SRC_SUBDIR)/heal_locations.json.txt
-	$(JSONPROC) $^ $@
+$(HEAL_LOCATIONS_STAMP): $(DATA_SRC_SUBDIR)/heal_locations.json $(DATA_SRC_SUBDIR)/heal_locations.json.txt $(DATA_SRC_SUBDIR)/heal_locations.constants.json.txt
+	@mkdir -p $(@D)
+	$(HEAL_LOCATIONS_JSONPROC)
+	@touch $@
 
 $(C_BUILDDIR)/heal_location.o: c_dep += $(DATA_SRC_SUBDIR)/heal_locations.h
 
-AUTO_GEN_TARGETS += include/constants/heal_locations.h
-include/constants/heal_locations.h: $(DATA_SRC_SUBDIR)/heal_locations.json $(DATA_SRC_SUBDIR)/heal_locations.constants.json.txt
-	$(JSONPROC) $^ $@
+JSONPROC_STAMPS := $(WILD_ENCOUNTERS_STAMP) $(REGION_MAP_SECTIONS_STAMP) $(HEAL_LOCATIONS_STAMP)
@@ -5,7 +5,7 @@ MAKEFLAGS += --no-print-directory
 
 # Inclusive list. If you don't want a tool to be built, don't add it here.
 TOOLS_DIR := tools
-TOOL_NAMES := bin2c gbafix gbagfx jsonproc mapjson mid2agb preproc ramscrgen rsfont scaninc wav2agb
+TOOL_NAMES := bin2c gbafix gbagfx jsonproc mapjson metatiles mid2agb preproc ramscrgen rsfont scaninc wav2agb
 
 TOOLDIRS := $(TOOL_NAMES:%=$(TOOLS_DIR)/%)
 
@@ -20,22 +20,46 @@ MAP_HEADERS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/header.inc,$(MAP_DIRS))
 MAP_JSONS := $(patsubst $(MAPS_DIR)/%/,$(MAPS_DIR)/%/map.json,$(MAP_DIRS))
 
 $(DATA_ASM_BUILDDIR)/maps.o: $(DATA_ASM_SUBDIR)/maps.s $(LAYOUTS_DIR)/layouts.inc $(LAYOUTS_DIR)/layouts_table.inc $(MAPS_DIR)/headers.inc $(MAPS_DIR)/groups.inc $(MAPS_DIR)/connections.inc $(MAP_CONNECTIONS) $(MAP_HEADERS)
-	$(PREPROC) $< charmap.txt | $(CPP) -I include - | $(PREPROC) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
+	$(PREPROC) $(PREPROC_FLAGS) $< charmap.txt | $(CPP) -I include - | $(PREPROC) $(PREPROC_FLAGS) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
 $(DATA_ASM_BUILDDIR)/map_events.o: $(DATA_ASM_SUBDIR)/map_events.s $(MAPS_DIR)/events.inc $(MAP_EVENTS)
-	$(PREPROC) $< charmap.txt | $(CPP) -I include - | $(PREPROC) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
+	$(PREPROC) $(PREPROC_FLAGS) $< charmap.txt | $(CPP) -I include - | $(PREPROC) $(PREPROC_FLAGS) -ie $< charmap.txt | $(AS) $(ASFLAGS) -o $@
 
 
-$(MAPS_OUTDIR)/%/header.inc $(MAPS_OUTDIR)/%/events.inc $(MAPS_OUTDIR)/%/connections.inc: $(MAPS_DIR)/%/map.json
-	$(MAPJSON) map emerald $< $(LAYOUTS_DIR)/layouts.json $(@D)
+# All map and layout outputs come from one `mapjson all` run. It parses
+# layouts.json once, handles the maps in parallel and leaves files whose
+# contents didn't change untouched, so the stamp records when it last ran
+# and maps.o/map_events.o are only reassembled if an output really changed.
+# An output that is missing while the stamp is current is regenerated.
+MAPJSON_STAMP := $(BUILD_DIR)/mapjson.stamp
+MAPJSON_ALL = $(MAPJSON) all emerald $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(INCLUDECONSTS_OUTDIR) $(MAP_JSONS)
 
-$(MAPS_OUTDIR)/connections.inc $(MAPS_OUTDIR)/groups.inc $(MAPS_OUTDIR)/events.inc $(MAPS_OUTDIR)/headers.inc $(INCLUDECONSTS_OUTDIR)/map_groups.h: $(MAPS_DIR)/map_groups.json
-	$(MAPJSON) groups emerald $< $(MAPS_OUTDIR) $(INCLUDECONSTS_OUTDIR)
+MAPJSON_OUTPUTS := $(MAP_CONNECTIONS) $(MAP_EVENTS) $(MAP_HEADERS)
+MAPJSON_OUTPUTS += $(MAPS_OUTDIR)/connections.inc $(MAPS_OUTDIR)/groups.inc $(MAPS_OUTDIR)/events.inc $(MAPS_OUTDIR)/headers.inc
+MAPJSON_OUTPUTS += $(LAYOUTS_OUTDIR)/layouts.inc $(LAYOUTS_OUTDIR)/layouts_table.inc
+MAPJSON_OUTPUTS += $(INCLUDECONSTS_OUTDIR)/map_groups.h $(INCLUDECONSTS_OUTDIR)/layouts.h $(INCLUDECONSTS_OUTDIR)/map_event_ids.h
 
-$(LAYOUTS_OUTDIR)/layouts.inc $(LAYOUTS_OUTDIR)/layouts_table.inc $(INCLUDECONSTS_OUTDIR)/layouts.h: $(LAYOUTS_DIR)/layouts.json
-	$(MAPJSON) layouts emerald $< $(LAYOUTS_OUTDIR) $(INCLUDECONSTS_OUTDIR)
+$(MAPJSON_OUTPUTS): $(MAPJSON_STAMP)
+	@test -f $@ || $(MAPJSON_ALL)
 
-# Generate constants for map events, which depend on data that's distributed across the map.json files.
 # There's a lot of map.json files, so we print an abbreviated output with echo.
-$(INCLUDECONSTS_OUTDIR)/map_event_ids.h: $(MAP_JSONS)
-	@$(MAPJSON) event_constants emerald $^ $(INCLUDECONSTS_OUTDIR)/map_event_ids.h
-	@echo "$(MAPJSON) event_constants emerald <MAP_JSONS> $(INCLUDECONSTS_OUTDIR)/map_event_ids.h"
+$(MAPJSON_STAMP): $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(MAP_JSONS)
+	@mkdir -p $(@D)
+	@$(MAPJSON_ALL)
+	@echo "$(MAPJSON) all emerald $(MAPS_DIR)/map_groups.json $(LAYOUTS_DIR)/layouts.json $(INCLUDECONSTS_OUTDIR) <MAP_JSONS>"
+	@touch $@
+
+# `make tileset-report` runs metatiles over every tileset: it checks the
+# metatiles against the layouts and the metatile labels, stops on malformed
+# metatile data, and prints the unused metatiles and tiles. It isn't part of
+# the ROM build, since nothing there reads the report.
+TILESET_REPORT := $(BUILD_DIR)/tileset_report.txt
+TILESET_SOURCES := src/data/tilesets/headers.h src/data/tilesets/metatiles.h $(INCLUDECONSTS_OUTDIR)/metatile_labels.h src/data/tilesets/graphics.h src/graphics.c
+TILESET_BINS := $(wildcard $(DATA_ASM_SUBDIR)/tilesets/*/*/metatile*.bin $(DATA_ASM_SUBDIR)/tilesets/*/*/*/metatile*.bin)
+LAYOUT_BINS := $(wildcard $(LAYOUTS_DIR)/*/*.bin)
+
+$(TILESET_REPORT): $(LAYOUTS_DIR)/layouts.json $(TILESET_SOURCES) $(TILESET_BINS) $(LAYOUT_BINS) | $(TOOLS_DIR)/metatiles
+	@mkdir -p $(@D)
+	$(METATILES) report $(LAYOUTS_DIR)/layouts.json $(TILESET_SOURCES) > $@
+
+tileset-report: $(TILESET_REPORT)
+	@cat $<
@@ -3958,6 +3958,7 @@ static void AnimProtect_Step(struct Sprite *sprite)
         }
 
         gPlttBufferFaded[sprite->data[2] + 7] = savedPal;
+        MarkPlttBufferDirty(sprite->data[2] + 1, PLTT_SIZEOF(7));
     }
 
     if (sprite->data[7] > 6 && sprite->data[0] >0 && ++sprite->data[6] > 1)
@@ -5070,6 +5071,7 @@ static void AnimTask_MoonlightEndFade_Step(u8 taskId)
                     {
                         gPlttBufferFaded[r3 + j] = color;
                     }
+                    MarkPlttBufferDirty(r3, PLTT_SIZE_4BPP);
                 }
 
                 bitmask <<= 1;
@@ -5260,6 +5262,7 @@ void AnimTask_MusicNotesRainbowBlend(u8 taskId)
         index = OBJ_PLTT_ID(index);
         for (i = 1; i < ARRAY_COUNT(gParticlesColorBlendTable[0]); i++)
             gPlttBufferFaded[index + i] = gParticlesColorBlendTable[0][i];
+        MarkPlttBufferDirty(index, PLTT_SIZE_4BPP);
     }
 
     for (j = 1; j < ARRAY_COUNT(gParticlesColorBlendTable); j++)
@@ -5270,6 +5273,7 @@ void AnimTask_MusicNotesRainbowBlend(u8 taskId)
             index = OBJ_PLTT_ID(index);
             for (i = 1; i < ARRAY_COUNT(gParticlesColorBlendTable[0]); i++)
                 gPlttBufferFaded[index + i] = gParticlesColorBlendTable[j][i];
+            MarkPlttBufferDirty(index, PLTT_SIZE_4BPP);
         }
     }
     DestroyAnimVisualTask(taskId);
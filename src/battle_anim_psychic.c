@@ -527,6 +527,7 @@ static void AnimDefensiveWall_Step3(struct Sprite *sprite)
             gPlttBufferFaded[startOffset + i] = gPlttBufferFaded[startOffset + i - 1];
 
         gPlttBufferFaded[startOffset + 1] = color;
+        MarkPlttBufferDirty(startOffset + 1, PLTT_SIZEOF(8));
 
         if (++sprite->data[2] == 16)
             sprite->callback = AnimDefensiveWall_Step4;
@@ -652,6 +652,7 @@ static void AnimTask_RotateAuroraRingColors_Step(u8 taskId)
         for (i = 1; i < 8; i++)
             gPlttBufferFaded[palIndex + i - 1] = gPlttBufferFaded[palIndex + i];
         gPlttBufferFaded[palIndex + 7] = rgbBuffer;
+        MarkPlttBufferDirty(palIndex, PLTT_SIZEOF(8));
     }
     if (++gTasks[taskId].data[11] == gTasks[taskId].data[0])
         DestroyAnimVisualTask(taskId);
@@ -910,6 +911,7 @@ static void AnimTask_CreateSurfWave_Step1(u8 taskId)
             gPlttBufferFaded[BG_PLTT_ID(animBg.paletteId) + 1 + i] = gPlttBufferFaded[BG_PLTT_ID(animBg.paletteId) + 1 + i - 1]; // 1 + i - 1 is needed to match for some bizarre reason
         }
         gPlttBufferFaded[BG_PLTT_ID(animBg.paletteId) + 1] = rgbBuffer;
+        MarkPlttBufferDirty(BG_PLTT_ID(animBg.paletteId) + 1, PLTT_SIZEOF(7));
         gTasks[taskId].data[5] = 0;
     }
     if (++gTasks[taskId].data[6] > 1)
@@ -754,6 +754,7 @@ void LoadBattleMenuWindowGfx(void)
         LoadMessageBoxGfx(0, 0x30, BG_PLTT_ID(7));
         gPlttBufferUnfaded[BG_PLTT_ID(7) + 6] = 0;
         CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(7) + 6], &gPlttBufferFaded[BG_PLTT_ID(7) + 6], PLTT_SIZEOF(1));
+        MarkPlttBufferDirty(BG_PLTT_ID(7) + 6, PLTT_SIZEOF(1));
     }
 }
 
@@ -1073,6 +1074,7 @@ void InitLinkBattleVsScreen(u8 taskId)
     case 1:
         palId = AllocSpritePalette(TAG_VS_LETTERS);
         gPlttBufferUnfaded[OBJ_PLTT_ID(palId) + 15] = gPlttBufferFaded[OBJ_PLTT_ID(palId) + 15] = RGB_WHITE;
+        MarkPlttBufferDirty(OBJ_PLTT_ID(palId) + 15, PLTT_SIZEOF(1));
         gBattleStruct->linkBattleVsSpriteId_V = CreateSprite(&sVsLetter_V_SpriteTemplate, 111, 80, 0);
         gBattleStruct->linkBattleVsSpriteId_S = CreateSprite(&sVsLetter_S_SpriteTemplate, 129, 80, 0);
         gSprites[gBattleStruct->linkBattleVsSpriteId_V].invisible = TRUE;
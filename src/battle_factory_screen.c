@@ -1654,6 +1654,7 @@ static void Select_Task_HandleMenu(u8 taskId)
             if (sFactorySelectScreen->fromSummaryScreen == TRUE)
             {
                 gPlttBufferFaded[BG_PLTT_ID(PALNUM_FADE_TEXT) + 4] = sFactorySelectScreen->speciesNameColorBackup;
+                MarkPlttBufferDirty(BG_PLTT_ID(PALNUM_FADE_TEXT) + 4, PLTT_SIZEOF(1));
                 gPlttBufferUnfaded[BG_PLTT_ID(PALNUM_FADE_TEXT) + 4] = gPlttBufferUnfaded[BG_PLTT_ID(PALNUM_TEXT) + 4];
             }
             sFactorySelectScreen->fromSummaryScreen = FALSE;
@@ -3138,6 +3139,7 @@ static void Swap_Task_ScreenInfoTransitionIn(u8 taskId)
          && gTasks[taskId].tSlideFinishedCancel == TRUE)
         {
             gPlttBufferFaded[BG_PLTT_ID(PALNUM_FADE_TEXT) + 2] = sPokeballGray_Pal[37];
+            MarkPlttBufferDirty(BG_PLTT_ID(PALNUM_FADE_TEXT) + 2, PLTT_SIZEOF(1));
             Swap_PrintActionStrings();
             PutWindowTilemap(SWAP_WIN_ACTION_FADE);
             gTasks[taskId].tState++;
@@ -3913,6 +3915,7 @@ static void Swap_PrintMonSpeciesForTransition(void)
 
     LoadPalette(sSwapText_Pal, BG_PLTT_ID(PALNUM_FADE_TEXT), sizeof(sSwapText_Pal));
     CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(PALNUM_TEXT)], &gPlttBufferFaded[BG_PLTT_ID(PALNUM_FADE_TEXT)], PLTT_SIZEOF(5));
+    MarkPlttBufferDirty(BG_PLTT_ID(PALNUM_FADE_TEXT), PLTT_SIZEOF(5));
 
     if (sFactorySwapScreen->cursorPos >= FRONTIER_PARTY_SIZE)
     {
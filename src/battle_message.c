@@ -3042,6 +3042,7 @@ void SetPPNumbersPaletteInMoveSelection(void)
 
     CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(5) + 12], &gPlttBufferFaded[BG_PLTT_ID(5) + 12], PLTT_SIZEOF(1));
     CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(5) + 11], &gPlttBufferFaded[BG_PLTT_ID(5) + 11], PLTT_SIZEOF(1));
+    MarkPlttBufferDirty(BG_PLTT_ID(5) + 11, PLTT_SIZEOF(2));
 }
 
 u8 GetCurrentPPToMaxPPState(u8 currentPP, u8 maxPP)
@@ -4504,6 +4504,7 @@ static bool8 FrontierSquares_Shrink(struct Task *task)
                 gPlttBufferUnfaded[i] = RGB_BLACK;
                 gPlttBufferFaded[i] = RGB_BLACK;
             }
+            MarkPlttBufferDirty(BG_PLTT_ID(15) + 10, PLTT_SIZEOF(5));
             break;
         case 1:
             BlendPalettes(PALETTES_ALL & ~(1 << 15), 16, RGB_BLACK);
@@ -149,6 +149,7 @@ static bool8 SetupClearSaveDataScreen(void)
         gPlttBufferFaded[0] = RGB_WHITE;
         gPlttBufferUnfaded[1] = RGB(5, 10, 14);
         gPlttBufferFaded[1] = RGB(5, 10, 14);
+        MarkPlttBufferDirty(0, PLTT_SIZEOF(2));
         for (i = 0; i < 0x10; i++)
             ((u16 *)(VRAM + 0x20))[i] = 0x1111;
 
@@ -4072,11 +4072,13 @@ static void UpdateBlendTaskContestantData(u8 contestant)
                      &gPlttBufferUnfaded[PLTT_ID(palOffset1) + 10],
                      &gPlttBufferFaded[PLTT_ID(palOffset1) + 10],
                      PLTT_SIZEOF(1));
+    MarkPlttBufferDirty(PLTT_ID(palOffset1) + 10, PLTT_SIZEOF(1));
     palOffset2 = PLTT_ID(contestant + 5) + 12 + contestant;
     DmaCopy16Defvars(3,
                      &gPlttBufferUnfaded[palOffset2],
                      &gPlttBufferFaded[palOffset2],
                      PLTT_SIZEOF(1));
+    MarkPlttBufferDirty(palOffset2, PLTT_SIZEOF(1));
 }
 
 // See comments on CreateUnusedBlendTask
@@ -19,6 +19,245 @@ struct Dma3Request
 
 static struct Dma3Request sDma3Requests[MAX_DMA_REQUESTS];
 
+#ifdef DMA3_PRIORITY_QUEUE
+
+// Requests are split into queues, each a ring buffer over its own part of
+// sDma3Requests. Queues are run in order, so urgent requests (palette and OAM
+// uploads) never wait behind a bulk tile or tilemap copy. Requests within a
+// queue are run in the order they were made.
+#define DMA_QUEUE_URGENT 0
+#define DMA_QUEUE_NORMAL 1
+#define DMA_QUEUE_COUNT  2
+
+#define MAX_URGENT_DMA_REQUESTS 32
+
+// Don't transfer more than 40 KiB in one VBlank
+#define DMA_FRAME_BYTE_LIMIT (40 * 1024)
+
+#define IS_DMA_REQUEST_FILL(mode) ((mode) == DMA_REQUEST_FILL32 || (mode) == DMA_REQUEST_FILL16)
+
+// The first slot of each queue, followed by the end of the last queue
+static const u8 sDma3QueueStart[DMA_QUEUE_COUNT + 1] = {0, MAX_URGENT_DMA_REQUESTS, MAX_DMA_REQUESTS};
+
+static vbool8 sDma3ManagerLocked;
+static vu8 sDma3QueueHead[DMA_QUEUE_COUNT]; // offset of the oldest request within the queue
+static vu8 sDma3QueueCount[DMA_QUEUE_COUNT];
+static u16 sDma3MergedRequests;
+static u16 sDma3RejectedRequests;
+static struct Dma3FrameStats sDma3FrameStats;
+
+static u8 GetDma3QueueSlot(u8 queue, u8 offset)
+{
+    u8 capacity = sDma3QueueStart[queue + 1] - sDma3QueueStart[queue];
+
+    if (offset >= capacity)
+        offset -= capacity;
+    return sDma3QueueStart[queue] + offset;
+}
+
+static u8 GetDma3RequestQueue(const void *dest)
+{
+    if ((u32)dest - PLTT < PLTT_SIZE || (u32)dest - OAM < OAM_SIZE)
+        return DMA_QUEUE_URGENT;
+    return DMA_QUEUE_NORMAL;
+}
+
+static void FreeDma3Request(struct Dma3Request *request)
+{
+    request->src = NULL;
+    request->dest = NULL;
+    request->size = 0;
+    request->mode = 0;
+    request->value = 0;
+}
+
+void ClearDma3Requests(void)
+{
+    int i;
+
+    sDma3ManagerLocked = TRUE;
+
+    for (i = 0; i < MAX_DMA_REQUESTS; i++)
+        FreeDma3Request(&sDma3Requests[i]);
+
+    for (i = 0; i < DMA_QUEUE_COUNT; i++)
+    {
+        sDma3QueueHead[i] = 0;
+        sDma3QueueCount[i] = 0;
+    }
+
+    sDma3MergedRequests = 0;
+    sDma3RejectedRequests = 0;
+    memset(&sDma3FrameStats, 0, sizeof(sDma3FrameStats));
+
+    sDma3ManagerLocked = FALSE;
+}
+
+static void RecordDma3Frame(u32 bytesTransferred, u16 requestsRun)
+{
+    sDma3FrameStats.bytes = bytesTransferred;
+    sDma3FrameStats.requests = requestsRun;
+    sDma3FrameStats.deferred = sDma3QueueCount[DMA_QUEUE_URGENT] + sDma3QueueCount[DMA_QUEUE_NORMAL];
+    sDma3FrameStats.merged = sDma3MergedRequests;
+    sDma3FrameStats.rejected = sDma3RejectedRequests;
+
+    if (sDma3FrameStats.deferred != 0 && sDma3FrameStats.overrunFrames != 0xFFFF)
+        sDma3FrameStats.overrunFrames++;
+    if (bytesTransferred > sDma3FrameStats.peakBytes)
+        sDma3FrameStats.peakBytes = bytesTransferred;
+
+    sDma3MergedRequests = 0;
+    sDma3RejectedRequests = 0;
+}
+
+void ProcessDma3Requests(void)
+{
+    struct Dma3Request *request;
+    u32 bytesTransferred;
+    u16 requestsRun;
+    u8 queue;
+
+    // A request is being made, leave everything for the next VBlank
+    if (sDma3ManagerLocked)
+    {
+        RecordDma3Frame(0, 0);
+        return;
+    }
+
+    bytesTransferred = 0;
+    requestsRun = 0;
+
+    for (queue = 0; queue < DMA_QUEUE_COUNT; queue++)
+    {
+        while (sDma3QueueCount[queue] != 0)
+        {
+            request = &sDma3Requests[GetDma3QueueSlot(queue, sDma3QueueHead[queue])];
+
+            if (bytesTransferred + request->size > DMA_FRAME_BYTE_LIMIT
+             || *(u8 *)REG_ADDR_VCOUNT > 224) // we're about to leave vblank, stop
+            {
+                RecordDma3Frame(bytesTransferred, requestsRun);
+                return;
+            }
+
+            bytesTransferred += request->size;
+            requestsRun++;
+
+            switch (request->mode)
+            {
+            case DMA_REQUEST_COPY32:
+                Dma3CopyLarge32_(request->src, request->dest, request->size);
+                break;
+            case DMA_REQUEST_FILL32:
+                Dma3FillLarge32_(request->value, request->dest, request->size);
+                break;
+            case DMA_REQUEST_COPY16:
+                Dma3CopyLarge16_(request->src, request->dest, request->size);
+                break;
+            case DMA_REQUEST_FILL16:
+                Dma3FillLarge16_(request->value, request->dest, request->size);
+                break;
+            }
+
+            FreeDma3Request(request);
+            sDma3QueueHead[queue] = GetDma3QueueSlot(queue, sDma3QueueHead[queue] + 1) - sDma3QueueStart[queue];
+            sDma3QueueCount[queue]--;
+        }
+    }
+
+    RecordDma3Frame(bytesTransferred, requestsRun);
+}
+
+// Adds a request to the end of its queue and returns its slot, or -1 if the
+// queue is full. A request that continues the last one in its queue (same mode,
+// the next source and destination bytes, or the same fill value) is merged into
+// it instead, and that request's slot is returned.
+static s16 QueueDma3Request(const void *src, void *dest, u16 size, u16 mode, u32 value)
+{
+    struct Dma3Request *last;
+    u8 queue = GetDma3RequestQueue(dest);
+    u8 count;
+    u8 slot;
+
+    // Lock before reading the queue, so ProcessDma3Requests can't run it in
+    // VBlank between here and adding the request.
+    sDma3ManagerLocked = TRUE;
+    count = sDma3QueueCount[queue];
+
+    if (count != 0)
+    {
+        slot = GetDma3QueueSlot(queue, sDma3QueueHead[queue] + count - 1);
+        last = &sDma3Requests[slot];
+
+        if (last->mode == mode
+         && last->dest + last->size == dest
+         && last->size + size <= DMA_FRAME_BYTE_LIMIT
+         && (IS_DMA_REQUEST_FILL(mode) ? last->value == value : last->src + last->size == src))
+        {
+            last->size += size;
+            sDma3MergedRequests++;
+            sDma3ManagerLocked = FALSE;
+            return slot;
+        }
+    }
+
+    if (count >= sDma3QueueStart[queue + 1] - sDma3QueueStart[queue])
+    {
+        sDma3RejectedRequests++;
+        sDma3ManagerLocked = FALSE;
+        return -1;  // no free DMA request was found
+    }
+
+    slot = GetDma3QueueSlot(queue, sDma3QueueHead[queue] + count);
+
+    // An empty request is never run, so its slot is already free
+    if (size != 0)
+    {
+        sDma3Requests[slot].src = src;
+        sDma3Requests[slot].dest = dest;
+        sDma3Requests[slot].size = size;
+        sDma3Requests[slot].mode = mode;
+        sDma3Requests[slot].value = value;
+        sDma3QueueCount[queue]++;
+    }
+
+    sDma3ManagerLocked = FALSE;
+    return slot;
+}
+
+s16 RequestDma3Copy(const void *src, void *dest, u16 size, u8 mode)
+{
+    return QueueDma3Request(src, dest, size, (mode == 1) ? DMA_REQUEST_COPY32 : DMA_REQUEST_COPY16, 0);
+}
+
+s16 RequestDma3Fill(s32 value, void *dest, u16 size, u8 mode)
+{
+    return QueueDma3Request(NULL, dest, size, (mode == 1) ? DMA_REQUEST_FILL32 : DMA_REQUEST_FILL16, value);
+}
+
+s16 CheckForSpaceForDma3Request(s16 index)
+{
+    if (index == -1)  // check if all requests are free
+    {
+        if (sDma3QueueCount[DMA_QUEUE_URGENT] != 0 || sDma3QueueCount[DMA_QUEUE_NORMAL] != 0)
+            return -1;
+        return 0;
+    }
+    else  // check the specified request
+    {
+        if (sDma3Requests[index].size != 0)
+            return -1;
+        return 0;
+    }
+}
+
+const struct Dma3FrameStats *GetDma3FrameStats(void)
+{
+    return &sDma3FrameStats;
+}
+
+#else
+
 static vbool8 sDma3ManagerLocked;
 static u8 sDma3RequestCursor;
 
@@ -181,3 +420,5 @@ s16 CheckForSpaceForDma3Request(s16 index)
         return 0;
     }
 }
+
+#endif // DMA3_PRIORITY_QUEUE
@@ -463,6 +463,8 @@ static void ApplyColorMap(u8 startPalIndex, u8 numPalettes, s8 colorMapIndex)
     u8 *colorMap;
     u16 i;
 
+    MarkPlttBufferDirty(PLTT_ID(startPalIndex), numPalettes * PLTT_SIZE_4BPP);
+
     if (colorMapIndex > 0)
     {
         colorMapIndex--;
@@ -547,6 +549,8 @@ static void ApplyColorMapWithBlend(u8 startPalIndex, u8 numPalettes, s8 colorMap
     u8 gBlend = color.g;
     u8 bBlend = color.b;
 
+    MarkPlttBufferDirty(PLTT_ID(startPalIndex), numPalettes * PLTT_SIZE_4BPP);
+
     palOffset = PLTT_ID(startPalIndex);
     numPalettes += startPalIndex;
     colorMapIndex--;
@@ -603,6 +607,8 @@ static void ApplyDroughtColorMapWithBlend(s8 colorMapIndex, u8 blendCoeff, u16 b
     rBlend = color.r;
     gBlend = color.g;
     bBlend = color.b;
+
+    MarkPalettesDirty(PALETTES_ALL);
     palOffset = 0;
     for (curPalIndex = 0; curPalIndex < 32; curPalIndex++)
     {
@@ -657,6 +663,8 @@ static void ApplyFogBlend(u8 blendCoeff, u16 blendColor)
     gBlend = color.g;
     bBlend = color.b;
 
+    MarkPalettesDirty(PALETTES_OBJECTS);
+
     for (curPalIndex = 16; curPalIndex < 32; curPalIndex++)
     {
         if (LightenSpritePaletteInFog(curPalIndex))
@@ -822,6 +830,7 @@ void UpdateSpritePaletteWithWeather(u8 spritePaletteIndex)
             paletteIndex = PLTT_ID(paletteIndex);
             for (i = 0; i < 16; i++)
                 gPlttBufferFaded[paletteIndex + i] = gWeatherPtr->fadeDestColor;
+            MarkPlttBufferDirty(paletteIndex, PLTT_SIZE_4BPP);
         }
         break;
     case WEATHER_PAL_STATE_SCREEN_FADING_OUT:
@@ -1894,6 +1894,7 @@ static void Task_Scene3_Groudon(u8 taskId)
         {
             tDelay = 2;
             CpuCopy16(INTRO3_RAW_PTR(tPalIdx), &gPlttBufferFaded[BG_PLTT_ID(1) + 15], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(1) + 15, PLTT_SIZEOF(1));
             tPalIdx += 2;
             if (tPalIdx == 0x1EC)
                 tState++;
@@ -1911,6 +1912,7 @@ static void Task_Scene3_Groudon(u8 taskId)
         {
             tDelay = 2;
             CpuCopy16(INTRO3_RAW_PTR(tPalIdx), &gPlttBufferFaded[BG_PLTT_ID(1) + 15], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(1) + 15, PLTT_SIZEOF(1));
             tPalIdx -= 2;
             if (tPalIdx == 0x1E0)
             {
@@ -2153,6 +2155,7 @@ static void Task_Scene3_Kyogre(u8 taskId)
         {
             tDelay = 4;
             CpuCopy16(INTRO3_RAW_PTR(tPalIdx), &gPlttBufferFaded[BG_PLTT_ID(2) + 15], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(2) + 15, PLTT_SIZEOF(1));
             tPalIdx -= 2;
             if (tPalIdx == 0x1E0)
                 tState++;
@@ -2171,6 +2174,7 @@ static void Task_Scene3_Kyogre(u8 taskId)
         {
             tDelay = 4;
             CpuCopy16(INTRO3_RAW_PTR(tPalIdx), &gPlttBufferFaded[BG_PLTT_ID(2) + 15], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(2) + 15, PLTT_SIZEOF(1));
             tPalIdx += 2;
             if (tPalIdx == 0x1EE)
             {
@@ -2502,6 +2506,7 @@ static void SpriteCB_Lightning(struct Sprite *sprite)
         sprite->sState++;
     case 1:
         CpuCopy16(INTRO3_RAW_PTR(sprite->sPalIdx), &gPlttBufferFaded[BG_PLTT_ID(5) + 13], PLTT_SIZEOF(1));
+        MarkPlttBufferDirty(BG_PLTT_ID(5) + 13, PLTT_SIZEOF(1));
         sprite->sPalIdx += 2;
         if (sprite->sPalIdx != 0x1CE)
             break;
@@ -2513,6 +2518,7 @@ static void SpriteCB_Lightning(struct Sprite *sprite)
         {
             sprite->sDelay = 4;
             CpuCopy16(INTRO3_RAW_PTR(sprite->sPalIdx), &gPlttBufferFaded[BG_PLTT_ID(5) + 13], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(5) + 13, PLTT_SIZEOF(1));
             sprite->sPalIdx -= 2;
             if (sprite->sPalIdx == 0x1C0)
                 DestroySprite(sprite);
@@ -2616,6 +2622,7 @@ static void Task_RayquazaAttack(u8 taskId)
         if ((data[2] & 1) != 0)
         {
             CpuCopy16(INTRO3_RAW_PTR(0x1A2 + data[1] * 2), &gPlttBufferFaded[BG_PLTT_ID(5) + 14], PLTT_SIZEOF(1));
+            MarkPlttBufferDirty(BG_PLTT_ID(5) + 14, PLTT_SIZEOF(1));
             data[1]++;
         }
         if (data[1] == 6)
@@ -2631,6 +2638,7 @@ static void Task_RayquazaAttack(u8 taskId)
             if ((data[2] & 1) != 0)
             {
                 CpuCopy16(INTRO3_RAW_PTR(0x1A2 + data[1] * 2), &gPlttBufferFaded[BG_PLTT_ID(5) + 8], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(BG_PLTT_ID(5) + 8, PLTT_SIZEOF(1));
                 data[1]++;
             }
             if (data[1] == 6)
@@ -2650,6 +2658,7 @@ static void Task_RayquazaAttack(u8 taskId)
             if ((data[2] & 1) != 0)
             {
                 CpuCopy16(INTRO3_RAW_PTR(0x182 + data[1] * 2), &gPlttBufferFaded[BG_PLTT_ID(5) + 12], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(BG_PLTT_ID(5) + 12, PLTT_SIZEOF(1));
                 data[1]++;
             }
             if (data[1] == 6)
@@ -2676,6 +2685,7 @@ static void Task_RayquazaAttack(u8 taskId)
                 CpuCopy16(INTRO3_RAW_PTR(428), &gPlttBufferFaded[BG_PLTT_ID(5) + 14], PLTT_SIZEOF(1));
                 CpuCopy16(INTRO3_RAW_PTR(428), &gPlttBufferFaded[BG_PLTT_ID(5) + 8], PLTT_SIZEOF(1));
                 CpuCopy16(INTRO3_RAW_PTR(396), &gPlttBufferFaded[BG_PLTT_ID(5) + 12], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(BG_PLTT_ID(5), PLTT_SIZE_4BPP);
             }
             else
             {
@@ -3209,6 +3219,7 @@ static void SpriteCB_LogoLetter(struct Sprite *sprite)
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer],      &gPlttBufferFaded[OBJ_PLTT_ID(1) + 15], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 16], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 4], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 32], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 10], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(OBJ_PLTT_ID(1), PLTT_SIZE_4BPP);
                 sprite->sTimer--;
             }
             else
@@ -3216,6 +3227,7 @@ static void SpriteCB_LogoLetter(struct Sprite *sprite)
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer],      &gPlttBufferFaded[OBJ_PLTT_ID(1) + 15], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 16], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 4], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 32], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 10], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(OBJ_PLTT_ID(1), PLTT_SIZE_4BPP);
                 sprite->sState++;
             }
         }
@@ -3238,6 +3250,7 @@ static void SpriteCB_LogoLetter(struct Sprite *sprite)
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer],      &gPlttBufferFaded[OBJ_PLTT_ID(1) + 15], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 16], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 4], PLTT_SIZEOF(1));
                 CpuCopy16(&gIntroGameFreakTextFade_Pal[sprite->sTimer + 32], &gPlttBufferFaded[OBJ_PLTT_ID(1) + 10], PLTT_SIZEOF(1));
+                MarkPlttBufferDirty(OBJ_PLTT_ID(1), PLTT_SIZE_4BPP);
                 sprite->sTimer++;
             }
             else
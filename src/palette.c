@@ -65,6 +65,11 @@ EWRAM_DATA struct PaletteFadeControl gPaletteFade = {0};
 static EWRAM_DATA u32 sFiller = 0;
 static EWRAM_DATA u32 sPlttBufferTransferPending = 0;
 EWRAM_DATA u8 ALIGNED(2) gPaletteDecompressionBuffer[PLTT_SIZE] = {0};
+#ifdef DIRTY_PALETTE_UPLOADS
+// One bit per 16 color palette of gPlttBufferFaded that palette RAM doesn't have yet
+static EWRAM_DATA u32 sPlttBufferDirty = 0;
+static EWRAM_DATA struct PlttUploadStats sPlttUploadStats = {0};
+#endif
 
 static const struct PaletteStructTemplate sDummyPaletteStructTemplate = {
     .id = 0xFFFF,
@@ -86,25 +91,113 @@ void LoadCompressedPalette(const u32 *src, u16 offset, u16 size)
     LZDecompressWram(src, gPaletteDecompressionBuffer);
     CpuCopy16(gPaletteDecompressionBuffer, &gPlttBufferUnfaded[offset], size);
     CpuCopy16(gPaletteDecompressionBuffer, &gPlttBufferFaded[offset], size);
+    MarkPlttBufferDirty(offset, size);
 }
 
 void LoadPalette(const void *src, u16 offset, u16 size)
 {
     CpuCopy16(src, &gPlttBufferUnfaded[offset], size);
     CpuCopy16(src, &gPlttBufferFaded[offset], size);
+    MarkPlttBufferDirty(offset, size);
 }
 
 void FillPalette(u16 value, u16 offset, u16 size)
 {
     CpuFill16(value, &gPlttBufferUnfaded[offset], size);
     CpuFill16(value, &gPlttBufferFaded[offset], size);
+    MarkPlttBufferDirty(offset, size);
 }
 
+#ifdef DIRTY_PALETTE_UPLOADS
+
+// With more dirty palettes than this, one copy of the whole buffer is cheaper
+// than a transfer per run of dirty palettes.
+#define DIRTY_PALETTE_FULL_COPY_THRESHOLD 16
+
+void MarkPlttBufferDirty(u16 offset, u16 size)
+{
+    u32 first, last;
+
+    if (size == 0 || offset >= PLTT_BUFFER_SIZE)
+        return;
+
+    first = offset / 16;
+    last = (offset + size / sizeof(u16) - 1) / 16;
+    if (last > 31)
+        last = 31;
+
+    // Bits first to last inclusive. 2u << 31 wraps to 0, which still works.
+    sPlttBufferDirty |= (2u << last) - (1u << first);
+}
+
+void MarkPalettesDirty(u32 selectedPalettes)
+{
+    sPlttBufferDirty |= selectedPalettes;
+}
+
+const struct PlttUploadStats *GetPlttUploadStats(void)
+{
+    return &sPlttUploadStats;
+}
+
+static void UploadDirtyPalettes(void)
+{
+    u32 dirty = sPlttBufferDirty;
+    u32 palettes, bytes;
+    u8 transfers;
+    u8 first;
+
+    for (palettes = 0; dirty != 0; dirty &= dirty - 1)
+        palettes++;
+
+    if (palettes > DIRTY_PALETTE_FULL_COPY_THRESHOLD)
+    {
+        DmaCopy16Defvars(3, gPlttBufferFaded, (void *)PLTT, PLTT_SIZE);
+        bytes = PLTT_SIZE;
+        transfers = 1;
+        sPlttUploadStats.fullCopy = TRUE;
+    }
+    else
+    {
+        // Copy each run of consecutive dirty palettes with one transfer
+        dirty = sPlttBufferDirty;
+        bytes = 0;
+        transfers = 0;
+        for (first = 0; dirty != 0; first++, dirty >>= 1)
+        {
+            u8 count;
+
+            if (!(dirty & 1))
+                continue;
+
+            for (count = 0; dirty & 1; count++)
+                dirty >>= 1;
+
+            DmaCopy32Defvars(3, &gPlttBufferFaded[PLTT_ID(first)], (void *)(PLTT + PLTT_OFFSET_4BPP(first)), count * PLTT_SIZE_4BPP);
+            bytes += count * PLTT_SIZE_4BPP;
+            transfers++;
+            first += count;
+        }
+        sPlttUploadStats.fullCopy = FALSE;
+    }
+
+    sPlttBufferDirty = 0;
+    sPlttUploadStats.bytes = bytes;
+    sPlttUploadStats.transfers = transfers;
+    sPlttUploadStats.totalBytes += bytes;
+}
+
+#endif // DIRTY_PALETTE_UPLOADS
+
 void TransferPlttBuffer(void)
 {
     if (!gPaletteFade.bufferTransferDisabled)
     {
+#ifdef DIRTY_PALETTE_UPLOADS
+        UploadDirtyPalettes();
+#else
         DmaCopy16Defvars(3, gPlttBufferFaded, (void *)PLTT, PLTT_SIZE);
+#endif
         sPlttBufferTransferPending = FALSE;
         if (gPaletteFade.mode == HARDWARE_FADE && gPaletteFade.active)
             UpdateBlendRegisters();
@@ -139,6 +232,10 @@ void ResetPaletteFade(void)
         PaletteStruct_Reset(i);
 
     ResetPaletteFadeControl();
+
+    // Screens usually clear palette RAM directly before resetting the fade,
+    // so the next transfer can't rely on what it uploaded before.
+    MarkPalettesDirty(PALETTES_ALL);
 }
 
 static void ReadPlttIntoBuffers(void)
@@ -191,6 +288,9 @@ bool8 BeginNormalPaletteFade(u32 selectedPalettes, s8 delay, u8 startY, u8 targe
         temp = gPaletteFade.bufferTransferDisabled;
         gPaletteFade.bufferTransferDisabled = FALSE;
         CpuCopy32(gPlttBufferFaded, (void *)PLTT, PLTT_SIZE);
+#ifdef DIRTY_PALETTE_UPLOADS
+        sPlttBufferDirty = 0;
+#endif
         sPlttBufferTransferPending = FALSE;
         if (gPaletteFade.mode == HARDWARE_FADE && gPaletteFade.active)
             UpdateBlendRegisters();
@@ -263,6 +363,7 @@ static void PaletteStruct_Copy(struct PaletteStruct *palStruct, u32 *unkFlags)
     }
 
     palStruct->destOffset = palStruct->baseDestOffset;
+    MarkPlttBufferDirty(palStruct->baseDestOffset, PLTT_SIZEOF(palStruct->template->size));
     palStruct->countdown1 = palStruct->template->time1;
     palStruct->srcIndex++;
 
@@ -305,6 +406,7 @@ static void PaletteStruct_Blend(struct PaletteStruct *palStruct, u32 *unkFlags)
 
                     for (i = 0; i < palStruct->template->size; i++)
                         gPlttBufferFaded[palStruct->baseDestOffset + i] = palStruct->template->src[srcOffset + i];
+                    MarkPlttBufferDirty(palStruct->baseDestOffset, PLTT_SIZEOF(palStruct->template->size));
                 }
             }
         }
@@ -493,6 +595,8 @@ void InvertPlttBuffer(u32 selectedPalettes)
 {
     u16 paletteOffset = 0;
 
+    MarkPalettesDirty(selectedPalettes);
+
     while (selectedPalettes)
     {
         if (selectedPalettes & 1)
@@ -510,6 +614,8 @@ void TintPlttBuffer(u32 selectedPalettes, s8 r, s8 g, s8 b)
 {
     u16 paletteOffset = 0;
 
+    MarkPalettesDirty(selectedPalettes);
+
     while (selectedPalettes)
     {
         if (selectedPalettes & 1)
@@ -532,6 +638,8 @@ void UnfadePlttBuffer(u32 selectedPalettes)
 {
     u16 paletteOffset = 0;
 
+    MarkPalettesDirty(selectedPalettes);
+
     while (selectedPalettes)
     {
         if (selectedPalettes & 1)
@@ -564,6 +672,8 @@ static void BeginFastPaletteFadeInternal(u8 submode)
     if (submode == FAST_FADE_IN_FROM_WHITE)
         CpuFill16(RGB_WHITE, gPlttBufferFaded, PLTT_SIZE);
 
+    MarkPalettesDirty(PALETTES_ALL);
+
     UpdatePaletteFade();
 }
 
@@ -688,6 +798,8 @@ static u8 UpdateFastPaletteFade(void)
         }
     }
 
+    MarkPlttBufferDirty(paletteOffsetStart, PLTT_SIZEOF(paletteOffsetEnd - paletteOffsetStart));
+
     gPaletteFade.objPaletteToggle ^= 1;
 
     if (gPaletteFade.objPaletteToggle)
@@ -715,6 +827,7 @@ static u8 UpdateFastPaletteFade(void)
             CpuFill32(0x00000000, gPlttBufferFaded, PLTT_SIZE);
             break;
         }
+        MarkPalettesDirty(PALETTES_ALL);
 
         gPaletteFade.mode = NORMAL_FADE;
         gPaletteFade.softwareFadeFinishing = TRUE;
@@ -842,6 +955,7 @@ void BlendPalettes(u32 selectedPalettes, u8 coeff, u16 color)
 void BlendPalettesUnfaded(u32 selectedPalettes, u8 coeff, u16 color)
 {
     DmaCopy32Defvars(3, gPlttBufferUnfaded, gPlttBufferFaded, PLTT_SIZE);
+    MarkPalettesDirty(PALETTES_ALL);
     BlendPalettes(selectedPalettes, coeff, color);
 }
 
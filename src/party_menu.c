@@ -781,6 +781,7 @@ static void PartyPaletteBufferCopy(u8 palNum)
     u8 offset = PLTT_ID(palNum);
     CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(3)], &gPlttBufferUnfaded[offset], PLTT_SIZE_4BPP);
     CpuCopy16(&gPlttBufferUnfaded[BG_PLTT_ID(3)], &gPlttBufferFaded[offset], PLTT_SIZE_4BPP);
+    MarkPlttBufferDirty(offset, PLTT_SIZE_4BPP);
 }
 
 static void FreePartyPointers(void)
@@ -1362,6 +1362,7 @@ static void SetWindowsHideVertBorders(void)
     SetGpuReg(REG_OFFSET_WIN0V, WIN_RANGE(24, DISPLAY_HEIGHT - 24));
     gPlttBufferUnfaded[0] = 0;
     gPlttBufferFaded[0] = 0;
+    MarkPlttBufferDirty(0, PLTT_SIZEOF(1));
 }
 
 static void ResetWindowDimensions(void)
@@ -2242,6 +2243,7 @@ static void LoadDescendsSceneGfx(void)
     LoadCompressedPalette(gRaySceneDescends_Bg_Pal, BG_PLTT_ID(0), 2 * PLTT_SIZE_4BPP);
     gPlttBufferUnfaded[0] = RGB_WHITE;
     gPlttBufferFaded[0] = RGB_WHITE;
+    MarkPlttBufferDirty(0, PLTT_SIZEOF(1));
     LoadCompressedSpriteSheet(&sSpriteSheet_Descends_Rayquaza);
     LoadCompressedSpriteSheet(&sSpriteSheet_Descends_RayquazaTail);
     LoadCompressedSpritePalette(&sSpritePal_Descends_Rayquaza);
@@ -1132,6 +1132,8 @@ static void InitRouletteTableData(void)
         gPlttBufferUnfaded[BG_PLTT_ID(0)] = gPlttBufferUnfaded[BG_PLTT_ID(5) + 1] = gPlttBufferFaded[BG_PLTT_ID(0)] = gPlttBufferFaded[BG_PLTT_ID(5) + 1] = bgColors[0];
     else
         gPlttBufferUnfaded[BG_PLTT_ID(0)] = gPlttBufferUnfaded[BG_PLTT_ID(5) + 1] = gPlttBufferFaded[BG_PLTT_ID(0)] = gPlttBufferFaded[BG_PLTT_ID(5) + 1] = bgColors[1];
+    MarkPlttBufferDirty(BG_PLTT_ID(0), PLTT_SIZEOF(1));
+    MarkPlttBufferDirty(BG_PLTT_ID(5) + 1, PLTT_SIZEOF(1));
 
     RouletteFlash_Reset(&sRoulette->flashUtil);
 
@@ -502,6 +502,7 @@ static void SpriteCB_PokemonLogoShine(struct Sprite *sprite)
                 gPlttBufferFaded[0] = RGB(24, 31, 12);
             else
                 gPlttBufferFaded[0] = backgroundColor;
+            MarkPlttBufferDirty(0, PLTT_SIZEOF(1));
         }
 
         sprite->x += SHINE_SPEED;
@@ -510,6 +511,7 @@ static void SpriteCB_PokemonLogoShine(struct Sprite *sprite)
     {
         // Sprite has moved fully offscreen
         gPlttBufferFaded[0] = RGB_BLACK;
+        MarkPlttBufferDirty(0, PLTT_SIZEOF(1));
         DestroySprite(sprite);
     }
 }
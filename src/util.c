@@ -261,9 +261,59 @@ u32 CalcByteArraySum(const u8 *data, u32 length)
     return sum;
 }
 
+#ifdef FAST_PALETTE_FADES
+// Blended value of each source channel, already shifted into place, for the
+// coefficient and blend color in sBlendTableKey. A fade step blends every
+// palette with the same pair, so the tables are rebuilt once per step.
+// They are in IWRAM (.bss) so the lookups don't wait on EWRAM.
+static u16 sBlendTableR[32];
+static u16 sBlendTableG[32];
+static u16 sBlendTableB[32];
+static u32 sBlendTableKey;
+
+#define BLEND_TABLE_KEY(coeff, blendColor) ((((coeff) + 1) << 16) | (blendColor))
+
+static void BuildBlendTables(u8 coeff, u16 blendColor)
+{
+    s32 i;
+    struct PlttData *data2 = (struct PlttData *)&blendColor;
+
+    // Same math as the loop in BlendPalette, one channel value at a time.
+    for (i = 0; i < 32; i++)
+    {
+        sBlendTableR[i] = i + (((data2->r - i) * coeff) >> 4);
+        sBlendTableG[i] = (i + (((data2->g - i) * coeff) >> 4)) << 5;
+        sBlendTableB[i] = (i + (((data2->b - i) * coeff) >> 4)) << 10;
+    }
+    sBlendTableKey = BLEND_TABLE_KEY(coeff, blendColor);
+}
+#endif // FAST_PALETTE_FADES
+
 void BlendPalette(u16 palOffset, u16 numEntries, u8 coeff, u16 blendColor)
 {
     u16 i;
+#ifdef FAST_PALETTE_FADES
+    // Past 16 the channels leave 0-31 and spill into each other, which
+    // the tables can't reproduce, so those fall through to the loop below.
+    if (coeff <= 16)
+    {
+        const u16 *src = &gPlttBufferUnfaded[palOffset];
+        u16 *dest = &gPlttBufferFaded[palOffset];
+
+        if (sBlendTableKey != BLEND_TABLE_KEY(coeff, blendColor))
+            BuildBlendTables(coeff, blendColor);
+
+        for (i = 0; i < numEntries; i++)
+        {
+            u32 color = *src++;
+            *dest++ = sBlendTableR[color & 0x1F]
+                    | sBlendTableG[(color >> 5) & 0x1F]
+                    | sBlendTableB[(color >> 10) & 0x1F];
+        }
+        MarkPlttBufferDirty(palOffset, PLTT_SIZEOF(numEntries));
+        return;
+    }
+#endif
     for (i = 0; i < numEntries; i++)
     {
         u16 index = i + palOffset;
@@ -276,4 +326,5 @@ void BlendPalette(u16 palOffset, u16 numEntries, u8 coeff, u16 blendColor)
                                       g + (((data2->g - g) * coeff) >> 4),
                                       b + (((data2->b - b) * coeff) >> 4));
     }
+    MarkPlttBufferDirty(palOffset, PLTT_SIZEOF(numEntries));
 }
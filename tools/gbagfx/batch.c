@@ -0,0 +1,408 @@
+// Runs many gbagfx commands from a manifest file in one process.
+//
+// Each non-empty line of the manifest holds the arguments of one gbagfx
+// invocation, e.g. "graphics/foo.png graphics/foo.4bpp -mwidth 4". Arguments
+// are separated by whitespace and may be double-quoted; lines starting with
+// '#' are comments. Commands run on a pool of worker threads, so lines are
+// independent unless they share files: a line whose arguments name a file an
+// earlier line writes (its OUTPUT_PATH) waits for that line, so a manifest can
+// chain steps like "foo.png foo.4bpp" and "foo.4bpp foo.4bpp.lz". A failing
+// command does not stop the others, but lines that wait on it are skipped; the
+// line numbers and error messages are reported once all commands have finished.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "global.h"
+#include "util.h"
+#include "batch.h"
+#include "cache.h"
+
+struct BatchCommand {
+    int lineNumber;
+    int argc;
+    char **argv;
+    int exitStatus;
+    char *errorMessage;
+    int *dependencies;
+    int numDependencies;
+    bool done;
+};
+
+struct Batch {
+    struct BatchCommand *commands;
+    int numCommands;
+    int nextCommand;
+    pthread_mutex_t mutex;
+    pthread_cond_t commandDone;
+};
+
+// Open-addressed map from an output path to the last command writing it.
+struct WriterTable {
+    const char **paths;
+    int *commands;
+    unsigned int mask;
+};
+
+static char *CopyString(const char *s, size_t length)
+{
+    char *copy = malloc(length + 1);
+
+    if (copy == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch command.\n");
+
+    memcpy(copy, s, length);
+    copy[length] = 0;
+
+    return copy;
+}
+
+// Splits a manifest line into arguments. argv[0] is the program name, as for main.
+static char **SplitArguments(char *line, int *argc)
+{
+    int capacity = 8;
+    char **argv = malloc(capacity * sizeof(char *));
+
+    if (argv == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch command.\n");
+
+    argv[0] = "gbagfx";
+    *argc = 1;
+
+    char *s = line;
+
+    for (;;)
+    {
+        while (*s == ' ' || *s == '\t')
+            s++;
+
+        if (*s == 0)
+            break;
+
+        char *start = s;
+
+        if (*s == '"')
+        {
+            start = ++s;
+
+            while (*s != 0 && *s != '"')
+                s++;
+        }
+        else
+        {
+            while (*s != 0 && *s != ' ' && *s != '\t')
+                s++;
+        }
+
+        if (*argc + 1 >= capacity)
+        {
+            capacity *= 2;
+            argv = realloc(argv, capacity * sizeof(char *));
+
+            if (argv == NULL)
+                FATAL_ERROR("Failed to allocate memory for batch command.\n");
+        }
+
+        argv[(*argc)++] = CopyString(start, s - start);
+
+        if (*s == '"')
+            s++;
+    }
+
+    argv[*argc] = NULL;
+
+    return argv;
+}
+
+static void ReadManifest(char *path, struct Batch *batch)
+{
+    int fileSize;
+    unsigned char *buffer = ReadWholeFileZeroPadded(path, &fileSize, 1);
+    char *s = (char *)buffer;
+    int capacity = 256;
+    int lineNumber = 0;
+
+    batch->commands = malloc(capacity * sizeof(struct BatchCommand));
+    batch->numCommands = 0;
+
+    if (batch->commands == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch commands.\n");
+
+    while (*s != 0)
+    {
+        char *line = s;
+
+        lineNumber++;
+
+        while (*s != 0 && *s != '\n')
+            s++;
+
+        if (*s == '\n')
+            *s++ = 0;
+
+        line[strcspn(line, "\r")] = 0;
+
+        while (*line == ' ' || *line == '\t')
+            line++;
+
+        if (*line == 0 || *line == '#')
+            continue;
+
+        if (batch->numCommands == capacity)
+        {
+            capacity *= 2;
+            batch->commands = realloc(batch->commands, capacity * sizeof(struct BatchCommand));
+
+            if (batch->commands == NULL)
+                FATAL_ERROR("Failed to allocate memory for batch commands.\n");
+        }
+
+        struct BatchCommand *command = &batch->commands[batch->numCommands++];
+        command->lineNumber = lineNumber;
+        command->argv = SplitArguments(line, &command->argc);
+        command->exitStatus = 0;
+        command->errorMessage = NULL;
+        command->dependencies = NULL;
+        command->numDependencies = 0;
+        command->done = false;
+    }
+
+    free(buffer);
+}
+
+static unsigned int HashPath(const char *path)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*path != 0)
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+    return hash;
+}
+
+static unsigned int FindWriterSlot(struct WriterTable *table, const char *path)
+{
+    unsigned int slot = HashPath(path) & table->mask;
+
+    while (table->paths[slot] != NULL && strcmp(table->paths[slot], path) != 0)
+        slot = (slot + 1) & table->mask;
+
+    return slot;
+}
+
+// Makes each command depend on the earlier commands that write a file it
+// names, whether it reads that file or writes it again.
+static void FindDependencies(struct Batch *batch)
+{
+    struct WriterTable table;
+    unsigned int capacity = 16;
+
+    while (capacity < 2 * (unsigned int)batch->numCommands)
+        capacity *= 2;
+
+    table.paths = calloc(capacity, sizeof(const char *));
+    table.commands = malloc(capacity * sizeof(int));
+    table.mask = capacity - 1;
+
+    if (table.paths == NULL || table.commands == NULL)
+        FATAL_ERROR("Failed to allocate memory for batch commands.\n");
+
+    for (int i = 0; i < batch->numCommands; i++)
+    {
+        struct BatchCommand *command = &batch->commands[i];
+
+        command->dependencies = malloc(command->argc * sizeof(int));
+        command->numDependencies = 0;
+
+        if (command->dependencies == NULL)
+            FATAL_ERROR("Failed to allocate memory for batch commands.\n");
+
+        for (int j = 1; j < command->argc; j++)
+        {
+            unsigned int slot = FindWriterSlot(&table, command->argv[j]);
+
+            if (table.paths[slot] == NULL)
+                continue;
+
+            int writer = table.commands[slot];
+            int k = 0;
+
+            while (k < command->numDependencies && command->dependencies[k] != writer)
+                k++;
+
+            if (k == command->numDependencies)
+                command->dependencies[command->numDependencies++] = writer;
+        }
+
+        if (command->argc >= 3)
+        {
+            unsigned int slot = FindWriterSlot(&table, command->argv[2]);
+            table.paths[slot] = command->argv[2];
+            table.commands[slot] = i;
+        }
+    }
+
+    free(table.paths);
+    free(table.commands);
+}
+
+// Waits, with the batch mutex held, until every command this one depends on
+// has finished. Returns the line number of one that failed, or 0.
+static int WaitForDependencies(struct Batch *batch, struct BatchCommand *command)
+{
+    for (int i = 0; i < command->numDependencies; i++)
+    {
+        struct BatchCommand *dependency = &batch->commands[command->dependencies[i]];
+
+        while (!dependency->done)
+            pthread_cond_wait(&batch->commandDone, &batch->mutex);
+
+        if (dependency->exitStatus != 0)
+            return dependency->lineNumber;
+    }
+
+    return 0;
+}
+
+static void RunBatchCommand(struct BatchCommand *command)
+{
+    struct FatalErrorHandler handler;
+
+    if (setjmp(handler.jmpBuf) == 0)
+    {
+        SetFatalErrorHandler(&handler);
+
+        if (command->argc < 3)
+            FATAL_ERROR("Expected INPUT_PATH OUTPUT_PATH [options...].\n");
+
+        RunCommand(command->argc, command->argv);
+        SetFatalErrorHandler(NULL);
+    }
+    else
+    {
+        command->exitStatus = 1;
+        command->errorMessage = CopyString(handler.message, strlen(handler.message));
+    }
+}
+
+static void *BatchWorker(void *arg)
+{
+    struct Batch *batch = arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->mutex);
+        int index = batch->nextCommand++;
+
+        if (index >= batch->numCommands)
+        {
+            pthread_mutex_unlock(&batch->mutex);
+            break;
+        }
+
+        // Commands are handed out in order, so everything this one waits on
+        // has already been picked up by a worker.
+        struct BatchCommand *command = &batch->commands[index];
+        int failedLine = WaitForDependencies(batch, command);
+        pthread_mutex_unlock(&batch->mutex);
+
+        if (failedLine != 0)
+        {
+            char message[64];
+            snprintf(message, sizeof(message), "Skipped, since line %d failed.\n", failedLine);
+            command->exitStatus = 1;
+            command->errorMessage = CopyString(message, strlen(message));
+        }
+        else
+        {
+            RunBatchCommand(command);
+        }
+
+        pthread_mutex_lock(&batch->mutex);
+        command->done = true;
+        pthread_cond_broadcast(&batch->commandDone);
+        pthread_mutex_unlock(&batch->mutex);
+    }
+
+    return NULL;
+}
+
+static int GetDefaultNumThreads(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long numProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (numProcessors > 0)
+        return (int)numProcessors;
+#endif
+
+    return 1;
+}
+
+int RunBatch(char *manifestPath, int numThreads)
+{
+    struct Batch batch;
+
+    ReadManifest(manifestPath, &batch);
+    FindDependencies(&batch);
+    batch.nextCommand = 0;
+    pthread_mutex_init(&batch.mutex, NULL);
+    pthread_cond_init(&batch.commandDone, NULL);
+
+    if (numThreads == 0)
+        numThreads = GetDefaultNumThreads();
+
+    if (numThreads > batch.numCommands)
+        numThreads = batch.numCommands;
+
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+
+    if (numThreads > 0 && threads == NULL)
+        FATAL_ERROR("Failed to allocate memory for worker threads.\n");
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        if (pthread_create(&threads[i], NULL, BatchWorker, &batch) != 0)
+            FATAL_ERROR("Failed to create worker thread.\n");
+    }
+
+    for (int i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_cond_destroy(&batch.commandDone);
+    pthread_mutex_destroy(&batch.mutex);
+    CacheTrim();
+
+    int numFailed = 0;
+
+    for (int i = 0; i < batch.numCommands; i++)
+    {
+        struct BatchCommand *command = &batch.commands[i];
+
+        if (command->exitStatus != 0)
+        {
+            fprintf(stderr, "%s:%d: exit status %d: %s", manifestPath, command->lineNumber,
+                    command->exitStatus, command->errorMessage);
+            numFailed++;
+        }
+
+        for (int j = 1; j < command->argc; j++)
+            free(command->argv[j]);
+
+        free(command->argv);
+        free(command->errorMessage);
+        free(command->dependencies);
+    }
+
+    if (numFailed != 0)
+        fprintf(stderr, "%d of %d commands failed.\n", numFailed, batch.numCommands);
+
+    free(batch.commands);
+
+    return numFailed != 0;
+}
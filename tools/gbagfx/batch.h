@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Runs a single gbagfx command line. Defined in main.c.
+void RunCommand(int argc, char **argv);
+
+// Runs every command in the manifest on a pool of numThreads worker threads
+// (0 picks the number of online processors) and returns the exit status.
+// A command that names an earlier command's output waits for it to finish.
+int RunBatch(char *manifestPath, int numThreads);
+
+#endif // BATCH_H
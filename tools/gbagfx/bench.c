@@ -0,0 +1,362 @@
+// Benchmarks for gbagfx's compression and conversion routines.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "global.h"
+#include "util.h"
+#include "lz.h"
+#include "gfx.h"
+#include "convert_png.h"
+#include "tile_pack.h"
+#include "huff.h"
+
+#define TILE_BENCH_REPEATS 200
+
+typedef void (*PackTileFunc)(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest);
+
+static double ElapsedSeconds(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double MegabytesPerSecond(long long bytes, double seconds)
+{
+    if (seconds <= 0.0)
+        return 0.0;
+
+    return bytes / seconds / (1024.0 * 1024.0);
+}
+
+static void BenchLZ(int numFiles, char **paths)
+{
+    long long totalSize = 0;
+    long long totalCompressedSize = 0;
+    long long totalOptimalSize = 0;
+    double oldSeconds = 0.0;
+    double newSeconds = 0.0;
+    double optimalSeconds = 0.0;
+
+    for (int i = 0; i < numFiles; i++)
+    {
+        int fileSize;
+        unsigned char *buffer = ReadWholeFile(paths[i], &fileSize);
+
+        if (fileSize == 0)
+        {
+            free(buffer);
+            continue;
+        }
+
+        int oldSize, newSize;
+        clock_t start = clock();
+        unsigned char *oldData = LZCompressBruteForce(buffer, fileSize, &oldSize, 2);
+        oldSeconds += ElapsedSeconds(start);
+
+        start = clock();
+        unsigned char *newData = LZCompress(buffer, fileSize, &newSize, 2);
+        newSeconds += ElapsedSeconds(start);
+
+        if (oldSize != newSize || memcmp(oldData, newData, newSize) != 0)
+            FATAL_ERROR("LZ output mismatch for \"%s\".\n", paths[i]);
+
+        int optimalSize;
+        start = clock();
+        unsigned char *optimalData = LZCompressOptimal(buffer, fileSize, &optimalSize, 2);
+        optimalSeconds += ElapsedSeconds(start);
+
+        totalSize += fileSize;
+        totalCompressedSize += newSize;
+        totalOptimalSize += optimalSize;
+
+        free(oldData);
+        free(newData);
+        free(optimalData);
+        free(buffer);
+    }
+
+    printf("lz: %d files, %lld bytes -> %lld bytes\n", numFiles, totalSize, totalCompressedSize);
+    printf("  brute force: %8.3f s, %8.2f MB/s\n", oldSeconds, MegabytesPerSecond(totalSize, oldSeconds));
+    printf("  hash chain:  %8.3f s, %8.2f MB/s\n", newSeconds, MegabytesPerSecond(totalSize, newSeconds));
+    printf("  optimal:     %8.3f s, %8.2f MB/s, %lld bytes (saved %lld)\n", optimalSeconds,
+           MegabytesPerSecond(totalSize, optimalSeconds), totalOptimalSize, totalCompressedSize - totalOptimalSize);
+}
+
+static double PackAllTiles(PackTileFunc packTile, struct Image *image, int pixelBitDepth, unsigned char *dest)
+{
+    int tilesWidth = image->width / 8;
+    int tilesHeight = image->height / 8;
+    int pitch = tilesWidth * pixelBitDepth;
+    int tileSize = image->bitDepth * 8;
+    clock_t start = clock();
+
+    for (int repeat = 0; repeat < TILE_BENCH_REPEATS; repeat++)
+    {
+        for (int tileY = 0; tileY < tilesHeight; tileY++)
+        {
+            for (int tileX = 0; tileX < tilesWidth; tileX++)
+            {
+                unsigned char *rows[8];
+
+                for (int j = 0; j < 8; j++)
+                    rows[j] = &image->pixels[(tileY * 8 + j) * pitch + tileX * pixelBitDepth];
+
+                packTile(rows, pixelBitDepth, image->bitDepth, !image->hasPalette, &dest[(tileY * tilesWidth + tileX) * tileSize]);
+            }
+        }
+    }
+
+    return ElapsedSeconds(start);
+}
+
+static void BenchTiles(int numFiles, char **paths)
+{
+    long long totalSize = 0;
+    double readSeconds = 0.0;
+    double simdSeconds = 0.0;
+    double scalarSeconds = 0.0;
+
+    for (int i = 0; i < numFiles; i++)
+    {
+        struct Image image;
+        int pixelBitDepth;
+
+        image.bitDepth = 4;
+        image.tilemap.data.affine = NULL;
+
+        clock_t start = clock();
+        ReadPngPixels(paths[i], &image, &pixelBitDepth);
+        readSeconds += ElapsedSeconds(start);
+
+        if (pixelBitDepth == 8)
+            image.bitDepth = 8;
+
+        if (image.width % 8 != 0 || image.height % 8 != 0)
+        {
+            FreeImage(&image);
+            continue;
+        }
+
+        int outputSize = image.width * image.height * image.bitDepth / 8;
+        unsigned char *simdOutput = malloc(outputSize);
+        unsigned char *scalarOutput = malloc(outputSize);
+
+        if (simdOutput == NULL || scalarOutput == NULL)
+            FATAL_ERROR("Failed to allocate memory for tiles.\n");
+
+        simdSeconds += PackAllTiles(PackTile, &image, pixelBitDepth, simdOutput);
+        scalarSeconds += PackAllTiles(PackTileScalar, &image, pixelBitDepth, scalarOutput);
+
+        if (memcmp(simdOutput, scalarOutput, outputSize) != 0)
+            FATAL_ERROR("Tile output mismatch for \"%s\".\n", paths[i]);
+
+        totalSize += (long long)outputSize * TILE_BENCH_REPEATS;
+
+        free(simdOutput);
+        free(scalarOutput);
+        FreeImage(&image);
+    }
+
+    printf("tiles: %d files, %lld tile bytes packed (%d passes)\n", numFiles, totalSize, TILE_BENCH_REPEATS);
+    printf("  png decode:  %8.3f s (one pass)\n", readSeconds);
+    printf("  simd pack:   %8.3f s, %8.2f MB/s\n", simdSeconds, MegabytesPerSecond(totalSize, simdSeconds));
+    printf("  scalar pack: %8.3f s, %8.2f MB/s\n", scalarSeconds, MegabytesPerSecond(totalSize, scalarSeconds));
+}
+
+static void RoundTripHuff(unsigned char *data, int size, int bitDepth, const char *name, double *compressSeconds, double *decompressSeconds)
+{
+    int compressedSize, uncompressedSize;
+    clock_t start = clock();
+    unsigned char *compressed = HuffCompress(data, size, &compressedSize, bitDepth);
+    *compressSeconds += ElapsedSeconds(start);
+
+    start = clock();
+    unsigned char *uncompressed = HuffDecompress(compressed, compressedSize, &uncompressedSize);
+    *decompressSeconds += ElapsedSeconds(start);
+
+    if (uncompressedSize != size || memcmp(uncompressed, data, size) != 0)
+        FATAL_ERROR("Huffman %d-bit round trip mismatch for %s.\n", bitDepth, name);
+
+    free(compressed);
+    free(uncompressed);
+}
+
+// Some 8-bit trees are too unbalanced for the format's 6-bit child offsets.
+// HuffCompress rejects those, which is not a round-trip failure.
+static bool TryRoundTripHuff(unsigned char *data, int size, int bitDepth, const char *name, double *compressSeconds, double *decompressSeconds)
+{
+    struct FatalErrorHandler handler;
+
+    if (setjmp(handler.jmpBuf) == 0)
+    {
+        SetFatalErrorHandler(&handler);
+        RoundTripHuff(data, size, bitDepth, name, compressSeconds, decompressSeconds);
+        SetFatalErrorHandler(NULL);
+        return true;
+    }
+
+    if (strstr(handler.message, "unable to encode binary tree") == NULL)
+        FATAL_ERROR("%s", handler.message);
+
+    return false;
+}
+
+static void BenchHuff(int numFiles, char **paths)
+{
+    for (int bitDepth = 4; bitDepth <= 8; bitDepth += 4)
+    {
+        long long totalSize = 0;
+        double compressSeconds = 0.0;
+        double decompressSeconds = 0.0;
+        int numUnencodable = 0;
+
+        for (int i = 0; i < numFiles; i++)
+        {
+            int fileSize;
+            unsigned char *buffer = ReadWholeFile(paths[i], &fileSize);
+
+            // The GBA format works on whole 32-bit words.
+            fileSize &= ~3;
+
+            if (fileSize > 0)
+            {
+                if (TryRoundTripHuff(buffer, fileSize, bitDepth, paths[i], &compressSeconds, &decompressSeconds))
+                    totalSize += fileSize;
+                else
+                    numUnencodable++;
+            }
+
+            free(buffer);
+        }
+
+        printf("huff %d-bit: %d files, %lld bytes, %d files with unencodable trees\n", bitDepth, numFiles, totalSize, numUnencodable);
+        printf("  compress:   %8.3f s, %8.2f MB/s\n", compressSeconds, MegabytesPerSecond(totalSize, compressSeconds));
+        printf("  decompress: %8.3f s, %8.2f MB/s\n", decompressSeconds, MegabytesPerSecond(totalSize, decompressSeconds));
+    }
+}
+
+// Round-trips random data through the Huffman coder. Inputs are drawn from
+// skewed distributions over a varying number of symbols so that both short
+// codes and codes longer than the decoder's lookup table are exercised.
+static void FuzzHuff(int iterations)
+{
+    double compressSeconds = 0.0;
+    double decompressSeconds = 0.0;
+    int numUnencodable = 0;
+
+    srand(1);
+
+    for (int i = 0; i < iterations; i++)
+    {
+        int bitDepth = (i & 1) ? 8 : 4;
+        int numSymbols = 1 + rand() % (1 << bitDepth);
+        int size = 4 * (1 + rand() % 4096);
+        int skew = rand() % 4;
+        unsigned char *data = malloc(size);
+        char name[32];
+
+        if (data == NULL)
+            FATAL_ERROR("Failed to allocate memory for fuzz input.\n");
+
+        for (int j = 0; j < size * 8 / bitDepth; j++)
+        {
+            int symbol = rand() % numSymbols;
+
+            // Each level of skew favors smaller symbols more strongly.
+            for (int k = 0; k < skew; k++)
+                symbol = rand() % (symbol + 1);
+
+            if (bitDepth == 8)
+                data[j] = symbol;
+            else if (j & 1)
+                data[j / 2] |= symbol << 4;
+            else
+                data[j / 2] = symbol;
+        }
+
+        snprintf(name, sizeof(name), "fuzz case %d", i);
+
+        if (!TryRoundTripHuff(data, size, bitDepth, name, &compressSeconds, &decompressSeconds))
+            numUnencodable++;
+
+        free(data);
+    }
+
+    printf("huff-fuzz: %d round trips passed, %d inputs had unencodable trees\n", iterations - numUnencodable, numUnencodable);
+    printf("  compress:   %8.3f s\n", compressSeconds);
+    printf("  decompress: %8.3f s\n", decompressSeconds);
+}
+
+// Reads one path per line from stdin, for file lists too long for the command line.
+static char **ReadPathList(int *numPaths)
+{
+    int capacity = 256;
+    char **paths = malloc(capacity * sizeof(char *));
+    char line[4096];
+
+    *numPaths = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        line[strcspn(line, "\r\n")] = 0;
+
+        if (line[0] == 0)
+            continue;
+
+        if (*numPaths == capacity)
+        {
+            capacity *= 2;
+            paths = realloc(paths, capacity * sizeof(char *));
+        }
+
+        if (paths == NULL)
+            FATAL_ERROR("Failed to allocate memory for path list.\n");
+
+        char *path = malloc(strlen(line) + 1);
+
+        if (path == NULL)
+            FATAL_ERROR("Failed to allocate memory for path list.\n");
+
+        strcpy(path, line);
+        paths[(*numPaths)++] = path;
+    }
+
+    return paths;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        FATAL_ERROR("Usage: gbagfx-bench lz|tiles|huff [FILES...]\n"
+                    "       gbagfx-bench huff-fuzz [ITERATIONS]\n"
+                    "Reads the file list from stdin when no files are given.\n");
+
+    if (strcmp(argv[1], "huff-fuzz") == 0)
+    {
+        int iterations = 1000;
+
+        if (argc > 2 && (!ParseNumber(argv[2], NULL, 10, &iterations) || iterations < 1))
+            FATAL_ERROR("Failed to parse number of iterations.\n");
+
+        FuzzHuff(iterations);
+        return 0;
+    }
+
+    int numPaths = argc - 2;
+    char **paths = argv + 2;
+
+    if (numPaths == 0)
+        paths = ReadPathList(&numPaths);
+
+    if (strcmp(argv[1], "lz") == 0)
+        BenchLZ(numPaths, paths);
+    else if (strcmp(argv[1], "tiles") == 0)
+        BenchTiles(numPaths, paths);
+    else if (strcmp(argv[1], "huff") == 0)
+        BenchHuff(numPaths, paths);
+    else
+        FATAL_ERROR("Unknown benchmark \"%s\".\n", argv[1]);
+
+    return 0;
+}
@@ -0,0 +1,5 @@
+#!/bin/sh
+# Compares the LZ match finders on every converted tile image under graphics/.
+# Run from the repository root after the graphics have been built.
+
+find graphics -name '*.4bpp' -o -name '*.8bpp' | tools/gbagfx/gbagfx-bench lz
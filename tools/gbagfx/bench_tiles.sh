@@ -0,0 +1,5 @@
+#!/bin/sh
+# Times tile packing on the largest PNGs under graphics/.
+# Run from the repository root.
+
+find graphics -name '*.png' -printf '%s %p\n' | sort -rn | head -n "${1:-32}" | cut -d' ' -f2- | tools/gbagfx/gbagfx-bench tiles
@@ -0,0 +1,383 @@
+// Content-addressed cache of gbagfx outputs.
+//
+// Each entry is a file in GBAGFX_CACHE_DIR named after the 64-bit FNV-1a hash
+// of the command options and input bytes, followed by the input size. The
+// options start with the command's *_CACHE_VERSION from cache.h, which must be
+// bumped whenever that command's output changes; nothing else identifies the
+// gbagfx build, so a cache kept across updates or shared between branches
+// would return the old output. CACHE_FORMAT_VERSION covers changes to the
+// key itself. Entries
+// are written to a temporary file and renamed into place, so concurrent gbagfx
+// processes never see a partial entry. A hit refreshes the entry's mtime,
+// which CacheTrim uses to evict the least recently used entries first.
+//
+// Hit and miss counts are appended to stats.log in the cache directory when
+// the process exits, and summed by "gbagfx --cache-stats".
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "global.h"
+#include "util.h"
+#include "cache.h"
+
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_DEFAULT_MAX_SIZE_MIB 512
+#define CACHE_STATS_FILE "stats.log"
+
+// Trimming scans the whole directory, so individual gbagfx runs only do it
+// for about one store in CACHE_TRIM_INTERVAL. Batch runs always trim at the end.
+#define CACHE_TRIM_INTERVAL 256
+
+static atomic_int sNumHits;
+static atomic_int sNumMisses;
+static atomic_flag sStatsRegistered = ATOMIC_FLAG_INIT;
+
+static const char *GetCacheDir(void)
+{
+    const char *dir = getenv("GBAGFX_CACHE_DIR");
+
+    if (dir == NULL || dir[0] == 0)
+        return NULL;
+
+    return dir;
+}
+
+bool CacheIsEnabled(void)
+{
+    return GetCacheDir() != NULL;
+}
+
+static long long GetMaxCacheSize(void)
+{
+    const char *value = getenv("GBAGFX_CACHE_MAX_SIZE");
+    long long sizeMiB = CACHE_DEFAULT_MAX_SIZE_MIB;
+
+    if (value != NULL && value[0] != 0)
+        sizeMiB = atoll(value);
+
+    return sizeMiB * 1024 * 1024;
+}
+
+static char *GetCachePath(const char *name)
+{
+    const char *dir = GetCacheDir();
+    size_t size = strlen(dir) + 1 + strlen(name) + 1;
+    char *path = malloc(size);
+
+    if (path == NULL)
+        FATAL_ERROR("Failed to allocate memory for cache path.\n");
+
+    snprintf(path, size, "%s/%s", dir, name);
+
+    return path;
+}
+
+static void WriteCacheStats(void)
+{
+    if (atomic_load(&sNumHits) == 0 && atomic_load(&sNumMisses) == 0)
+        return;
+
+    char *path = GetCachePath(CACHE_STATS_FILE);
+    FILE *fp = OpenFile(path, "a");
+
+    // Statistics are best effort, so a read-only cache directory is not an error.
+    if (fp != NULL)
+    {
+        fprintf(fp, "%d %d\n", atomic_load(&sNumHits), atomic_load(&sNumMisses));
+        CloseFile(fp);
+    }
+
+    free(path);
+}
+
+static void CountLookup(bool hit)
+{
+    if (!atomic_flag_test_and_set(&sStatsRegistered))
+        atexit(WriteCacheStats);
+
+    if (hit)
+        atomic_fetch_add(&sNumHits, 1);
+    else
+        atomic_fetch_add(&sNumMisses, 1);
+}
+
+static unsigned long long HashBytes(unsigned long long hash, const unsigned char *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+void CacheInitKey(struct CacheKey *key, const char *options, const unsigned char *data, int dataSize)
+{
+    char header[32];
+    unsigned long long hash = 0xCBF29CE484222325ull;
+
+    snprintf(header, sizeof(header), "gbagfx-cache-%d", CACHE_FORMAT_VERSION);
+    hash = HashBytes(hash, (const unsigned char *)header, strlen(header) + 1);
+    hash = HashBytes(hash, (const unsigned char *)options, strlen(options) + 1);
+    hash = HashBytes(hash, data, dataSize);
+
+    key->hash = hash;
+    snprintf(key->name, sizeof(key->name), "%016llx-%08x", hash, (unsigned int)dataSize);
+}
+
+void CacheInitKeyFromFile(struct CacheKey *key, const char *options, char *inputPath)
+{
+    if (!CacheIsEnabled())
+        return;
+
+    int fileSize;
+    unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
+
+    CacheInitKey(key, options, buffer, fileSize);
+
+    free(buffer);
+}
+
+static bool CopyFile(const char *srcPath, const char *destPath)
+{
+    FILE *src = OpenFile(srcPath, "rb");
+
+    if (src == NULL)
+        return false;
+
+    FILE *dest = OpenFile(destPath, "wb");
+
+    if (dest == NULL)
+    {
+        CloseFile(src);
+        return false;
+    }
+
+    char buffer[16384];
+    size_t size;
+    bool success = true;
+
+    while ((size = fread(buffer, 1, sizeof(buffer), src)) > 0)
+    {
+        if (fwrite(buffer, 1, size, dest) != size)
+        {
+            success = false;
+            break;
+        }
+    }
+
+    if (ferror(src))
+        success = false;
+
+    CloseFile(src);
+
+    if (CloseFile(dest) != 0)
+        success = false;
+
+    return success;
+}
+
+bool CacheFetch(struct CacheKey *key, char *outputPath)
+{
+    if (!CacheIsEnabled())
+        return false;
+
+    char *entryPath = GetCachePath(key->name);
+    bool hit = CopyFile(entryPath, outputPath);
+
+    if (hit)
+        utime(entryPath, NULL);
+
+    CountLookup(hit);
+    free(entryPath);
+
+    return hit;
+}
+
+void CacheStore(struct CacheKey *key, char *outputPath)
+{
+    if (!CacheIsEnabled())
+        return;
+
+    char *entryPath = GetCachePath(key->name);
+    char *tempPath = GetCachePath(".tmp-XXXXXX");
+    int fd = mkstemp(tempPath);
+
+    if (fd < 0)
+    {
+        // The cache directory may not exist yet.
+        mkdir(GetCacheDir(), 0777);
+        strcpy(tempPath + strlen(tempPath) - 6, "XXXXXX");
+        fd = mkstemp(tempPath);
+    }
+
+    // A failure to populate the cache only costs a future miss.
+    if (fd >= 0)
+    {
+        close(fd);
+
+        if (CopyFile(outputPath, tempPath) && rename(tempPath, entryPath) == 0)
+            tempPath[0] = 0;
+        else
+            remove(tempPath);
+    }
+
+    free(entryPath);
+    free(tempPath);
+
+    if (key->hash % CACHE_TRIM_INTERVAL == 0)
+        CacheTrim();
+}
+
+struct CacheEntry {
+    char *path;
+    long long size;
+    time_t lastUsed;
+};
+
+static int CompareCacheEntries(const void *a, const void *b)
+{
+    const struct CacheEntry *entryA = a;
+    const struct CacheEntry *entryB = b;
+
+    if (entryA->lastUsed != entryB->lastUsed)
+        return entryA->lastUsed < entryB->lastUsed ? -1 : 1;
+
+    return strcmp(entryA->path, entryB->path);
+}
+
+static struct CacheEntry *ListCacheEntries(int *numEntries, long long *totalSize)
+{
+    int capacity = 256;
+    struct CacheEntry *entries = malloc(capacity * sizeof(struct CacheEntry));
+
+    *numEntries = 0;
+    *totalSize = 0;
+
+    if (entries == NULL)
+        FATAL_ERROR("Failed to allocate memory for cache entries.\n");
+
+    DIR *dir = opendir(GetCacheDir());
+
+    if (dir == NULL)
+        return entries;
+
+    struct dirent *dirEntry;
+
+    while ((dirEntry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+
+        // Skip ".", "..", temporary files and the statistics log.
+        if (dirEntry->d_name[0] == '.' || strcmp(dirEntry->d_name, CACHE_STATS_FILE) == 0)
+            continue;
+
+        char *path = GetCachePath(dirEntry->d_name);
+
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            free(path);
+            continue;
+        }
+
+        if (*numEntries == capacity)
+        {
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(struct CacheEntry));
+
+            if (entries == NULL)
+                FATAL_ERROR("Failed to allocate memory for cache entries.\n");
+        }
+
+        entries[*numEntries].path = path;
+        entries[*numEntries].size = st.st_size;
+        entries[*numEntries].lastUsed = st.st_mtime;
+        (*numEntries)++;
+        *totalSize += st.st_size;
+    }
+
+    closedir(dir);
+
+    return entries;
+}
+
+static void FreeCacheEntries(struct CacheEntry *entries, int numEntries)
+{
+    for (int i = 0; i < numEntries; i++)
+        free(entries[i].path);
+
+    free(entries);
+}
+
+void CacheTrim(void)
+{
+    if (!CacheIsEnabled())
+        return;
+
+    int numEntries;
+    long long totalSize;
+    long long maxSize = GetMaxCacheSize();
+    struct CacheEntry *entries = ListCacheEntries(&numEntries, &totalSize);
+
+    if (totalSize > maxSize)
+    {
+        qsort(entries, numEntries, sizeof(struct CacheEntry), CompareCacheEntries);
+
+        for (int i = 0; i < numEntries && totalSize > maxSize; i++)
+        {
+            if (remove(entries[i].path) == 0)
+                totalSize -= entries[i].size;
+        }
+    }
+
+    FreeCacheEntries(entries, numEntries);
+}
+
+void PrintCacheStats(void)
+{
+    if (!CacheIsEnabled())
+        FATAL_ERROR("GBAGFX_CACHE_DIR is not set.\n");
+
+    long long numHits = 0;
+    long long numMisses = 0;
+    char *statsPath = GetCachePath(CACHE_STATS_FILE);
+    FILE *fp = OpenFile(statsPath, "r");
+
+    if (fp != NULL)
+    {
+        int hits, misses;
+
+        while (fscanf(fp, "%d %d", &hits, &misses) == 2)
+        {
+            numHits += hits;
+            numMisses += misses;
+        }
+
+        CloseFile(fp);
+    }
+
+    free(statsPath);
+
+    int numEntries;
+    long long totalSize;
+    struct CacheEntry *entries = ListCacheEntries(&numEntries, &totalSize);
+    FreeCacheEntries(entries, numEntries);
+
+    long long numLookups = numHits + numMisses;
+
+    printf("cache: %s\n", GetCacheDir());
+    printf("  entries: %d (%lld bytes, limit %lld bytes)\n", numEntries, totalSize, GetMaxCacheSize());
+    printf("  hits:    %lld\n", numHits);
+    printf("  misses:  %lld\n", numMisses);
+    printf("  hit rate: %.1f%%\n", numLookups != 0 ? 100.0 * numHits / numLookups : 0.0);
+}
@@ -0,0 +1,33 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+
+// Content-addressed cache of conversion outputs, enabled by setting
+// GBAGFX_CACHE_DIR. Entries are keyed by a hash of the input bytes and a
+// normalized description of the command and its options, so a hit can be
+// written out without redoing the conversion. Entries are evicted least
+// recently used first once the cache grows past GBAGFX_CACHE_MAX_SIZE MiB.
+
+// Version of each cached command's output, part of its cache key. Bump a
+// command's version whenever a change to gbagfx changes what it writes for the
+// same input and options, or a shared cache keeps returning the old output.
+#define PNG2GBA_CACHE_VERSION 1
+#define LZ_CACHE_VERSION 1
+#define RL_CACHE_VERSION 1
+#define HUFF_CACHE_VERSION 1
+
+struct CacheKey {
+    unsigned long long hash;
+    char name[32];
+};
+
+bool CacheIsEnabled(void);
+void CacheInitKey(struct CacheKey *key, const char *options, const unsigned char *data, int dataSize);
+void CacheInitKeyFromFile(struct CacheKey *key, const char *options, char *inputPath);
+bool CacheFetch(struct CacheKey *key, char *outputPath);
+void CacheStore(struct CacheKey *key, char *outputPath);
+void CacheTrim(void);
+void PrintCacheStats(void);
+
+#endif // CACHE_H
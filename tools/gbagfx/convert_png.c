@@ -6,10 +6,11 @@
 #include "global.h"
 #include "convert_png.h"
 #include "gfx.h"
+#include "util.h"
 
 static FILE *PngReadOpen(char *path, png_structp *pngStruct, png_infop *pngInfo)
 {
-    FILE *fp = fopen(path, "rb");
+    FILE *fp = OpenFile(path, "rb");
 
     if (fp == NULL)
         FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
@@ -76,7 +77,9 @@ static unsigned char *ConvertBitDepth(unsigned char *src, int srcBitDepth, int d
     return output;
 }
 
-void ReadPng(char *path, struct Image *image)
+// Reads the rows exactly as libpng returns them, leaving the pixels at the
+// PNG's own bit depth, which is stored in pixelBitDepth.
+void ReadPngPixels(char *path, struct Image *image, int *pixelBitDepth)
 {
     png_structp png_ptr;
     png_infop info_ptr;
@@ -120,14 +123,24 @@ void ReadPng(char *path, struct Image *image)
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
     free(row_pointers);
-    fclose(fp);
+    CloseFile(fp);
+
+    if (bit_depth != image->bitDepth && bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
+        FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
+
+    *pixelBitDepth = bit_depth;
+}
+
+void ReadPng(char *path, struct Image *image)
+{
+    int bit_depth;
+
+    ReadPngPixels(path, image, &bit_depth);
 
     if (bit_depth != image->bitDepth && image->tilemap.data.affine == NULL)
     {
         unsigned char *src = image->pixels;
 
-        if (bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
-            FATAL_ERROR("Bit depth of image must be 1, 2, 4, or 8.\n");
         image->pixels = ConvertBitDepth(image->pixels, bit_depth, image->bitDepth, image->width * image->height);
         free(src);
     }
@@ -160,7 +173,7 @@ void ReadPngPalette(char *path, struct Palette *palette)
 
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
-    fclose(fp);
+    CloseFile(fp);
 }
 
 void SetPngPalette(png_structp png_ptr, png_infop info_ptr, struct Palette *palette)
@@ -183,7 +196,7 @@ void SetPngPalette(png_structp png_ptr, png_infop info_ptr, struct Palette *pale
 
 void WritePng(char *path, struct Image *image)
 {
-    FILE *fp = fopen(path, "wb");
+    FILE *fp = OpenFile(path, "wb");
 
     if (fp == NULL)
         FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
@@ -243,7 +256,7 @@ void WritePng(char *path, struct Image *image)
 
     png_write_end(png_ptr, NULL);
 
-    fclose(fp);
+    CloseFile(fp);
 
     png_destroy_write_struct(&png_ptr, &info_ptr);
     free(row_pointers);
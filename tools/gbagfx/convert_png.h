@@ -5,6 +5,7 @@
 
 #include "gfx.h"
 
+void ReadPngPixels(char *path, struct Image *image, int *pixelBitDepth);
 void ReadPng(char *path, struct Image *image);
 void WritePng(char *path, struct Image *image);
 void ReadPngPalette(char *path, struct Palette *palette);
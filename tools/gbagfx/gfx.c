@@ -8,6 +8,7 @@
 #include "global.h"
 #include "gfx.h"
 #include "util.h"
+#include "tile_pack.h"
 
 #define GET_GBA_PAL_RED(x)   (((x) >>  0) & 0x1F)
 #define GET_GBA_PAL_GREEN(x) (((x) >>  5) & 0x1F)
@@ -120,90 +121,6 @@ static void ConvertFromTiles8Bpp(unsigned char *src, unsigned char *dest, int nu
 	}
 }
 
-static void ConvertToTiles1Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
-{
-	int subTileX = 0;
-	int subTileY = 0;
-	int metatileX = 0;
-	int metatileY = 0;
-	int pitch = metatilesWide * metatileWidth;
-
-	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
-			int srcX = metatileX * metatileWidth + subTileX;
-			unsigned char srcPixelOctet = src[srcY * pitch + srcX];
-			unsigned char *destPixelOctet = dest++;
-
-			for (int k = 0; k < 8; k++) {
-				*destPixelOctet <<= 1;
-				*destPixelOctet |= (srcPixelOctet & 1) ^ invertColors;
-				srcPixelOctet >>= 1;
-			}
-		}
-
-		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
-	}
-}
-
-static void ConvertToTiles4Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
-{
-	int subTileX = 0;
-	int subTileY = 0;
-	int metatileX = 0;
-	int metatileY = 0;
-	int pitch = (metatilesWide * metatileWidth) * 4;
-
-	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
-
-			for (int k = 0; k < 4; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 4 + k;
-				unsigned char srcPixelPair = src[srcY * pitch + srcX];
-				unsigned char leftPixel = srcPixelPair >> 4;
-				unsigned char rightPixel = srcPixelPair & 0xF;
-
-				if (invertColors) {
-					leftPixel = 15 - leftPixel;
-					rightPixel = 15 - rightPixel;
-				}
-
-				*dest++ = (rightPixel << 4) | leftPixel;
-			}
-		}
-
-		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
-	}
-}
-
-static void ConvertToTiles8Bpp(unsigned char *src, unsigned char *dest, int numTiles, int metatilesWide, int metatileWidth, int metatileHeight, bool invertColors)
-{
-	int subTileX = 0;
-	int subTileY = 0;
-	int metatileX = 0;
-	int metatileY = 0;
-	int pitch = (metatilesWide * metatileWidth) * 8;
-
-	for (int i = 0; i < numTiles; i++) {
-		for (int j = 0; j < 8; j++) {
-			int srcY = (metatileY * metatileHeight + subTileY) * 8 + j;
-
-			for (int k = 0; k < 8; k++) {
-				int srcX = (metatileX * metatileWidth + subTileX) * 8 + k;
-				unsigned char srcPixel = src[srcY * pitch + srcX];
-
-				if (invertColors)
-					srcPixel = 255 - srcPixel;
-
-				*dest++ = srcPixel;
-			}
-		}
-
-		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
-	}
-}
-
 // For untiled, plain images
 static void CopyPlainPixels(unsigned char *src, unsigned char *dest, int size, int dataWidth, bool invertColors)
 {
@@ -408,7 +325,36 @@ void ReadTileImage(char *path, int tilesWidth, int metatileWidth, int metatileHe
 	free(buffer);
 }
 
-void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, bool invertColors)
+// Packs every tile of the image into buffer, in metatile order. The pixels are
+// still the rows libpng produced, at pixelBitDepth, and each tile is packed
+// straight from them.
+static void PackImageTiles(struct Image *image, int pixelBitDepth, int metatileWidth, int metatileHeight, bool invertColors, unsigned char *buffer)
+{
+	int tileSize = image->bitDepth * 8;
+	int tilesWidth = image->width / 8;
+	int numTiles = tilesWidth * (image->height / 8);
+	int pitch = tilesWidth * pixelBitDepth;
+	int metatilesWide = tilesWidth / metatileWidth;
+	int subTileX = 0;
+	int subTileY = 0;
+	int metatileX = 0;
+	int metatileY = 0;
+
+	for (int i = 0; i < numTiles; i++) {
+		int tileX = metatileX * metatileWidth + subTileX;
+		int tileY = metatileY * metatileHeight + subTileY;
+		unsigned char *rows[8];
+
+		for (int j = 0; j < 8; j++)
+			rows[j] = &image->pixels[(tileY * 8 + j) * pitch + tileX * pixelBitDepth];
+
+		PackTile(rows, pixelBitDepth, image->bitDepth, invertColors, &buffer[i * tileSize]);
+
+		AdvanceMetatilePosition(&subTileX, &subTileY, &metatileX, &metatileY, metatilesWide, metatileWidth, metatileHeight);
+	}
+}
+
+void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, int metatileWidth, int metatileHeight, struct Image *image, int pixelBitDepth, bool invertColors)
 {
 	int tileSize = image->bitDepth * 8;
 
@@ -441,19 +387,7 @@ void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, in
 	if (buffer == NULL)
 		FATAL_ERROR("Failed to allocate memory for pixels.\n");
 
-	int metatilesWide = tilesWidth / metatileWidth;
-
-	switch (image->bitDepth) {
-	case 1:
-		ConvertToTiles1Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 4:
-		ConvertToTiles4Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	case 8:
-		ConvertToTiles8Bpp(image->pixels, buffer, maxNumTiles, metatilesWide, metatileWidth, metatileHeight, invertColors);
-		break;
-	}
+	PackImageTiles(image, pixelBitDepth, metatileWidth, metatileHeight, invertColors, buffer);
 
 	bool zeroPadded = true;
 	for (int i = bufferSize; i < maxBufferSize && zeroPadded; i++) {
@@ -479,6 +413,123 @@ void WriteTileImage(char *path, enum NumTilesMode numTilesMode, int numTiles, in
 	free(buffer);
 }
 
+// Open-addressed hash set of the unique tiles found so far.
+struct TileSet {
+	unsigned char *tiles;
+	int tileSize;
+	int numTiles;
+	int *slots;
+	unsigned int mask;
+};
+
+static unsigned int HashTile(unsigned char *tile, int tileSize)
+{
+	unsigned int hash = 2166136261u;
+
+	for (int i = 0; i < tileSize; i++)
+		hash = (hash ^ tile[i]) * 16777619u;
+
+	return hash;
+}
+
+// Returns the index of the unique tile equal to tile, or -1 if there is none.
+static int FindTile(struct TileSet *set, unsigned char *tile)
+{
+	for (unsigned int slot = HashTile(tile, set->tileSize) & set->mask; set->slots[slot] >= 0; slot = (slot + 1) & set->mask)
+		if (memcmp(&set->tiles[set->slots[slot] * set->tileSize], tile, set->tileSize) == 0)
+			return set->slots[slot];
+
+	return -1;
+}
+
+static int AddTile(struct TileSet *set, unsigned char *tile)
+{
+	unsigned int slot = HashTile(tile, set->tileSize) & set->mask;
+
+	while (set->slots[slot] >= 0)
+		slot = (slot + 1) & set->mask;
+
+	set->slots[slot] = set->numTiles;
+	memcpy(&set->tiles[set->numTiles * set->tileSize], tile, set->tileSize);
+
+	return set->numTiles++;
+}
+
+// Writes only the image's unique tiles, plus a non-affine tilemap that
+// rebuilds the image from them. A tile that is a mirror image of an earlier
+// one reuses it with the tilemap's hflip/vflip bits set.
+void WriteTileImageWithTilemap(char *path, char *tilemapPath, int paletteNum, struct Image *image, int pixelBitDepth, bool invertColors)
+{
+	int tileSize = image->bitDepth * 8;
+
+	if (image->width % 8 != 0)
+		FATAL_ERROR("The width in pixels (%d) isn't a multiple of 8.\n", image->width);
+
+	if (image->height % 8 != 0)
+		FATAL_ERROR("The height in pixels (%d) isn't a multiple of 8.\n", image->height);
+
+	int numTiles = (image->width / 8) * (image->height / 8);
+	unsigned char *buffer = malloc(numTiles * tileSize);
+	struct NonAffineTile *tilemap = calloc(numTiles, sizeof(struct NonAffineTile));
+	struct TileSet set;
+
+	set.tiles = malloc(numTiles * tileSize);
+	set.tileSize = tileSize;
+	set.numTiles = 0;
+	set.mask = 1;
+	while (set.mask < 2 * (unsigned int)numTiles)
+		set.mask <<= 1;
+	set.slots = malloc(set.mask * sizeof(int));
+	memset(set.slots, 0xFF, set.mask * sizeof(int));
+	set.mask--;
+
+	if (buffer == NULL || tilemap == NULL || set.tiles == NULL || set.slots == NULL)
+		FATAL_ERROR("Failed to allocate memory for tiles.\n");
+
+	PackImageTiles(image, pixelBitDepth, 1, 1, invertColors, buffer);
+
+	for (int i = 0; i < numTiles; i++) {
+		unsigned char *tile = &buffer[i * tileSize];
+		unsigned char flipped[64];
+		int index = -1;
+		int flip;
+
+		// Flipping is its own inverse, so if a flipped copy of this tile is
+		// already in the set, the same flip of that tile gives this one back.
+		for (flip = 0; flip < 4 && index < 0; flip++) {
+			memcpy(flipped, tile, tileSize);
+			if (flip & 1)
+				HflipTile(flipped, image->bitDepth);
+			if (flip & 2)
+				VflipTile(flipped, image->bitDepth);
+			index = FindTile(&set, flipped);
+		}
+
+		if (index < 0) {
+			index = AddTile(&set, tile);
+			flip = 0;
+		} else {
+			flip--;
+		}
+
+		if (index > 0x3FF)
+			FATAL_ERROR("The image has more than 1024 unique tiles, which a tilemap can't address.\n");
+
+		tilemap[i].index = index;
+		tilemap[i].hflip = (flip & 1) != 0;
+		tilemap[i].vflip = (flip & 2) != 0;
+		tilemap[i].palno = paletteNum;
+	}
+
+	WriteWholeFile(path, set.tiles, set.numTiles * tileSize);
+	WriteWholeFile(tilemapPath, tilemap, numTiles * sizeof(struct NonAffineTile));
+
+	free(set.slots);
+	free(set.tiles);
+	free(tilemap);
+	free(buffer);
+}
+
 void ReadPlainImage(char *path, int dataWidth, struct Image *image, bool invertColors)
 {
 	int fileSize;
@@ -569,7 +620,7 @@ void ReadGbaPalette(char *path, struct Palette *palette)
 
 void WriteGbaPalette(char *path, struct Palette *palette)
 {
-	FILE *fp = fopen(path, "wb");
+	FILE *fp = OpenFile(path, "wb");
 
 	if (fp == NULL)
 		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
@@ -585,5 +636,5 @@ void WriteGbaPalette(char *path, struct Palette *palette)
 		fputc(paletteEntry >> 8, fp);
 	}
 
-	fclose(fp);
+	CloseFile(fp);
 }
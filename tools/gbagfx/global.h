@@ -10,22 +10,28 @@
 
 #define FATAL_ERROR(format, ...)          \
 do {                                      \
-    fprintf(stderr, format, __VA_ARGS__); \
-    exit(1);                              \
+    FatalError(format, __VA_ARGS__);      \
 } while (0)
 
 #define UNUSED
 
+#define NORETURN __declspec(noreturn)
+
 #else
 
 #define FATAL_ERROR(format, ...)            \
 do {                                        \
-    fprintf(stderr, format, ##__VA_ARGS__); \
-    exit(1);                                \
+    FatalError(format, ##__VA_ARGS__);      \
 } while (0)
 
 #define UNUSED __attribute__((__unused__))
 
+#define NORETURN __attribute__((__noreturn__))
+
 #endif // _MSC_VER
 
+// Prints the message and exits, unless the calling thread has installed a
+// handler with SetFatalErrorHandler (see util.h).
+NORETURN void FatalError(const char *format, ...);
+
 #endif // GLOBAL_H
@@ -6,151 +6,106 @@
 #include "global.h"
 #include "huff.h"
 
-static int cmp_tree(const void * a0, const void * b0) {
-    return ((struct HuffData *)a0)->value - ((struct HuffData *)b0)->value;
+/*
+ * Min-heap of tree nodes used to build the Huffman tree.  Nodes are ordered by
+ * frequency, then by insertion order, so that ties resolve the same way the
+ * original stable sort did: leaves in key order, then merged nodes in the order
+ * they were created.  This keeps the output byte-identical to earlier versions.
+ */
+struct HeapEntry {
+    HuffNode_t node;
+    int order;
+};
+
+struct NodeHeap {
+    struct HeapEntry * entries;
+    int count;
+};
+
+static bool heap_less(const struct HeapEntry * a, const struct HeapEntry * b) {
+    if (a->node.header.value != b->node.header.value)
+        return a->node.header.value < b->node.header.value;
+    return a->order < b->order;
 }
 
-typedef int (*cmpfun)(const void *, const void *);
-
-int msort_r(void * data, size_t count, size_t size, cmpfun cmp, void * buffer) {
-    /*
-     * Out-of-place mergesort (stable sort)
-     * Returns 1 on success, 0 on failure
-     */
-    void * leftPtr;
-    void * rightPtr;
-    void * leftEnd;
-    void * rightEnd;
-    int i;
-
-    switch (count) {
-    case 0:
-        // Should never be here
-        return 0;
-
-    case 1:
-        // Nothing to do here
-        break;
-
-    case 2:
-        // Swap the two entries if the right one compares higher.
-        if (cmp(data, data + size) > 0) {
-            memcpy(buffer, data, size);
-            memcpy(data, data + size, size);
-            memcpy(data + size, buffer, size);
-        }
-        break;
-    default:
-        // Merge sort out-of-place.
-        leftPtr = data;
-        leftEnd = rightPtr = data + count / 2 * size;
-        rightEnd = data + count * size;
-
-        // Sort the left half
-        if (!msort_r(leftPtr, count / 2, size, cmp, buffer))
-            return 0;
-
-        // Sort the right half
-        if (!msort_r(rightPtr, count / 2 + (count & 1), size, cmp, buffer))
-            return 0;
-
-        // Merge the sorted halves out of place
-        i = 0;
-        do {
-            if (cmp(leftPtr, rightPtr) <= 0) {
-                memcpy(buffer + i * size, leftPtr, size);
-                leftPtr += size;
-            } else {
-                memcpy(buffer + i * size, rightPtr, size);
-                rightPtr += size;
-            }
-
-        } while (++i < count && leftPtr < leftEnd && rightPtr < rightEnd);
-
-        // Copy the remainder
-        if (i < count) {
-            if (leftPtr < leftEnd) {
-                memcpy(buffer + i * size, leftPtr, leftEnd - leftPtr);
-            }
-            else {
-                memcpy(buffer + i * size, rightPtr, rightEnd - rightPtr);
-            }
-        }
+static void heap_push(struct NodeHeap * heap, HuffNode_t * node, int order) {
+    int i = heap->count++;
+    struct HeapEntry entry = { *node, order };
 
-        // Copy the merged data back
-        memcpy(data, buffer, count * size);
-        break;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!heap_less(&entry, &heap->entries[parent]))
+            break;
+        heap->entries[i] = heap->entries[parent];
+        i = parent;
     }
-
-    return 1;
+    heap->entries[i] = entry;
 }
 
-int msort(void * data, size_t count, size_t size, cmpfun cmp) {
-    void * buffer = malloc(count * size);
-    if (buffer == NULL) return 0;
-    int result = msort_r(data, count, size, cmp, buffer);
-    free(buffer);
-    return result;
+static HuffNode_t heap_pop(struct NodeHeap * heap) {
+    HuffNode_t top = heap->entries[0].node;
+    struct HeapEntry last = heap->entries[--heap->count];
+    int i = 0;
+
+    for (;;) {
+        int child = i * 2 + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count && heap_less(&heap->entries[child + 1], &heap->entries[child]))
+            child++;
+        if (!heap_less(&heap->entries[child], &last))
+            break;
+        heap->entries[i] = heap->entries[child];
+        i = child;
+    }
+    if (heap->count > 0)
+        heap->entries[i] = last;
+    return top;
 }
 
 static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, struct BitEncoding * encoding) {
     /*
      * The example used to guide this function encodes the tree in a
-     * breadth-first manner.  We attempt to emulate that here.
+     * breadth-first manner, visiting left children before right ones.
      */
 
-    int i, j, k;
+    int nnodes = 2 * nitems - 1;
 
-    // There are (2 * nitems - 1) nodes in the binary tree.  Allocate that.
-    HuffNode_t * traversal = calloc(2 * nitems - 1, sizeof(HuffNode_t));
-    if (traversal == NULL)
+    HuffNode_t * traversal = calloc(nnodes, sizeof(HuffNode_t));
+    int * depths = calloc(nnodes, sizeof(int));
+    uint32_t * paths = calloc(nnodes, sizeof(uint32_t));
+    if (traversal == NULL || depths == NULL || paths == NULL)
         FATAL_ERROR("Fatal error while compressing Huff file.\n");
 
-    // The first node is the root of the tree.
+    // The first node is the root of the tree.  traversal doubles as the
+    // breadth-first queue: each branch copies its children to the end.
     traversal[0] = *tree;
-    i = 1;
-
-    // Copy the tree into a breadth-first ordering using brute force.
-    for (int depth = 1; i < 2 * nitems - 1; depth++) {
-        // Consider every possible path up to the current depth.
-        for (j = 0; i < 2 * nitems - 1 && j < 1 << depth; j++) {
-            // The index of the path is used to encode the path itself.
-            // Start from the most significant relevant bit and work our way down.
-            // Keep track of the current and previous nodes.
-            HuffNode_t * currNode = traversal;
-            HuffNode_t * parent = NULL;
-            for (k = 0; k < depth; k++) {
-                if (currNode->header.isLeaf)
-                    break;
-                parent = currNode;
-                if ((j >> (depth - k - 1)) & 1)
-                    currNode = currNode->branch.right;
-                else
-                    currNode = currNode->branch.left;
-            }
-            // Check that the length of the current path equals the current depth.
-            if (k == depth) {
-                // Make sure we can encode the current branch.
-                // Bail here if we cannot.
-                // This is only applicable for 8-bit encodings.
-                if (traversal + i - parent > 128)
-                    FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
-                // Copy the current node, and update its parent.
-                traversal[i] = *currNode;
-                if (parent != NULL) {
-                    if ((j & 1) == 1)
-                        parent->branch.right = traversal + i;
-                    else
-                        parent->branch.left = traversal + i;
-                }
-                // Encode the path through the tree in the lookup table
-                if (traversal[i].header.isLeaf) {
-                    encoding[traversal[i].leaf.key].nbits = depth;
-                    encoding[traversal[i].leaf.key].bitstring = j;
-                }
-                i++;
-            }
+    int count = 1;
+
+    for (int i = 0; i < nnodes; i++) {
+        HuffNode_t * currNode = traversal + i;
+
+        if (currNode->header.isLeaf) {
+            // Encode the path through the tree in the lookup table
+            encoding[currNode->leaf.key].nbits = depths[i];
+            encoding[currNode->leaf.key].bitstring = paths[i];
+            continue;
         }
+
+        HuffNode_t * children[2] = { currNode->branch.left, currNode->branch.right };
+        for (int j = 0; j < 2; j++) {
+            // Make sure we can encode the current branch.
+            // Bail here if we cannot.
+            // This is only applicable for 8-bit encodings.
+            if (count - i > 128)
+                FATAL_ERROR("Fatal error while compressing Huff file: unable to encode binary tree.\n");
+            traversal[count] = *children[j];
+            depths[count] = depths[i] + 1;
+            paths[count] = (paths[i] << 1) | j;
+            count++;
+        }
+        currNode->branch.left = traversal + count - 2;
+        currNode->branch.right = traversal + count - 1;
     }
 
     // Encode the size of the tree.
@@ -158,7 +113,7 @@ static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, stru
     dest[4] = nitems - 1;
 
     // Encode each node in the tree.
-    for (i = 0; i < 2 * nitems - 1; i++) {
+    for (int i = 0; i < nnodes; i++) {
         HuffNode_t * currNode = traversal + i;
         if (currNode->header.isLeaf) {
             dest[5 + i] = traversal[i].leaf.key;
@@ -172,6 +127,8 @@ static void write_tree(unsigned char * dest, HuffNode_t * tree, int nitems, stru
     }
 
     free(traversal);
+    free(depths);
+    free(paths);
 }
 
 static inline void write_32_le(unsigned char * dest, int * destPos, uint32_t * buff, int * buffPos) {
@@ -201,7 +158,7 @@ static void write_bits(unsigned char * dest, int * destPos, struct BitEncoding *
         int diff = *buffBits + nbits - 32;
         *buff <<= nbits - diff;
         *buff |= bitstring >> diff;
-        bitstring &= ~(1 << diff);
+        bitstring &= (1u << diff) - 1;
         nbits = diff;
         write_32_le(dest, destPos, buff, buffBits);
     }
@@ -261,51 +218,52 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     }
 #endif // DEBUG
 
-    // Sort the frequency table.
-    if (!msort(freqs, nitems, sizeof(HuffNode_t), cmp_tree))
+    // Queue every value that occurs at least once.
+    struct NodeHeap heap;
+    heap.entries = calloc(nitems, sizeof(struct HeapEntry));
+    heap.count = 0;
+    if (heap.entries == NULL)
         goto fail;
 
-    // Prune zero-frequency values.
     for (int i = 0; i < nitems; i++) {
-        if (freqs[i].header.value != 0) {
-            if (i > 0) {
-                for (int j = i; j < nitems; j++) {
-                    freqs[j - i] = freqs[j];
-                }
-                nitems -= i;
-            }
-            break;
-        }
-        // This should never happen:
-        if (i == nitems - 1)
-            goto fail;
+        if (freqs[i].header.value != 0)
+            heap_push(&heap, &freqs[i], i);
+    }
+
+    // This should never happen:
+    if (heap.count == 0)
+        goto fail;
+
+    // The tree needs at least two leaves, so give single-valued input an unused second one.
+    if (heap.count == 1) {
+        int key = heap.entries[0].node.leaf.key ^ 1;
+        heap_push(&heap, &freqs[key], key);
     }
 
+    nitems = heap.count;
+
     HuffNode_t * tree = calloc(nitems * 2 - 1, sizeof(HuffNode_t));
     if (tree == NULL)
         goto fail;
 
     // Iteratively collapse the two least frequent nodes.
-    HuffNode_t * endptr = freqs + nitems - 2;
-
+    // The least frequent becomes the right child.
     for (int i = 0; i < nitems - 1; i++) {
-        HuffNode_t * left = freqs;
-        HuffNode_t * right = freqs + 1;
-        tree[i * 2] = *right;
-        tree[i * 2 + 1] = *left;
-        for (int j = 0; j < nitems - i - 2; j++)
-            freqs[j] = freqs[j + 2];
-        endptr->header.isLeaf = 0;
-        endptr->header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
-        endptr->branch.left = tree + i * 2;
-        endptr->branch.right = tree + i * 2 + 1;
-        endptr--;
-        if (i < nitems - 2 && !msort(freqs, nitems - i - 1, sizeof(HuffNode_t), cmp_tree))
-            goto fail;
+        HuffNode_t branch;
+        tree[i * 2 + 1] = heap_pop(&heap);
+        tree[i * 2] = heap_pop(&heap);
+        branch.header.isLeaf = 0;
+        branch.header.value = tree[i * 2].header.value + tree[i * 2 + 1].header.value;
+        branch.branch.left = tree + i * 2;
+        branch.branch.right = tree + i * 2 + 1;
+        heap_push(&heap, &branch, (1 << bitDepth) + i);
     }
 
+    HuffNode_t root = heap_pop(&heap);
+    free(heap.entries);
+
     // Write the tree breadth-first, and create the path lookup table.
-    write_tree(dest, freqs, nitems, encoding);
+    write_tree(dest, &root, nitems, encoding);
 
     free(tree);
     free(freqs);
@@ -325,6 +283,8 @@ unsigned char * HuffCompress(unsigned char * src, int srcSize, int * compressedS
     }
 
     if (destBitPos != 0) {
+        // The decoder reads each word from the top, so left-align the last one.
+        destBuf <<= 32 - destBitPos;
         write_32_le(dest, &destPos, &destBuf, &destBitPos);
     }
 
@@ -342,8 +302,51 @@ fail:
     FATAL_ERROR("Fatal error while compressing Huff file.\n");
 }
 
+/*
+ * The decoder looks up HUFF_TABLE_BITS bits of the stream at a time.  Each
+ * table entry holds either the value of the leaf those bits reach and the
+ * number of bits it takes, or the node reached after all of them.
+ */
+#define HUFF_TABLE_BITS 8
+
+struct HuffTableEntry {
+    uint16_t node;
+    uint8_t nbits;
+    uint8_t isLeaf;
+};
+
+// Follows one bit from the node at treePos.  Returns false if the tree points
+// outside the compressed data.
+static inline bool step_tree(unsigned char * src, int srcSize, int * treePos, int bit, bool * isLeaf) {
+    unsigned char treeView = src[*treePos];
+    *isLeaf = ((treeView << bit) & 0x80) != 0;
+    *treePos = (*treePos & ~1) + ((treeView & 0x3F) + 1) * 2 + bit;
+    return *treePos < srcSize;
+}
+
+static bool build_decode_table(unsigned char * src, int srcSize, struct HuffTableEntry * table) {
+    for (int prefix = 0; prefix < 1 << HUFF_TABLE_BITS; prefix++) {
+        int treePos = 5;
+        bool isLeaf = false;
+        int nbits = 0;
+
+        while (!isLeaf && nbits < HUFF_TABLE_BITS) {
+            int bit = (prefix >> (HUFF_TABLE_BITS - 1 - nbits)) & 1;
+            if (!step_tree(src, srcSize, &treePos, bit, &isLeaf))
+                return false;
+            nbits++;
+        }
+
+        table[prefix].node = treePos;
+        table[prefix].nbits = nbits;
+        table[prefix].isLeaf = isLeaf;
+    }
+
+    return true;
+}
+
 unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompressedSize_p) {
-    if (srcSize < 4)
+    if (srcSize < 5)
         goto fail;
 
     int bitDepth = *src & 15;
@@ -352,47 +355,71 @@ unsigned char * HuffDecompress(unsigned char * src, int srcSize, int * uncompres
 
     int destSize = (src[3] << 16) | (src[2] << 8) | src[1];
 
-    unsigned char *dest = malloc(destSize);
+    unsigned char *dest = calloc(destSize, 1);
 
     if (dest == NULL)
         goto fail;
 
-    int treePos = 5;
+    struct HuffTableEntry table[1 << HUFF_TABLE_BITS];
+
+    if (!build_decode_table(src, srcSize, table))
+        goto fail;
+
     int treeSize = (src[4] + 1) * 2;
     int srcPos = 4 + treeSize;
     int destPos = 0;
-    int curValPos = 0;
-    uint32_t destTmp = 0;
-    uint32_t window;
+    bool highNybble = false;
+
+    // The stream is a series of little-endian 32-bit words, each read from
+    // its most significant bit.  bits holds the unread bits, left aligned.
+    uint64_t bits = 0;
+    int nbits = 0;
+
+    while (destPos < destSize) {
+        if (nbits <= 32 && srcPos < srcSize) {
+            uint32_t window = 0;
+            for (int i = 0; i < 4 && srcPos + i < srcSize; i++)
+                window |= (uint32_t)src[srcPos + i] << (i * 8);
+            srcPos += 4;
+            bits |= (uint64_t)window << (32 - nbits);
+            nbits += 32;
+        }
+
+        struct HuffTableEntry entry = table[bits >> (64 - HUFF_TABLE_BITS)];
+        int treePos = entry.node;
+        bool isLeaf = entry.isLeaf;
 
-    for (;;)
-    {
-        if (srcPos >= srcSize)
+        if (entry.nbits > nbits)
             goto fail;
-        read_32_le(src, &srcPos, &window);
-        for (int i = 0; i < 32; i++) {
-            int curBit = (window >> 31) & 1;
-            unsigned char treeView = src[treePos];
-            bool isLeaf = ((treeView << curBit) & 0x80) != 0;
-            treePos &= ~1; // align
-            treePos += ((treeView & 0x3F) + 1) * 2 + curBit;
-            if (isLeaf) {
-                destTmp >>= bitDepth;
-                destTmp |= (src[treePos] << (32 - bitDepth));
-                curValPos++;
-                if (curValPos == 32 / bitDepth) {
-                    write_32_le(dest, &destPos, &destTmp, &curValPos);
-                    if (destPos == destSize) {
-                        *uncompressedSize_p = destSize;
-                        return dest;
-                    }
-                }
-                treePos = 5;
-            }
-            window <<= 1;
+        bits <<= entry.nbits;
+        nbits -= entry.nbits;
+
+        // Codes longer than the table walk the rest of the tree a bit at a time.
+        while (!isLeaf) {
+            if (nbits == 0)
+                goto fail;
+            if (!step_tree(src, srcSize, &treePos, bits >> 63, &isLeaf))
+                goto fail;
+            bits <<= 1;
+            nbits--;
+        }
+
+        unsigned char value = src[treePos];
+
+        if (bitDepth == 8) {
+            dest[destPos++] = value;
+        } else if (!highNybble) {
+            dest[destPos] = value & 0xF;
+            highNybble = true;
+        } else {
+            dest[destPos++] |= value << 4;
+            highNybble = false;
         }
     }
 
+    *uncompressedSize_p = destSize;
+    return dest;
+
 fail:
     FATAL_ERROR("Fatal error while decompressing Huff file.\n");
 }
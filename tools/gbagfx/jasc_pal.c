@@ -72,7 +72,7 @@ void ReadJascPalette(char *path, struct Palette *palette)
 {
     char line[MAX_LINE_LENGTH + 1];
 
-    FILE *fp = fopen(path, "rb");
+    FILE *fp = OpenFile(path, "rb");
 
     if (fp == NULL)
         FATAL_ERROR("Failed to open JASC-PAL file \"%s\" for reading.\n", path);
@@ -155,12 +155,12 @@ void ReadJascPalette(char *path, struct Palette *palette)
     if (fgetc(fp) != EOF)
         FATAL_ERROR("Garbage after color data.\n");
 
-    fclose(fp);
+    CloseFile(fp);
 }
 
 void WriteJascPalette(char *path, struct Palette *palette)
 {
-    FILE *fp = fopen(path, "wb");
+    FILE *fp = OpenFile(path, "wb");
 
     fputs("JASC-PAL\r\n", fp);
     fputs("0100\r\n", fp);
@@ -172,5 +172,5 @@ void WriteJascPalette(char *path, struct Palette *palette)
         fprintf(fp, "%d %d %d\r\n", color->red, color->green, color->blue);
     }
 
-    fclose(fp);
+    CloseFile(fp);
 }
@@ -69,11 +69,115 @@ fail:
 	FATAL_ERROR("Fatal error while decompressing LZ file.\n");
 }
 
-unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+#define LZ_WINDOW_SIZE 0x1000
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 18
+#define LZ_HASH_BITS 15
+#define LZ_HASH_SIZE (1 << LZ_HASH_BITS)
+
+// Hash chains over the 3-byte prefix of every position. For each position,
+// prev[] links to the closest earlier position whose prefix hashes to the same
+// value, so walking a chain visits candidates in order of increasing distance.
+struct LZMatchFinder {
+	unsigned char *src;
+	int srcSize;
+	int minDistance;
+	int *head;
+	int *prev;
+	int nextInsertPos;
+};
+
+static unsigned int LZHash(unsigned char *p)
 {
-	if (srcSize <= 0)
-		goto fail;
+	unsigned int key = (p[0] << 16) | (p[1] << 8) | p[2];
+
+	return (key * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static bool LZInitMatchFinder(struct LZMatchFinder *mf, unsigned char *src, int srcSize, int minDistance)
+{
+	mf->src = src;
+	mf->srcSize = srcSize;
+	mf->minDistance = minDistance;
+	mf->nextInsertPos = 0;
+	mf->head = malloc(LZ_HASH_SIZE * sizeof(int));
+	mf->prev = malloc(srcSize * sizeof(int));
+
+	if (mf->head == NULL || mf->prev == NULL) {
+		free(mf->head);
+		free(mf->prev);
+		return false;
+	}
+
+	for (int i = 0; i < LZ_HASH_SIZE; i++)
+		mf->head[i] = -1;
+
+	return true;
+}
+
+static void LZFreeMatchFinder(struct LZMatchFinder *mf)
+{
+	free(mf->head);
+	free(mf->prev);
+}
+
+// Returns the length of the longest match at srcPos and stores its distance.
+// Among matches of equal length, the closest one wins. This is the same choice
+// the exhaustive search in LZCompressBruteForce makes, so the output of the two
+// is byte-identical.
+static int LZFindLongestMatch(struct LZMatchFinder *mf, int srcPos, int *bestDistance)
+{
+	unsigned char *src = mf->src;
+	int maxSize = mf->srcSize - srcPos;
+
+	if (maxSize > LZ_MAX_MATCH)
+		maxSize = LZ_MAX_MATCH;
+
+	while (mf->nextInsertPos < srcPos) {
+		int pos = mf->nextInsertPos++;
+
+		if (pos + LZ_MIN_MATCH <= mf->srcSize) {
+			unsigned int hash = LZHash(&src[pos]);
+			mf->prev[pos] = mf->head[hash];
+			mf->head[hash] = pos;
+		}
+	}
+
+	if (maxSize < LZ_MIN_MATCH)
+		return 0;
+
+	int bestSize = 0;
+	int candidate = mf->head[LZHash(&src[srcPos])];
+
+	while (candidate >= 0) {
+		int blockDistance = srcPos - candidate;
+
+		if (blockDistance > LZ_WINDOW_SIZE)
+			break;
+
+		if (blockDistance >= mf->minDistance && src[candidate + bestSize] == src[srcPos + bestSize]) {
+			int blockSize = 0;
+
+			while (blockSize < maxSize && src[candidate + blockSize] == src[srcPos + blockSize])
+				blockSize++;
+
+			if (blockSize > bestSize) {
+				bestSize = blockSize;
+				*bestDistance = blockDistance;
+
+				if (blockSize == maxSize)
+					break;
+			}
+		}
+
+		candidate = mf->prev[candidate];
+	}
+
+	return bestSize;
+}
 
+static unsigned char *LZAllocCompressBuffer(int srcSize, int *destPos)
+{
 	int worstCaseDestSize = 4 + srcSize + ((srcSize + 7) / 8);
 
 	// Round up to the next multiple of four.
@@ -82,7 +186,7 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	unsigned char *dest = malloc(worstCaseDestSize);
 
 	if (dest == NULL)
-		goto fail;
+		return NULL;
 
 	// header
 	dest[0] = 0x10; // LZ compression type
@@ -90,8 +194,172 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 	dest[2] = (unsigned char)(srcSize >> 8);
 	dest[3] = (unsigned char)(srcSize >> 16);
 
+	*destPos = 4;
+
+	return dest;
+}
+
+static int LZPadToMultipleOf4(unsigned char *dest, int destPos)
+{
+	int remainder = destPos % 4;
+
+	if (remainder != 0) {
+		for (int i = 0; i < 4 - remainder; i++)
+			dest[destPos++] = 0;
+	}
+
+	return destPos;
+}
+
+unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		goto fail;
+
+	int destPos;
+	unsigned char *dest = LZAllocCompressBuffer(srcSize, &destPos);
+
+	if (dest == NULL)
+		goto fail;
+
+	struct LZMatchFinder mf;
+
+	if (!LZInitMatchFinder(&mf, src, srcSize, minDistance))
+		goto fail;
+
+	int srcPos = 0;
+
+	for (;;) {
+		unsigned char *flags = &dest[destPos++];
+		*flags = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int blockDistance = 0;
+			int blockSize = LZFindLongestMatch(&mf, srcPos, &blockDistance);
+
+			if (blockSize >= LZ_MIN_MATCH) {
+				*flags |= (0x80 >> i);
+				srcPos += blockSize;
+				blockSize -= LZ_MIN_MATCH;
+				blockDistance--;
+				dest[destPos++] = (blockSize << 4) | ((unsigned int)blockDistance >> 8);
+				dest[destPos++] = (unsigned char)blockDistance;
+			} else {
+				dest[destPos++] = src[srcPos++];
+			}
+
+			if (srcPos == srcSize) {
+				LZFreeMatchFinder(&mf);
+				*compressedSize = LZPadToMultipleOf4(dest, destPos);
+				return dest;
+			}
+		}
+	}
+
+fail:
+	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+}
+
+// Chooses matches by shortest path instead of always taking the longest match.
+// Each literal costs 9 bits (byte plus flag) and each match costs 17 bits, so
+// the cheapest parse of src[i..] is found working backwards from the end.
+// Every match the finder reports can also be used at any shorter length >= 3
+// at the same distance, which is all the path search needs to consider. The
+// result uses the same format and distance limits as LZCompress.
+unsigned char *LZCompressOptimal(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		goto fail;
+
+	int destPos;
+	unsigned char *dest = LZAllocCompressBuffer(srcSize, &destPos);
+
+	if (dest == NULL)
+		goto fail;
+
+	struct LZMatchFinder mf;
+
+	if (!LZInitMatchFinder(&mf, src, srcSize, minDistance))
+		goto fail;
+
+	int *matchSize = malloc(srcSize * sizeof(int));
+	int *matchDistance = malloc(srcSize * sizeof(int));
+	int *cost = malloc((srcSize + 1) * sizeof(int));
+	int *step = malloc(srcSize * sizeof(int));
+
+	if (matchSize == NULL || matchDistance == NULL || cost == NULL || step == NULL)
+		goto fail;
+
+	for (int srcPos = 0; srcPos < srcSize; srcPos++)
+		matchSize[srcPos] = LZFindLongestMatch(&mf, srcPos, &matchDistance[srcPos]);
+
+	LZFreeMatchFinder(&mf);
+
+	cost[srcSize] = 0;
+
+	for (int srcPos = srcSize - 1; srcPos >= 0; srcPos--) {
+		cost[srcPos] = 9 + cost[srcPos + 1];
+		step[srcPos] = 1;
+
+		for (int blockSize = LZ_MIN_MATCH; blockSize <= matchSize[srcPos]; blockSize++) {
+			int blockCost = 17 + cost[srcPos + blockSize];
+
+			if (blockCost <= cost[srcPos]) {
+				cost[srcPos] = blockCost;
+				step[srcPos] = blockSize;
+			}
+		}
+	}
+
+	int srcPos = 0;
+
+	for (;;) {
+		unsigned char *flags = &dest[destPos++];
+		*flags = 0;
+
+		for (int i = 0; i < 8; i++) {
+			int blockSize = step[srcPos];
+
+			if (blockSize >= LZ_MIN_MATCH) {
+				int blockDistance = matchDistance[srcPos] - 1;
+				*flags |= (0x80 >> i);
+				srcPos += blockSize;
+				blockSize -= LZ_MIN_MATCH;
+				dest[destPos++] = (blockSize << 4) | ((unsigned int)blockDistance >> 8);
+				dest[destPos++] = (unsigned char)blockDistance;
+			} else {
+				dest[destPos++] = src[srcPos++];
+			}
+
+			if (srcPos == srcSize) {
+				free(matchSize);
+				free(matchDistance);
+				free(cost);
+				free(step);
+				*compressedSize = LZPadToMultipleOf4(dest, destPos);
+				return dest;
+			}
+		}
+	}
+
+fail:
+	FATAL_ERROR("Fatal error while compressing LZ file.\n");
+}
+
+// The original exhaustive search, which tries every distance in the window.
+// Kept as the reference for LZCompress and for benchmarking.
+unsigned char *LZCompressBruteForce(unsigned char *src, int srcSize, int *compressedSize, const int minDistance)
+{
+	if (srcSize <= 0)
+		goto fail;
+
+	int destPos;
+	unsigned char *dest = LZAllocCompressBuffer(srcSize, &destPos);
+
+	if (dest == NULL)
+		goto fail;
+
 	int srcPos = 0;
-	int destPos = 4;
 
 	for (;;) {
 		unsigned char *flags = &dest[destPos++];
@@ -102,11 +370,11 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 			int bestBlockSize = 0;
 			int blockDistance = minDistance;
 
-			while (blockDistance <= srcPos && blockDistance <= 0x1000) {
+			while (blockDistance <= srcPos && blockDistance <= LZ_WINDOW_SIZE) {
 				int blockStart = srcPos - blockDistance;
 				int blockSize = 0;
 
-				while (blockSize < 18
+				while (blockSize < LZ_MAX_MATCH
 				    && srcPos + blockSize < srcSize
 				    && src[blockStart + blockSize] == src[srcPos + blockSize])
 					blockSize++;
@@ -115,17 +383,17 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 					bestBlockDistance = blockDistance;
 					bestBlockSize = blockSize;
 
-					if (blockSize == 18)
+					if (blockSize == LZ_MAX_MATCH)
 						break;
 				}
 
 				blockDistance++;
 			}
 
-			if (bestBlockSize >= 3) {
+			if (bestBlockSize >= LZ_MIN_MATCH) {
 				*flags |= (0x80 >> i);
 				srcPos += bestBlockSize;
-				bestBlockSize -= 3;
+				bestBlockSize -= LZ_MIN_MATCH;
 				bestBlockDistance--;
 				dest[destPos++] = (bestBlockSize << 4) | ((unsigned int)bestBlockDistance >> 8);
 				dest[destPos++] = (unsigned char)bestBlockDistance;
@@ -134,15 +402,7 @@ unsigned char *LZCompress(unsigned char *src, int srcSize, int *compressedSize,
 			}
 
 			if (srcPos == srcSize) {
-				// Pad to multiple of 4 bytes.
-				int remainder = destPos % 4;
-
-				if (remainder != 0) {
-					for (int i = 0; i < 4 - remainder; i++)
-						dest[destPos++] = 0;
-				}
-
-				*compressedSize = destPos;
+				*compressedSize = LZPadToMultipleOf4(dest, destPos);
 				return dest;
 			}
 		}
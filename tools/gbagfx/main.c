@@ -13,6 +13,8 @@
 #include "rl.h"
 #include "font.h"
 #include "huff.h"
+#include "batch.h"
+#include "cache.h"
 
 struct CommandHandler
 {
@@ -81,12 +83,20 @@ void ConvertPngToGba(char *inputPath, char *outputPath, struct PngToGbaOptions *
     image.bitDepth = options->bitDepth;
     image.tilemap.data.affine = NULL; // initialize to NULL to avoid issues in FreeImage
 
-    ReadPng(inputPath, &image);
-
     if (options->isTiled)
-        WriteTileImage(outputPath, options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, !image.hasPalette);
+    {
+        int pixelBitDepth;
+        ReadPngPixels(inputPath, &image, &pixelBitDepth);
+        if (options->tilemapFilePath != NULL)
+            WriteTileImageWithTilemap(outputPath, options->tilemapFilePath, options->paletteNum, &image, pixelBitDepth, !image.hasPalette);
+        else
+            WriteTileImage(outputPath, options->numTilesMode, options->numTiles, options->metatileWidth, options->metatileHeight, &image, pixelBitDepth, !image.hasPalette);
+    }
     else
+    {
+        ReadPng(inputPath, &image);
         WritePlainImage(outputPath, options->dataWidth, &image, !image.hasPalette);
+    }
 
     FreeImage(&image);
 }
@@ -211,6 +221,7 @@ void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **a
     options.metatileWidth = 1;
     options.metatileHeight = 1;
     options.tilemapFilePath = NULL;
+    options.paletteNum = 0;
     options.isAffineMap = false;
     options.isTiled = true;
     options.dataWidth = 1;
@@ -280,13 +291,61 @@ void HandlePngToGbaCommand(char *inputPath, char *outputPath, int argc, char **a
             if (options.dataWidth < 1)
                 FATAL_ERROR("Data width must be positive.\n");
         }
+        else if (strcmp(option, "-tilemap") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No tilemap value following \"-tilemap\".\n");
+            i++;
+            options.tilemapFilePath = argv[i];
+        }
+        else if (strcmp(option, "-palno") == 0)
+        {
+            if (i + 1 >= argc)
+                FATAL_ERROR("No palette number following \"-palno\".\n");
+            i++;
+
+            if (!ParseNumber(argv[i], NULL, 10, &options.paletteNum))
+                FATAL_ERROR("Failed to parse palette number.\n");
+
+            if (options.paletteNum < 0 || options.paletteNum > 15)
+                FATAL_ERROR("Palette number must be between 0 and 15.\n");
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
         }
     }
 
+    if (options.tilemapFilePath != NULL)
+    {
+        if (!options.isTiled)
+            FATAL_ERROR("\"-tilemap\" can't be used with \"-plain\".\n");
+
+        if (options.numTiles != 0 || options.metatileWidth != 1 || options.metatileHeight != 1)
+            FATAL_ERROR("\"-tilemap\" can't be used with \"-num_tiles\", \"-mwidth\" or \"-mheight\".\n");
+    }
+
+    // -Wnum_tiles prints its warning during conversion, so don't let a cache hit hide it.
+    // The cache holds one output per entry, so a second output file bypasses it.
+    bool useCache = options.numTilesMode != NUM_TILES_WARN && options.tilemapFilePath == NULL;
+    struct CacheKey cacheKey;
+
+    if (useCache)
+    {
+        char cacheOptions[256];
+        snprintf(cacheOptions, sizeof(cacheOptions), "png2gba-%d -bpp %d -num_tiles %d %d -mwidth %d -mheight %d -tiled %d -data_width %d",
+                 PNG2GBA_CACHE_VERSION, options.bitDepth, options.numTiles, options.numTilesMode, options.metatileWidth, options.metatileHeight,
+                 options.isTiled, options.dataWidth);
+        CacheInitKeyFromFile(&cacheKey, cacheOptions, inputPath);
+
+        if (CacheFetch(&cacheKey, outputPath))
+            return;
+    }
+
     ConvertPngToGba(inputPath, outputPath, &options);
+
+    if (useCache)
+        CacheStore(&cacheKey, outputPath);
 }
 
 void HandlePngToJascPaletteCommand(char *inputPath, char *outputPath, int argc UNUSED, char **argv UNUSED)
@@ -429,6 +488,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
 {
     int overflowSize = 0;
     int minDistance = 2; // default, for compatibility with LZ77UnCompVram()
+    bool optimal = false;
 
     for (int i = 3; i < argc; i++)
     {
@@ -460,6 +520,10 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
             if (minDistance < 1)
                 FATAL_ERROR("LZ min search distance must be positive.\n");
         }
+        else if (strcmp(option, "-optimal") == 0)
+        {
+            optimal = true;
+        }
         else
         {
             FATAL_ERROR("Unrecognized option \"%s\".\n", option);
@@ -475,8 +539,33 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     int fileSize;
     unsigned char *buffer = ReadWholeFileZeroPadded(inputPath, &fileSize, overflowSize);
 
+    char cacheOptions[64];
+    struct CacheKey cacheKey;
+    snprintf(cacheOptions, sizeof(cacheOptions), "lz-%d -overflow %d -search %d -optimal %d", LZ_CACHE_VERSION, overflowSize, minDistance, optimal);
+    CacheInitKey(&cacheKey, cacheOptions, buffer, fileSize);
+
+    if (CacheFetch(&cacheKey, outputPath))
+    {
+        free(buffer);
+        return;
+    }
+
     int compressedSize;
-    unsigned char *compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    unsigned char *compressedData;
+
+    if (optimal)
+    {
+        // The optimal parse is opt-in since it changes the compressed bytes,
+        // so report what it saves over the default greedy parse.
+        int greedySize;
+        free(LZCompress(buffer, fileSize + overflowSize, &greedySize, minDistance));
+        compressedData = LZCompressOptimal(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+        printf("%s: %d -> %d bytes (saved %d)\n", outputPath, greedySize, compressedSize, greedySize - compressedSize);
+    }
+    else
+    {
+        compressedData = LZCompress(buffer, fileSize + overflowSize, &compressedSize, minDistance);
+    }
 
     compressedData[1] = (unsigned char)fileSize;
     compressedData[2] = (unsigned char)(fileSize >> 8);
@@ -485,6 +574,7 @@ void HandleLZCompressCommand(char *inputPath, char *outputPath, int argc, char *
     free(buffer);
 
     WriteWholeFile(outputPath, compressedData, compressedSize);
+    CacheStore(&cacheKey, outputPath);
 
     free(compressedData);
 }
@@ -509,12 +599,24 @@ void HandleRLCompressCommand(char *inputPath, char *outputPath, int argc UNUSED,
     int fileSize;
     unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
 
+    char cacheOptions[16];
+    struct CacheKey cacheKey;
+    snprintf(cacheOptions, sizeof(cacheOptions), "rl-%d", RL_CACHE_VERSION);
+    CacheInitKey(&cacheKey, cacheOptions, buffer, fileSize);
+
+    if (CacheFetch(&cacheKey, outputPath))
+    {
+        free(buffer);
+        return;
+    }
+
     int compressedSize;
     unsigned char *compressedData = RLCompress(buffer, fileSize, &compressedSize);
 
     free(buffer);
 
     WriteWholeFile(outputPath, compressedData, compressedSize);
+    CacheStore(&cacheKey, outputPath);
 
     free(compressedData);
 }
@@ -564,12 +666,24 @@ void HandleHuffCompressCommand(char *inputPath, char *outputPath, int argc, char
 
     unsigned char *buffer = ReadWholeFile(inputPath, &fileSize);
 
+    char cacheOptions[32];
+    struct CacheKey cacheKey;
+    snprintf(cacheOptions, sizeof(cacheOptions), "huff-%d -depth %d", HUFF_CACHE_VERSION, bitDepth);
+    CacheInitKey(&cacheKey, cacheOptions, buffer, fileSize);
+
+    if (CacheFetch(&cacheKey, outputPath))
+    {
+        free(buffer);
+        return;
+    }
+
     int compressedSize;
     unsigned char *compressedData = HuffCompress(buffer, fileSize, &compressedSize, bitDepth);
 
     free(buffer);
 
     WriteWholeFile(outputPath, compressedData, compressedSize);
+    CacheStore(&cacheKey, outputPath);
 
     free(compressedData);
 }
@@ -589,13 +703,10 @@ void HandleHuffDecompressCommand(char *inputPath, char *outputPath, int argc UNU
     free(uncompressedData);
 }
 
-int main(int argc, char **argv)
+void RunCommand(int argc, char **argv)
 {
     char converted = 0;
 
-    if (argc < 3)
-        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n");
-
     struct CommandHandler handlers[] =
     {
         { "1bpp", "png", HandleGbaToPngCommand },
@@ -675,6 +786,60 @@ int main(int argc, char **argv)
 
     if (!converted)
         FATAL_ERROR("Don't know how to convert \"%s\" to \"%s\".\n", argv[1], argv[2]);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+    {
+        int numThreads = 0;
+
+        if (argc < 3)
+            FATAL_ERROR("No manifest path following \"--batch\".\n");
+
+        for (int i = 3; i < argc; i++)
+        {
+            if (strcmp(argv[i], "-j") == 0)
+            {
+                if (i + 1 >= argc)
+                    FATAL_ERROR("No number of jobs following \"-j\".\n");
+
+                i++;
+
+                if (!ParseNumber(argv[i], NULL, 10, &numThreads))
+                    FATAL_ERROR("Failed to parse number of jobs.\n");
+
+                if (numThreads < 1)
+                    FATAL_ERROR("Number of jobs must be positive.\n");
+            }
+            else
+            {
+                FATAL_ERROR("Unrecognized option \"%s\".\n", argv[i]);
+            }
+        }
+
+        return RunBatch(argv[2], numThreads);
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--cache-stats") == 0)
+    {
+        PrintCacheStats();
+        return 0;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "--cache-trim") == 0)
+    {
+        CacheTrim();
+        return 0;
+    }
+
+    if (argc < 3)
+        FATAL_ERROR("Usage: gbagfx INPUT_PATH OUTPUT_PATH [options...]\n"
+                    "       gbagfx --batch MANIFEST_PATH [-j JOBS]\n"
+                    "           (lines run in parallel; a line naming an earlier line's output waits for it)\n"
+                    "       gbagfx --cache-stats | --cache-trim\n");
+
+    RunCommand(argc, argv);
 
     return 0;
 }
@@ -26,6 +26,7 @@ struct PngToGbaOptions {
     int metatileWidth;
     int metatileHeight;
     char *tilemapFilePath;
+    int paletteNum;
     bool isAffineMap;
     bool isTiled;
     int dataWidth;
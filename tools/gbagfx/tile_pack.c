@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "tile_pack.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Handles any combination of depths, one pixel at a time.
+static void PackTileGeneric(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest)
+{
+	unsigned char srcMask = (1 << srcBitDepth) - 1;
+	unsigned char mask = (1 << destBitDepth) - 1;
+	unsigned char invertMask = invertColors ? mask : 0;
+
+	for (int j = 0; j < 8; j++) {
+		unsigned char pixels[8];
+		uint64_t rowBits = 0;
+
+		// A tile row is srcBitDepth bytes wide; read it as one big-endian bit string.
+		for (int i = 0; i < srcBitDepth; i++)
+			rowBits = (rowBits << 8) | rows[j][i];
+
+		for (int x = 0; x < 8; x++)
+			pixels[x] = ((rowBits >> ((7 - x) * srcBitDepth)) & srcMask & mask) ^ invertMask;
+
+		switch (destBitDepth) {
+		case 1:
+			*dest = 0;
+			for (int x = 0; x < 8; x++)
+				*dest |= pixels[x] << x;
+			dest++;
+			break;
+		case 4:
+			for (int x = 0; x < 8; x += 2)
+				*dest++ = (pixels[x + 1] << 4) | pixels[x];
+			break;
+		case 8:
+			memcpy(dest, pixels, 8);
+			dest += 8;
+			break;
+		}
+	}
+}
+
+// 4bpp rows are stored left pixel in the high nibble, GBA tiles the opposite.
+static uint32_t SwapNibbles(uint32_t pixels)
+{
+	return ((pixels >> 4) & 0x0F0F0F0F) | ((pixels << 4) & 0xF0F0F0F0);
+}
+
+static unsigned char ReverseBits(unsigned char pixels)
+{
+	pixels = (pixels >> 4) | (pixels << 4);
+	pixels = ((pixels >> 2) & 0x33) | ((pixels << 2) & 0xCC);
+	pixels = ((pixels >> 1) & 0x55) | ((pixels << 1) & 0xAA);
+
+	return pixels;
+}
+
+void PackTileScalar(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest)
+{
+	if (srcBitDepth != destBitDepth) {
+		PackTileGeneric(rows, srcBitDepth, destBitDepth, invertColors, dest);
+		return;
+	}
+
+	switch (destBitDepth) {
+	case 1:
+		for (int j = 0; j < 8; j++)
+			dest[j] = ReverseBits(rows[j][0] ^ (invertColors ? 0xFF : 0));
+		break;
+	case 4:
+		for (int j = 0; j < 8; j++) {
+			uint32_t pixels;
+			memcpy(&pixels, rows[j], 4);
+			pixels = SwapNibbles(pixels ^ (invertColors ? 0xFFFFFFFF : 0));
+			memcpy(&dest[j * 4], &pixels, 4);
+		}
+		break;
+	case 8:
+		for (int j = 0; j < 8; j++) {
+			uint64_t pixels;
+			memcpy(&pixels, rows[j], 8);
+			pixels ^= invertColors ? 0xFFFFFFFFFFFFFFFFull : 0;
+			memcpy(&dest[j * 8], &pixels, 8);
+		}
+		break;
+	}
+}
+
+#if defined(__SSE2__)
+
+static __m128i LoadRow32(unsigned char *row)
+{
+	uint32_t pixels;
+	memcpy(&pixels, row, 4);
+
+	return _mm_cvtsi32_si128(pixels);
+}
+
+// Gathers four 4-byte rows into one register.
+static __m128i LoadRows4Bpp(unsigned char **rows)
+{
+	__m128i rows01 = _mm_unpacklo_epi32(LoadRow32(rows[0]), LoadRow32(rows[1]));
+	__m128i rows23 = _mm_unpacklo_epi32(LoadRow32(rows[2]), LoadRow32(rows[3]));
+
+	return _mm_unpacklo_epi64(rows01, rows23);
+}
+
+static void PackTile4BppSimd(unsigned char *rows[8], bool invertColors, unsigned char *dest)
+{
+	__m128i invertMask = _mm_set1_epi8(invertColors ? 0xFF : 0);
+	__m128i lowNibbles = _mm_set1_epi8(0x0F);
+
+	for (int half = 0; half < 2; half++) {
+		__m128i pixels = _mm_xor_si128(LoadRows4Bpp(&rows[half * 4]), invertMask);
+		__m128i high = _mm_and_si128(_mm_srli_epi16(pixels, 4), lowNibbles);
+		__m128i low = _mm_slli_epi16(_mm_and_si128(pixels, lowNibbles), 4);
+		_mm_storeu_si128((__m128i *)&dest[half * 16], _mm_or_si128(high, low));
+	}
+}
+
+static void PackTile8BppSimd(unsigned char *rows[8], bool invertColors, unsigned char *dest)
+{
+	__m128i invertMask = _mm_set1_epi8(invertColors ? 0xFF : 0);
+
+	for (int j = 0; j < 8; j += 2) {
+		__m128i row0 = _mm_loadl_epi64((__m128i *)rows[j]);
+		__m128i row1 = _mm_loadl_epi64((__m128i *)rows[j + 1]);
+		__m128i pixels = _mm_xor_si128(_mm_unpacklo_epi64(row0, row1), invertMask);
+		_mm_storeu_si128((__m128i *)&dest[j * 8], pixels);
+	}
+}
+
+#elif defined(__ARM_NEON)
+
+static void PackTile4BppSimd(unsigned char *rows[8], bool invertColors, unsigned char *dest)
+{
+	uint8x16_t invertMask = vdupq_n_u8(invertColors ? 0xFF : 0);
+
+	for (int half = 0; half < 2; half++) {
+		unsigned char gathered[16];
+
+		for (int j = 0; j < 4; j++)
+			memcpy(&gathered[j * 4], rows[half * 4 + j], 4);
+
+		uint8x16_t pixels = veorq_u8(vld1q_u8(gathered), invertMask);
+		vst1q_u8(&dest[half * 16], vorrq_u8(vshrq_n_u8(pixels, 4), vshlq_n_u8(pixels, 4)));
+	}
+}
+
+static void PackTile8BppSimd(unsigned char *rows[8], bool invertColors, unsigned char *dest)
+{
+	uint8x16_t invertMask = vdupq_n_u8(invertColors ? 0xFF : 0);
+
+	for (int j = 0; j < 8; j += 2) {
+		uint8x16_t pixels = vcombine_u8(vld1_u8(rows[j]), vld1_u8(rows[j + 1]));
+		vst1q_u8(&dest[j * 8], veorq_u8(pixels, invertMask));
+	}
+}
+
+#endif
+
+void PackTile(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	if (srcBitDepth == 4 && destBitDepth == 4) {
+		PackTile4BppSimd(rows, invertColors, dest);
+		return;
+	}
+
+	if (srcBitDepth == 8 && destBitDepth == 8) {
+		PackTile8BppSimd(rows, invertColors, dest);
+		return;
+	}
+#endif
+
+	PackTileScalar(rows, srcBitDepth, destBitDepth, invertColors, dest);
+}
@@ -0,0 +1,16 @@
+#ifndef TILE_PACK_H
+#define TILE_PACK_H
+
+#include <stdbool.h>
+
+// Packs one 8x8 tile into GBA tile format (1, 4 or 8 bpp). rows[j] points at
+// the byte holding the tile's leftmost pixel in row j of an image stored at
+// srcBitDepth (1, 2, 4 or 8 bpp, leftmost pixel in the most significant bits,
+// as libpng returns it). Source pixels wider than destBitDepth keep only their
+// low bits. invertColors is used for grayscale images.
+void PackTile(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest);
+
+// The portable implementation of PackTile, also used when no SIMD kernel applies.
+void PackTileScalar(unsigned char *rows[8], int srcBitDepth, int destBitDepth, bool invertColors, unsigned char *dest);
+
+#endif // TILE_PACK_H
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Converts PNGs to 4bpp tiles both as a full tile sheet and with -tilemap,
+# decodes the tilemap output back to a PNG, and checks that it packs to the
+# same tiles as the original. Prints the bytes the deduplicated tiles plus
+# tilemap take against the full sheet. Run from the repository root.
+# Usage: tilemap_report.sh [PNG...] (default: every PNG under graphics/)
+
+GBAGFX=${GBAGFX:-tools/gbagfx/gbagfx}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+if [ $# -eq 0 ]; then
+    set -- $(find graphics -name '*.png' | sort)
+fi
+
+python3 - "$@" <<'PY' > "$TMP/list"
+import struct, sys
+for path in sys.argv[1:]:
+    with open(path, "rb") as f:
+        header = f.read(24)
+    width, height = struct.unpack(">II", header[16:24])
+    if width % 8 == 0 and height % 8 == 0:
+        print(width // 8, path)
+PY
+
+while read -r width png; do
+    "$GBAGFX" "$png" "$TMP/full.4bpp" || continue
+    if ! "$GBAGFX" "$png" "$TMP/dedup.4bpp" -tilemap "$TMP/map.bin" 2>/dev/null; then
+        echo "$png: skipped"
+        continue
+    fi
+    "$GBAGFX" "$TMP/dedup.4bpp" "$TMP/back.png" -tilemap "$TMP/map.bin" -width "$width" || exit 1
+    "$GBAGFX" "$TMP/back.png" "$TMP/back.4bpp" || exit 1
+    if ! cmp -s "$TMP/full.4bpp" "$TMP/back.4bpp"; then
+        echo "$png: ROUND TRIP FAILED"
+        exit 1
+    fi
+    echo "$png $(wc -c < "$TMP/full.4bpp") $(wc -c < "$TMP/dedup.4bpp") $(wc -c < "$TMP/map.bin")"
+done < "$TMP/list" | awk '
+$2 == "skipped" || NF != 4 { print; next }
+{
+    printf "%s: %d -> %d tile bytes + %d tilemap bytes\n", $1, $2, $3, $4
+    full += $2
+    tiles += $3
+    map += $4
+}
+END {
+    if (full > 0)
+        printf "total: %d -> %d tile bytes (%.1f%%) + %d tilemap bytes\n", full, tiles, 100 * tiles / full, map
+}'
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdbool.h>
 #include <errno.h>
@@ -9,6 +10,72 @@
 #include "global.h"
 #include "util.h"
 
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+static THREAD_LOCAL struct FatalErrorHandler *sFatalErrorHandler;
+
+void SetFatalErrorHandler(struct FatalErrorHandler *handler)
+{
+	if (handler != NULL)
+		handler->numFiles = 0;
+
+	sFatalErrorHandler = handler;
+}
+
+FILE *OpenFile(const char *path, const char *mode)
+{
+	FILE *fp = fopen(path, mode);
+
+	// Past MAX_HANDLER_FILES, a file is left open if its command fails.
+	if (fp != NULL && sFatalErrorHandler != NULL && sFatalErrorHandler->numFiles < MAX_HANDLER_FILES)
+		sFatalErrorHandler->files[sFatalErrorHandler->numFiles++] = fp;
+
+	return fp;
+}
+
+int CloseFile(FILE *fp)
+{
+	struct FatalErrorHandler *handler = sFatalErrorHandler;
+
+	if (handler != NULL) {
+		for (int i = 0; i < handler->numFiles; i++) {
+			if (handler->files[i] == fp) {
+				handler->files[i] = handler->files[--handler->numFiles];
+				break;
+			}
+		}
+	}
+
+	return fclose(fp);
+}
+
+void FatalError(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	if (sFatalErrorHandler != NULL) {
+		struct FatalErrorHandler *handler = sFatalErrorHandler;
+		sFatalErrorHandler = NULL;
+		vsnprintf(handler->message, sizeof(handler->message), format, args);
+		va_end(args);
+
+		for (int i = 0; i < handler->numFiles; i++)
+			fclose(handler->files[i]);
+
+		handler->numFiles = 0;
+		longjmp(handler->jmpBuf, 1);
+	}
+
+	vfprintf(stderr, format, args);
+	va_end(args);
+	exit(1);
+}
+
 bool ParseNumber(char *s, char **end, int radix, int *intValue)
 {
 	char *localEnd;
@@ -67,7 +134,7 @@ char *GetFileExtensionAfterDot(char *path)
 
 unsigned char *ReadWholeFile(char *path, int *size)
 {
-	FILE *fp = fopen(path, "rb");
+	FILE *fp = OpenFile(path, "rb");
 
 	if (fp == NULL)
 		FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
@@ -86,14 +153,14 @@ unsigned char *ReadWholeFile(char *path, int *size)
 	if (fread(buffer, *size, 1, fp) != 1)
 		FATAL_ERROR("Failed to read \"%s\".\n", path);
 
-	fclose(fp);
+	CloseFile(fp);
 
 	return buffer;
 }
 
 unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 {
-	FILE *fp = fopen(path, "rb");
+	FILE *fp = OpenFile(path, "rb");
 
 	if (fp == NULL)
 		FATAL_ERROR("Failed to open \"%s\" for reading.\n", path);
@@ -112,14 +179,14 @@ unsigned char *ReadWholeFileZeroPadded(char *path, int *size, int padAmount)
 	if (fread(buffer, *size, 1, fp) != 1)
 		FATAL_ERROR("Failed to read \"%s\".\n", path);
 
-	fclose(fp);
+	CloseFile(fp);
 
 	return buffer;
 }
 
 void WriteWholeFile(char *path, void *buffer, int bufferSize)
 {
-	FILE *fp = fopen(path, "wb");
+	FILE *fp = OpenFile(path, "wb");
 
 	if (fp == NULL)
 		FATAL_ERROR("Failed to open \"%s\" for writing.\n", path);
@@ -127,5 +194,5 @@ void WriteWholeFile(char *path, void *buffer, int bufferSize)
 	if (fwrite(buffer, bufferSize, 1, fp) != 1)
 		FATAL_ERROR("Failed to write to \"%s\".\n", path);
 
-	fclose(fp);
+	CloseFile(fp);
 }
@@ -3,7 +3,29 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdio.h>
 #include <stdbool.h>
+#include <setjmp.h>
+
+#define MAX_HANDLER_FILES 8
+
+// Lets a batch job recover from FATAL_ERROR. While a handler is installed on
+// the current thread, FatalError stores the message in it, closes the files
+// the command still has open through OpenFile, and longjmps to jmpBuf instead
+// of exiting. Memory owned by the failed command is not released.
+struct FatalErrorHandler {
+    jmp_buf jmpBuf;
+    char message[1024];
+    FILE *files[MAX_HANDLER_FILES];
+    int numFiles;
+};
+
+void SetFatalErrorHandler(struct FatalErrorHandler *handler);
+
+// fopen and fclose, keeping track of the file in the current thread's handler
+// so that a failing batch command doesn't leave it open.
+FILE *OpenFile(const char *path, const char *mode);
+int CloseFile(FILE *fp);
 
 bool ParseNumber(char *s, char **end, int radix, int *intValue);
 char *GetFileExtension(char *path);
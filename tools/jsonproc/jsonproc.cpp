@@ -12,10 +12,17 @@ using std::string; using std::to_string;
 #include <algorithm>
 using std::replace_if;
 
+#include <chrono>
+
+#include <fstream>
+#include <sstream>
+
 #include <inja.hpp>
 using namespace inja;
 using json = nlohmann::json;
 
+#include "json_reader.h"
+
 std::map<string, string> customVars;
 
 void set_custom_var(string key, string value)
@@ -28,20 +35,91 @@ string get_custom_var(string key)
     return customVars[key];
 }
 
+// inja renders from nlohmann::json, so the data file is read with the
+// shared reader and then copied into one; that is still cheaper than letting
+// nlohmann parse from a stream.
+json to_inja_json(const jsonreader::Json &value)
+{
+    switch (value.type())
+    {
+    case jsonreader::Json::Type::NUL:
+        return json();
+    case jsonreader::Json::Type::BOOL:
+        return json(value.bool_value());
+    case jsonreader::Json::Type::NUMBER:
+        switch (value.number_kind())
+        {
+        case jsonreader::Json::NumberKind::INTEGER:
+            return json(value.integer_value());
+        case jsonreader::Json::NumberKind::UNSIGNED:
+            return json(value.unsigned_value());
+        default:
+            return json(value.number_value());
+        }
+    case jsonreader::Json::Type::STRING:
+        return json(value.string_value());
+    case jsonreader::Json::Type::ARRAY:
+    {
+        json array = json::array();
+        for (size_t i = 0; i < value.size(); i++)
+            array.push_back(to_inja_json(value[i]));
+        return array;
+    }
+    case jsonreader::Json::Type::OBJECT:
+    {
+        json object = json::object();
+        for (size_t i = 0; i < value.size(); i++)
+            object[string(value.key(i))] = to_inja_json(value[i]);
+        return object;
+    }
+    }
+
+    return json();
+}
+
+// Leaves the file alone if it already holds text, so that make doesn't
+// rebuild everything that includes an output which didn't change.
+void write_if_changed(const string &filepath, const string &text)
+{
+    std::ifstream existing(filepath);
+    if (existing.is_open())
+    {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == text)
+            return;
+    }
+    existing.close();
+
+    std::ofstream file(filepath);
+    if (!file.is_open())
+        FATAL_ERROR("JSONPROC_ERROR: Cannot open file %s for writing.\n", filepath.c_str());
+    file << text;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
-        FATAL_ERROR("USAGE: jsonproc <json-filepath> <template-filepath> <output-filepath>\n");
+    auto startTime = std::chrono::steady_clock::now();
+    bool reportTiming = false;
+
+    if (argc > 1 && string(argv[1]) == "-t")
+    {
+        reportTiming = true;
+        argc--;
+        argv++;
+    }
+
+    if (argc < 4 || argc % 2 != 0)
+        FATAL_ERROR("USAGE: jsonproc [-t] <json-filepath> <template-filepath> <output-filepath> [<template-filepath> <output-filepath> ...]\n");
 
     string jsonfilepath = argv[1];
-    string templateFilepath = argv[2];
-    string outputFilepath = argv[3];
+    string templateFilepath;
 
     Environment env;
     env.set_trim_blocks(true);
 
     // Add custom command callbacks.
-    env.add_callback("doNotModifyHeader", 0, [jsonfilepath, templateFilepath](Arguments& args) {
+    env.add_callback("doNotModifyHeader", 0, [&jsonfilepath, &templateFilepath](Arguments& args) {
         return "//\n// DO NOT MODIFY THIS FILE! It is auto-generated from " + jsonfilepath +" and Inja template " + templateFilepath + "\n//\n";
     });
 
@@ -120,13 +198,43 @@ int main(int argc, char *argv[])
         return str;
     });
 
-    try
+    string err;
+    jsonreader::Json data = jsonreader::Json::parse_file(jsonfilepath, err);
+
+    if (!err.empty())
+        FATAL_ERROR("JSONPROC_ERROR: %s: %s\n", jsonfilepath.c_str(), err.c_str());
+
+    // The data is parsed once and rendered with each template in turn; a
+    // template named more than once is only parsed the first time.
+    json injaData = to_inja_json(data);
+    std::map<string, Template> templates;
+
+    for (int i = 2; i < argc; i += 2)
     {
-        env.write_with_json_file(templateFilepath, jsonfilepath, outputFilepath);
+        templateFilepath = argv[i];
+        string outputFilepath = argv[i + 1];
+
+        // Each output starts from the same state as a separate run would.
+        customVars.clear();
+
+        try
+        {
+            auto it = templates.find(templateFilepath);
+            if (it == templates.end())
+                it = templates.emplace(templateFilepath, env.parse_template(templateFilepath)).first;
+
+            write_if_changed(outputFilepath, env.render(it->second, injaData));
+        }
+        catch (const std::exception& e)
+        {
+            FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        }
     }
-    catch (const std::exception& e)
+
+    if (reportTiming)
     {
-        FATAL_ERROR("JSONPROC_ERROR: %s\n", e.what());
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        jsonreader::print_stats(stderr, "jsonproc", elapsed.count());
     }
 
     return 0;
@@ -0,0 +1,805 @@
+// json_reader.cpp
+
+#include "json_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace jsonreader {
+
+// Far deeper than any real data; keeps bad input from overflowing the stack.
+static const int kMaxDepth = 200;
+
+// Escaped strings are decoded into blocks of this size.
+static const size_t kArenaBlockSize = 64 * 1024;
+
+struct Node {
+    Json::Type type;
+    Json::NumberKind kind;
+    // String length, or element/member count.
+    uint32_t size;
+    union {
+        const char *str;
+        // Index of the first element in Document::elements or member in
+        // Document::members.
+        uint32_t first;
+        bool boolean;
+        int64_t integer;
+        uint64_t uinteger;
+        double number;
+    };
+};
+
+static const Node s_nullNode = {};
+
+class Document {
+public:
+    Document() : m_mapped(nullptr), m_mappedSize(0), m_arenaNext(nullptr), m_arenaLeft(0) {}
+    Document(const Document &) = delete;
+    Document &operator=(const Document &) = delete;
+
+    ~Document() {
+#ifndef _WIN32
+        if (m_mapped != nullptr)
+            munmap(m_mapped, m_mappedSize);
+#endif
+    }
+
+    bool load(const std::string &path, std::string &err);
+    bool parse(std::string_view text, std::string &err);
+
+    char *allocate(size_t size);
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> elements;
+    std::vector<Member> members;
+
+    std::string owned;
+
+private:
+    void *m_mapped;
+    size_t m_mappedSize;
+
+    std::vector<std::unique_ptr<char[]>> m_arena;
+    char *m_arenaNext;
+    size_t m_arenaLeft;
+};
+
+char *Document::allocate(size_t size) {
+    if (size > m_arenaLeft) {
+        if (size > kArenaBlockSize / 4) {
+            m_arena.emplace_back(new char[size]);
+            return m_arena.back().get();
+        }
+        m_arena.emplace_back(new char[kArenaBlockSize]);
+        m_arenaNext = m_arena.back().get();
+        m_arenaLeft = kArenaBlockSize;
+    }
+
+    char *p = m_arenaNext;
+    m_arenaNext += size;
+    m_arenaLeft -= size;
+    return p;
+}
+
+class Parser {
+public:
+    Parser(Document &doc, std::string_view text, std::string &err)
+        : m_doc(doc), m_text(text.data()), m_size(text.size()), m_pos(0), m_err(err) {}
+
+    bool parse_document();
+
+private:
+    bool parse_value(int depth, uint32_t &index);
+    bool parse_array(int depth, uint32_t index);
+    bool parse_object(int depth, uint32_t index);
+    bool parse_string(std::string_view &out);
+    bool parse_escaped_string(size_t start, std::string_view &out);
+    bool parse_number(uint32_t index);
+    bool parse_literal(const char *literal);
+    bool fail(const std::string &message);
+
+    void skip_whitespace() {
+        while (m_pos < m_size) {
+            char c = m_text[m_pos];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                break;
+            m_pos++;
+        }
+    }
+
+    Document &m_doc;
+    const char *m_text;
+    size_t m_size;
+    size_t m_pos;
+    std::string &m_err;
+
+    // Children of the arrays and objects currently being parsed; each
+    // container's run is moved into the document when it closes, so that
+    // its children end up contiguous.
+    std::vector<uint32_t> m_elementStack;
+    std::vector<Member> m_memberStack;
+};
+
+static std::string describe_char(char c) {
+    char buffer[16];
+    if ((unsigned char)c >= 0x20 && (unsigned char)c < 0x7F)
+        std::snprintf(buffer, sizeof(buffer), "'%c'", c);
+    else
+        std::snprintf(buffer, sizeof(buffer), "(%d)", (unsigned char)c);
+    return buffer;
+}
+
+bool Parser::fail(const std::string &message) {
+    size_t end = std::min(m_pos, m_size);
+    int line = 1 + (int)std::count(m_text, m_text + end, '\n');
+    m_err = "line " + std::to_string(line) + ": " + message;
+    return false;
+}
+
+bool Parser::parse_document() {
+    uint32_t root;
+
+    // nlohmann::json, which jsonproc used to parse with, skips a UTF-8 BOM.
+    if (m_size >= 3 && std::memcmp(m_text, "\xEF\xBB\xBF", 3) == 0)
+        m_pos = 3;
+
+    skip_whitespace();
+    if (!parse_value(0, root))
+        return false;
+
+    skip_whitespace();
+    if (m_pos != m_size)
+        return fail("unexpected trailing " + describe_char(m_text[m_pos]));
+
+    return true;
+}
+
+bool Parser::parse_value(int depth, uint32_t &index) {
+    if (depth > kMaxDepth)
+        return fail("exceeded maximum nesting depth");
+
+    if (m_pos >= m_size)
+        return fail("unexpected end of input");
+
+    index = m_doc.nodes.size();
+    m_doc.nodes.emplace_back();
+    Node &node = m_doc.nodes.back();
+
+    switch (m_text[m_pos]) {
+    case '{':
+        node.type = Json::Type::OBJECT;
+        return parse_object(depth, index);
+    case '[':
+        node.type = Json::Type::ARRAY;
+        return parse_array(depth, index);
+    case '"': {
+        node.type = Json::Type::STRING;
+        std::string_view value;
+        if (!parse_string(value))
+            return false;
+        Node &string = m_doc.nodes[index];
+        string.str = value.data();
+        string.size = value.size();
+        return true;
+    }
+    case 't':
+        node.type = Json::Type::BOOL;
+        node.boolean = true;
+        return parse_literal("true");
+    case 'f':
+        node.type = Json::Type::BOOL;
+        node.boolean = false;
+        return parse_literal("false");
+    case 'n':
+        node.type = Json::Type::NUL;
+        return parse_literal("null");
+    default:
+        if (m_text[m_pos] == '-' || (m_text[m_pos] >= '0' && m_text[m_pos] <= '9')) {
+            node.type = Json::Type::NUMBER;
+            return parse_number(index);
+        }
+        return fail("expected value, got " + describe_char(m_text[m_pos]));
+    }
+}
+
+bool Parser::parse_array(int depth, uint32_t index) {
+    size_t base = m_elementStack.size();
+
+    m_pos++;
+    skip_whitespace();
+
+    if (m_pos < m_size && m_text[m_pos] == ']') {
+        m_pos++;
+    } else {
+        for (;;) {
+            uint32_t element;
+            skip_whitespace();
+            if (!parse_value(depth + 1, element))
+                return false;
+            m_elementStack.push_back(element);
+
+            skip_whitespace();
+            if (m_pos >= m_size)
+                return fail("unexpected end of input in list");
+            char c = m_text[m_pos++];
+            if (c == ']')
+                break;
+            if (c != ',')
+                return fail("expected ',' in list, got " + describe_char(c));
+        }
+    }
+
+    Node &node = m_doc.nodes[index];
+    node.first = m_doc.elements.size();
+    node.size = m_elementStack.size() - base;
+    m_doc.elements.insert(m_doc.elements.end(), m_elementStack.begin() + base, m_elementStack.end());
+    m_elementStack.resize(base);
+    return true;
+}
+
+bool Parser::parse_object(int depth, uint32_t index) {
+    size_t base = m_memberStack.size();
+
+    m_pos++;
+    skip_whitespace();
+
+    if (m_pos < m_size && m_text[m_pos] == '}') {
+        m_pos++;
+    } else {
+        for (;;) {
+            Member member;
+
+            skip_whitespace();
+            if (m_pos >= m_size)
+                return fail("unexpected end of input in object");
+            if (m_text[m_pos] != '"')
+                return fail("expected '\"' in object, got " + describe_char(m_text[m_pos]));
+            if (!parse_string(member.key))
+                return false;
+
+            skip_whitespace();
+            if (m_pos >= m_size || m_text[m_pos] != ':')
+                return fail("expected ':' in object");
+            m_pos++;
+
+            skip_whitespace();
+            if (!parse_value(depth + 1, member.value))
+                return false;
+            m_memberStack.push_back(member);
+
+            skip_whitespace();
+            if (m_pos >= m_size)
+                return fail("unexpected end of input in object");
+            char c = m_text[m_pos++];
+            if (c == '}')
+                break;
+            if (c != ',')
+                return fail("expected ',' in object, got " + describe_char(c));
+        }
+    }
+
+    Node &node = m_doc.nodes[index];
+    node.first = m_doc.members.size();
+    node.size = m_memberStack.size() - base;
+    m_doc.members.insert(m_doc.members.end(), m_memberStack.begin() + base, m_memberStack.end());
+    m_memberStack.resize(base);
+    return true;
+}
+
+// Strings without escapes are returned as views into the input text.
+bool Parser::parse_string(std::string_view &out) {
+    size_t start = ++m_pos;
+
+    while (m_pos < m_size) {
+        unsigned char c = m_text[m_pos];
+        if (c == '"') {
+            out = std::string_view(m_text + start, m_pos - start);
+            m_pos++;
+            return true;
+        }
+        if (c == '\\')
+            return parse_escaped_string(start, out);
+        if (c < 0x20)
+            return fail("unescaped " + describe_char(c) + " in string");
+        m_pos++;
+    }
+
+    return fail("unexpected end of input in string");
+}
+
+static void encode_utf8(long codepoint, std::string &out) {
+    if (codepoint < 0x80) {
+        out += (char)codepoint;
+    } else if (codepoint < 0x800) {
+        out += (char)((codepoint >> 6) | 0xC0);
+        out += (char)((codepoint & 0x3F) | 0x80);
+    } else if (codepoint < 0x10000) {
+        out += (char)((codepoint >> 12) | 0xE0);
+        out += (char)(((codepoint >> 6) & 0x3F) | 0x80);
+        out += (char)((codepoint & 0x3F) | 0x80);
+    } else {
+        out += (char)((codepoint >> 18) | 0xF0);
+        out += (char)(((codepoint >> 12) & 0x3F) | 0x80);
+        out += (char)(((codepoint >> 6) & 0x3F) | 0x80);
+        out += (char)((codepoint & 0x3F) | 0x80);
+    }
+}
+
+static long parse_hex4(const char *p) {
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+// Decodes a string from start (just past its opening quote) into the
+// document's arena. Called once the first backslash is found at m_pos.
+bool Parser::parse_escaped_string(size_t start, std::string_view &out) {
+    std::string decoded(m_text + start, m_pos - start);
+
+    while (m_pos < m_size) {
+        unsigned char c = m_text[m_pos++];
+
+        if (c == '"') {
+            char *copy = m_doc.allocate(decoded.size());
+            std::memcpy(copy, decoded.data(), decoded.size());
+            out = std::string_view(copy, decoded.size());
+            return true;
+        }
+
+        if (c < 0x20)
+            return fail("unescaped " + describe_char(c) + " in string");
+
+        if (c != '\\') {
+            decoded += (char)c;
+            continue;
+        }
+
+        if (m_pos >= m_size)
+            break;
+
+        char escape = m_text[m_pos++];
+        switch (escape) {
+        case 'b': decoded += '\b'; break;
+        case 'f': decoded += '\f'; break;
+        case 'n': decoded += '\n'; break;
+        case 'r': decoded += '\r'; break;
+        case 't': decoded += '\t'; break;
+        case '"':
+        case '\\':
+        case '/':
+            decoded += escape;
+            break;
+        case 'u': {
+            long codepoint = m_size - m_pos >= 4 ? parse_hex4(m_text + m_pos) : -1;
+            if (codepoint < 0)
+                return fail("bad \\u escape");
+            m_pos += 4;
+
+            // Combine a surrogate pair into one code point.
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF && m_size - m_pos >= 6
+             && m_text[m_pos] == '\\' && m_text[m_pos + 1] == 'u') {
+                long low = parse_hex4(m_text + m_pos + 2);
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    codepoint = (((codepoint - 0xD800) << 10) | (low - 0xDC00)) + 0x10000;
+                    m_pos += 6;
+                }
+            }
+
+            encode_utf8(codepoint, decoded);
+            break;
+        }
+        default:
+            return fail("invalid escape character " + describe_char(escape));
+        }
+    }
+
+    return fail("unexpected end of input in string");
+}
+
+// Integers that fit in 64 bits are kept exact, negative ones as INTEGER and
+// the rest as UNSIGNED, like nlohmann::json; anything else is a double.
+bool Parser::parse_number(uint32_t index) {
+    size_t start = m_pos;
+    bool negative = false;
+    bool overflow = false;
+    bool isFloat = false;
+    uint64_t magnitude = 0;
+
+    if (m_text[m_pos] == '-') {
+        negative = true;
+        m_pos++;
+    }
+
+    if (m_pos >= m_size)
+        return fail("unexpected end of input in number");
+
+    if (m_text[m_pos] == '0') {
+        m_pos++;
+        if (m_pos < m_size && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+            return fail("leading 0s not permitted in numbers");
+    } else if (m_text[m_pos] >= '1' && m_text[m_pos] <= '9') {
+        while (m_pos < m_size && m_text[m_pos] >= '0' && m_text[m_pos] <= '9') {
+            unsigned digit = m_text[m_pos++] - '0';
+            if (magnitude > (UINT64_MAX - digit) / 10)
+                overflow = true;
+            else
+                magnitude = magnitude * 10 + digit;
+        }
+    } else {
+        return fail("invalid " + describe_char(m_text[m_pos]) + " in number");
+    }
+
+    if (m_pos < m_size && m_text[m_pos] == '.') {
+        isFloat = true;
+        m_pos++;
+        if (m_pos >= m_size || m_text[m_pos] < '0' || m_text[m_pos] > '9')
+            return fail("at least one digit required in fractional part");
+        while (m_pos < m_size && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+            m_pos++;
+    }
+
+    if (m_pos < m_size && (m_text[m_pos] == 'e' || m_text[m_pos] == 'E')) {
+        isFloat = true;
+        m_pos++;
+        if (m_pos < m_size && (m_text[m_pos] == '+' || m_text[m_pos] == '-'))
+            m_pos++;
+        if (m_pos >= m_size || m_text[m_pos] < '0' || m_text[m_pos] > '9')
+            return fail("at least one digit required in exponent");
+        while (m_pos < m_size && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+            m_pos++;
+    }
+
+    Node &node = m_doc.nodes[index];
+
+    if (!isFloat && !overflow && !negative) {
+        node.kind = Json::NumberKind::UNSIGNED;
+        node.uinteger = magnitude;
+    } else if (!isFloat && !overflow && magnitude <= (uint64_t)INT64_MAX + 1) {
+        node.kind = Json::NumberKind::INTEGER;
+        node.integer = (int64_t)(0 - magnitude);
+    } else {
+        // strtod needs a terminated copy; the mapped file isn't.
+        std::string token(m_text + start, m_pos - start);
+        node.kind = Json::NumberKind::FLOAT;
+        node.number = std::strtod(token.c_str(), nullptr);
+    }
+
+    return true;
+}
+
+bool Parser::parse_literal(const char *literal) {
+    size_t length = std::strlen(literal);
+
+    if (m_size - m_pos < length || std::memcmp(m_text + m_pos, literal, length) != 0)
+        return fail(std::string("expected ") + literal);
+
+    m_pos += length;
+    return true;
+}
+
+static std::atomic<uint64_t> s_parsedFiles(0);
+static std::atomic<uint64_t> s_parsedBytes(0);
+static std::atomic<uint64_t> s_parseNanoseconds(0);
+
+bool Document::parse(std::string_view text, std::string &err) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Map files have a node per ~10 bytes; reserving avoids most regrowth.
+    nodes.reserve(text.size() / 8 + 1);
+
+    Parser parser(*this, text, err);
+    bool ok = parser.parse_document();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    s_parsedFiles++;
+    s_parsedBytes += text.size();
+    s_parseNanoseconds += elapsed.count();
+
+    return ok;
+}
+
+bool Document::load(const std::string &path, std::string &err) {
+#ifdef _WIN32
+    FILE *fp = std::fopen(path.c_str(), "rb");
+
+    if (fp == nullptr) {
+        err = "Cannot open file " + path + " for reading.";
+        return false;
+    }
+
+    std::fseek(fp, 0, SEEK_END);
+    owned.resize(std::ftell(fp));
+    std::rewind(fp);
+    bool readOk = owned.empty() || std::fread(&owned[0], owned.size(), 1, fp) == 1;
+    std::fclose(fp);
+
+    if (!readOk) {
+        err = "Cannot read file " + path + ".";
+        return false;
+    }
+
+    return parse(owned, err);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        err = "Cannot open file " + path + " for reading.";
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        err = "Cannot read file " + path + ".";
+        return false;
+    }
+
+    // An empty file can't be mapped, but it can fail to parse all the same.
+    if (st.st_size == 0) {
+        close(fd);
+        return parse(std::string_view(), err);
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED) {
+        err = "Cannot read file " + path + ".";
+        return false;
+    }
+
+    m_mapped = mapped;
+    m_mappedSize = st.st_size;
+
+    return parse(std::string_view((const char *)mapped, st.st_size), err);
+#endif
+}
+
+const Member *Object::find(std::string_view key) const {
+    for (const Member *member = m_end; member != m_begin; ) {
+        --member;
+        if (member->key == key)
+            return member;
+    }
+    return m_end;
+}
+
+Json Json::parse(const std::string &text, std::string &err) {
+    auto doc = std::make_shared<Document>();
+    doc->owned = text;
+
+    if (!doc->parse(doc->owned, err))
+        return Json();
+
+    return Json(std::move(doc), 0);
+}
+
+Json Json::parse_file(const std::string &path, std::string &err) {
+    auto doc = std::make_shared<Document>();
+
+    if (!doc->load(path, err))
+        return Json();
+
+    return Json(std::move(doc), 0);
+}
+
+Json Json::object() {
+    static const Json empty = [] {
+        std::string err;
+        return Json::parse("{}", err);
+    }();
+    return empty;
+}
+
+const Node &Json::node() const {
+    return m_doc ? m_doc->nodes[m_index] : s_nullNode;
+}
+
+Json::Type Json::type() const {
+    return node().type;
+}
+
+Json::NumberKind Json::number_kind() const {
+    return node().kind;
+}
+
+double Json::number_value() const {
+    const Node &n = node();
+    if (n.type != Type::NUMBER)
+        return 0;
+    switch (n.kind) {
+    case NumberKind::INTEGER:
+        return (double)n.integer;
+    case NumberKind::UNSIGNED:
+        return (double)n.uinteger;
+    default:
+        return n.number;
+    }
+}
+
+int Json::int_value() const {
+    return (int)integer_value();
+}
+
+int64_t Json::integer_value() const {
+    const Node &n = node();
+    if (n.type != Type::NUMBER)
+        return 0;
+    switch (n.kind) {
+    case NumberKind::INTEGER:
+        return n.integer;
+    case NumberKind::UNSIGNED:
+        return (int64_t)n.uinteger;
+    default:
+        return (int64_t)n.number;
+    }
+}
+
+uint64_t Json::unsigned_value() const {
+    return (uint64_t)integer_value();
+}
+
+bool Json::bool_value() const {
+    const Node &n = node();
+    return n.type == Type::BOOL && n.boolean;
+}
+
+std::string_view Json::string_view() const {
+    const Node &n = node();
+    if (n.type != Type::STRING)
+        return std::string_view();
+    return std::string_view(n.str, n.size);
+}
+
+size_t Json::size() const {
+    const Node &n = node();
+    if (n.type != Type::ARRAY && n.type != Type::OBJECT)
+        return 0;
+    return n.size;
+}
+
+std::vector<Json> Json::array_items() const {
+    std::vector<Json> items;
+    const Node &n = node();
+
+    if (n.type == Type::ARRAY) {
+        items.reserve(n.size);
+        for (uint32_t i = 0; i < n.size; i++)
+            items.push_back(Json(m_doc, m_doc->elements[n.first + i]));
+    }
+
+    return items;
+}
+
+Object Json::object_items() const {
+    const Node &n = node();
+
+    if (n.type != Type::OBJECT)
+        return Object(nullptr, nullptr);
+
+    const Member *first = m_doc->members.data() + n.first;
+    return Object(first, first + n.size);
+}
+
+Json Json::operator[](size_t i) const {
+    const Node &n = node();
+
+    if (i >= size())
+        return Json();
+    if (n.type == Type::ARRAY)
+        return Json(m_doc, m_doc->elements[n.first + i]);
+    return Json(m_doc, m_doc->members[n.first + i].value);
+}
+
+std::string_view Json::key(size_t i) const {
+    const Node &n = node();
+
+    if (n.type != Type::OBJECT || i >= n.size)
+        return std::string_view();
+    return m_doc->members[n.first + i].key;
+}
+
+Json Json::operator[](std::string_view key) const {
+    Object members = object_items();
+    const Member *member = members.find(key);
+
+    if (member == members.end())
+        return Json();
+    return Json(m_doc, member->value);
+}
+
+Json Json::operator[](const Member &member) const {
+    return Json(m_doc, member.value);
+}
+
+bool Json::operator==(const Json &other) const {
+    if (m_doc == other.m_doc && m_index == other.m_index)
+        return true;
+
+    Type t = type();
+    if (t != other.type())
+        return false;
+
+    switch (t) {
+    case Type::NUL:
+        return true;
+    case Type::BOOL:
+        return bool_value() == other.bool_value();
+    case Type::NUMBER:
+        return number_value() == other.number_value();
+    case Type::STRING:
+        return string_view() == other.string_view();
+    case Type::ARRAY:
+        if (size() != other.size())
+            return false;
+        for (size_t i = 0; i < size(); i++)
+            if ((*this)[i] != other[i])
+                return false;
+        return true;
+    case Type::OBJECT:
+        if (size() != other.size())
+            return false;
+        for (size_t i = 0; i < size(); i++)
+            if (key(i) != other.key(i) || (*this)[i] != other[i])
+                return false;
+        return true;
+    }
+
+    return false;
+}
+
+ParseStats parse_stats() {
+    ParseStats stats;
+    stats.files = s_parsedFiles;
+    stats.bytes = s_parsedBytes;
+    stats.nanoseconds = s_parseNanoseconds;
+    return stats;
+}
+
+long peak_rss_kib() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void print_stats(FILE *fp, const char *tool, double elapsed_ms) {
+    ParseStats stats = parse_stats();
+    std::fprintf(fp, "%s: parsed %llu JSON files (%llu bytes) in %.2f ms of %.2f ms total, peak RSS %ld KiB\n",
+                 tool, (unsigned long long)stats.files, (unsigned long long)stats.bytes,
+                 stats.nanoseconds / 1e6, elapsed_ms, peak_rss_kib());
+}
+
+} // namespace jsonreader
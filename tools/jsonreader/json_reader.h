@@ -0,0 +1,126 @@
+// json_reader.h
+//
+// Read-only JSON documents for the host tools that consume the project's
+// JSON data (mapjson, jsonproc). A file is memory-mapped and parsed into a
+// flat arena of nodes; strings that contain no escapes are views into the
+// mapped file, so loading a document costs a few large allocations rather
+// than one per value. The interface follows json11's, which mapjson was
+// written against.
+//
+// Json handles are cheap to copy and keep their document alive.
+
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jsonreader {
+
+class Document;
+struct Node;
+
+struct Member {
+    std::string_view key;
+    uint32_t value;
+};
+
+// The members of an object, in file order.
+class Object {
+public:
+    Object(const Member *begin, const Member *end) : m_begin(begin), m_end(end) {}
+
+    const Member *begin() const { return m_begin; }
+    const Member *end() const { return m_end; }
+    size_t size() const { return m_end - m_begin; }
+
+    // Returns the last member named key (later duplicates win, as they do
+    // when json11 or nlohmann::json build their maps), or end().
+    const Member *find(std::string_view key) const;
+
+private:
+    const Member *m_begin;
+    const Member *m_end;
+};
+
+class Json {
+public:
+    enum class Type { NUL, NUMBER, BOOL, STRING, ARRAY, OBJECT };
+
+    // Integers keep their exact value when they fit in 64 bits.
+    enum class NumberKind { INTEGER, UNSIGNED, FLOAT };
+
+    Json() : m_index(0) {}
+
+    // Parses text, which is copied into the document. Returns a null Json
+    // and sets err on failure.
+    static Json parse(const std::string &text, std::string &err);
+
+    // Maps and parses the file at path. Returns a null Json and sets err on
+    // failure.
+    static Json parse_file(const std::string &path, std::string &err);
+
+    // An empty object, for comparisons like json11's Json::object().
+    static Json object();
+
+    Type type() const;
+
+    NumberKind number_kind() const;
+    double number_value() const;
+    int int_value() const;
+    int64_t integer_value() const;
+    uint64_t unsigned_value() const;
+    bool bool_value() const;
+    std::string_view string_view() const;
+    std::string string_value() const { return std::string(string_view()); }
+
+    // Number of elements of an array or members of an object; 0 otherwise.
+    size_t size() const;
+
+    std::vector<Json> array_items() const;
+    Object object_items() const;
+
+    // Element i of an array, or the value of member i of an object.
+    Json operator[](size_t i) const;
+    // Name of member i of an object.
+    std::string_view key(size_t i) const;
+    // Value of the member named key, or a null Json.
+    Json operator[](std::string_view key) const;
+    Json operator[](const Member &member) const;
+
+    bool operator==(const Json &other) const;
+    bool operator!=(const Json &other) const { return !(*this == other); }
+
+private:
+    Json(std::shared_ptr<const Document> doc, uint32_t index) : m_doc(std::move(doc)), m_index(index) {}
+
+    const Node &node() const;
+
+    std::shared_ptr<const Document> m_doc;
+    uint32_t m_index;
+};
+
+// Totals over every document parsed by this process, for the tools' -t
+// reports. Safe to update from several threads.
+struct ParseStats {
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t nanoseconds;
+};
+
+ParseStats parse_stats();
+
+// Peak resident set size of this process in KiB, or 0 if unknown.
+long peak_rss_kib();
+
+// Prints the parse totals, the tool's total run time and peak RSS as one
+// line prefixed with tool.
+void print_stats(FILE *fp, const char *tool, double elapsed_ms);
+
+} // namespace jsonreader
+
+#endif // JSON_READER_H
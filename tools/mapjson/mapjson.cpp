@@ -24,35 +24,36 @@ using std::ostringstream;
 #include <limits>
 using std::numeric_limits;
 
-#include "json11.h"
-using json11::Json;
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "json_reader.h"
+using jsonreader::Json;
 
 #include "mapjson.h"
 
 string version;
 // System directory separator
 string sep;
-
-string read_text_file(string filepath) {
-    ifstream in_file(filepath);
-
-    if (!in_file.is_open())
-        FATAL_ERROR("Cannot open file %s for reading.\n", filepath.c_str());
-
-    string text;
-
-    in_file.seekg(0, std::ios::end);
-    text.resize(in_file.tellg());
-
-    in_file.seekg(0, std::ios::beg);
-    in_file.read(&text[0], text.size());
-
-    in_file.close();
-
-    return text;
-}
+// Set by 'all' mode: leave outputs alone if their contents wouldn't change,
+// so that make doesn't reassemble the files that include them.
+bool skip_unchanged_outputs = false;
+// Parsed map.json files by path, filled by 'all' mode so that the groups and
+// event constants outputs don't parse every map a second time.
+map<string, Json> parsed_maps;
 
 void write_text_file(string filepath, string text) {
+    if (skip_unchanged_outputs) {
+        ifstream existing(filepath, std::ifstream::binary);
+        if (existing.is_open()) {
+            ostringstream current;
+            current << existing.rdbuf();
+            if (current.str() == text)
+                return;
+        }
+    }
+
     ofstream out_file(filepath, std::ofstream::binary);
 
     if (!out_file.is_open())
@@ -64,6 +65,14 @@ void write_text_file(string filepath, string text) {
 }
 
 
+Json read_map_json(const string &filepath, string &err) {
+    auto it = parsed_maps.find(filepath);
+    if (it != parsed_maps.end())
+        return it->second;
+
+    return Json::parse_file(filepath, err);
+}
+
 string json_to_string(const Json &data, const string &field = "", bool silent = false) {
     const Json value = !field.empty() ? data[field] : data;
     string output = "";
@@ -367,28 +376,29 @@ string file_parent(string filename){
     return filename.substr(0, dir_pos + 1);
 }
 
+void write_map_outputs(const Json &map_data, const Json &layouts_data, string output_dir) {
+    string header_text = generate_map_header_text(map_data, layouts_data);
+    string events_text = generate_map_events_text(map_data);
+    string connections_text = generate_map_connections_text(map_data);
+
+    string out_dir = strip_trailing_separator(output_dir).append(sep);
+    write_text_file(out_dir + "header.inc", header_text);
+    write_text_file(out_dir + "events.inc", events_text);
+    write_text_file(out_dir + "connections.inc", connections_text);
+}
+
 void process_map(string map_filepath, string layouts_filepath, string output_dir) {
     string mapdata_err, layouts_err;
 
-    string mapdata_json_text = read_text_file(map_filepath);
-    string layouts_json_text = read_text_file(layouts_filepath);
-
-    Json map_data = Json::parse(mapdata_json_text, mapdata_err);
+    Json map_data = Json::parse_file(map_filepath, mapdata_err);
     if (map_data == Json())
         FATAL_ERROR("%s\n", mapdata_err.c_str());
 
-    Json layouts_data = Json::parse(layouts_json_text, layouts_err);
+    Json layouts_data = Json::parse_file(layouts_filepath, layouts_err);
     if (layouts_data == Json())
         FATAL_ERROR("%s\n", layouts_err.c_str());
 
-    string header_text = generate_map_header_text(map_data, layouts_data);
-    string events_text = generate_map_events_text(map_data);
-    string connections_text = generate_map_connections_text(map_data);
-
-    string out_dir = strip_trailing_separator(output_dir).append(sep);
-    write_text_file(out_dir + "header.inc", header_text);
-    write_text_file(out_dir + "events.inc", events_text);
-    write_text_file(out_dir + "connections.inc", connections_text);
+    write_map_outputs(map_data, layouts_data, output_dir);
 }
 
 void process_event_constants(const vector<string> &map_filepaths, string output_ids_file) {
@@ -400,8 +410,7 @@ void process_event_constants(const vector<string> &map_filepaths, string output_
 
     for (const string &filepath : map_filepaths) {
         string err;
-        string map_json_text = read_text_file(filepath);
-        Json map_data = Json::parse(map_json_text, err);
+        Json map_data = read_map_json(filepath, err);
         if (map_data == Json())
             FATAL_ERROR("Failed to read '%s' while generating map event constants: %s\n", filepath.c_str(), err.c_str());
 
@@ -520,7 +529,7 @@ string generate_events_text(Json groups_data, string include_path) {
 }
 
 string generate_map_constants_text(string groups_filepath, Json groups_data) {
-    string file_dir = file_parent(groups_filepath) + sep;
+    string file_dir = file_parent(groups_filepath);
 
     string guard_name = "CONSTANTS_MAP_GROUPS";
     ostringstream text;
@@ -539,7 +548,7 @@ string generate_map_constants_text(string groups_filepath, Json groups_data) {
         for (auto &map_name : groups_data[groupName].array_items()) {
             string map_filepath = file_dir + json_to_string(map_name) + sep + "map.json";
             string err_str;
-            Json map_data = Json::parse(read_text_file(map_filepath), err_str);
+            Json map_data = read_map_json(map_filepath, err_str);
             if (map_data == Json())
                 FATAL_ERROR("%s: %s\n", map_filepath.c_str(), err_str.c_str());
             string id = json_to_string(map_data, "id", true);
@@ -572,7 +581,7 @@ void process_groups(string groups_filepath, string output_asm, string output_c)
     output_c = strip_trailing_separator(output_c);
 
     string err;
-    Json groups_data = Json::parse(read_text_file(groups_filepath), err);
+    Json groups_data = Json::parse_file(groups_filepath, err);
 
     if (groups_data == Json())
         FATAL_ERROR("%s\n", err.c_str());
@@ -657,16 +666,10 @@ string generate_layouts_constants_text(Json layouts_data) {
     return text.str();
 }
 
-void process_layouts(string layouts_filepath, string output_asm, string output_c) {
+void write_layouts_outputs(const Json &layouts_data, string output_asm, string output_c) {
     output_asm = strip_trailing_separator(output_asm).append(sep);
     output_c = strip_trailing_separator(output_c).append(sep);
 
-    string err;
-    Json layouts_data = Json::parse(read_text_file(layouts_filepath), err);
-
-    if (layouts_data == Json())
-        FATAL_ERROR("%s\n", err.c_str());
-
     string layout_headers_text = generate_layout_headers_text(layouts_data);
     string layouts_table_text = generate_layouts_table_text(layouts_data);
     string layouts_constants_text = generate_layouts_constants_text(layouts_data);
@@ -676,9 +679,75 @@ void process_layouts(string layouts_filepath, string output_asm, string output_c
     write_text_file(output_c + "layouts.h", layouts_constants_text);
 }
 
+void process_layouts(string layouts_filepath, string output_asm, string output_c) {
+    string err;
+    Json layouts_data = Json::parse_file(layouts_filepath, err);
+
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    write_layouts_outputs(layouts_data, output_asm, output_c);
+}
+
+// Generates everything the map data build needs in one run: the per-map
+// header/events/connections files next to each map.json, the group and
+// layout tables, and the map constants headers in output_c. layouts.json is
+// parsed once and the maps are processed on a pool of threads.
+void process_all(string groups_filepath, string layouts_filepath, string output_c, const vector<string> &map_filepaths, int jobs) {
+    skip_unchanged_outputs = true;
+
+    string err;
+    Json layouts_data = Json::parse_file(layouts_filepath, err);
+
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    vector<Json> maps_data(map_filepaths.size());
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < map_filepaths.size()) {
+            string map_err;
+            Json map_data = Json::parse_file(map_filepaths[i], map_err);
+            if (map_data == Json())
+                FATAL_ERROR("%s: %s\n", map_filepaths[i].c_str(), map_err.c_str());
+
+            write_map_outputs(map_data, layouts_data, file_parent(map_filepaths[i]));
+            maps_data[i] = map_data;
+        }
+    };
+
+    if (jobs <= 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    vector<std::thread> threads;
+    for (int i = 1; i < jobs; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &thread : threads)
+        thread.join();
+
+    for (size_t i = 0; i < map_filepaths.size(); i++)
+        parsed_maps[map_filepaths[i]] = maps_data[i];
+
+    write_layouts_outputs(layouts_data, file_parent(layouts_filepath), output_c);
+    process_groups(groups_filepath, file_parent(groups_filepath), output_c);
+    process_event_constants(map_filepaths, strip_trailing_separator(output_c) + sep + "map_event_ids.h");
+}
+
 int main(int argc, char *argv[]) {
+    auto start_time = std::chrono::steady_clock::now();
+    bool report_timing = false;
+
+    if (argc > 1 && string(argv[1]) == "-t") {
+        report_timing = true;
+        argc--;
+        argv++;
+    }
+
     if (argc < 3)
-        FATAL_ERROR("USAGE: mapjson <mode> <game-version> [options]\n");
+        FATAL_ERROR("USAGE: mapjson [-t] <mode> <game-version> [options]\n");
 
     char *version_arg = argv[2];
     version = string(version_arg);
@@ -736,8 +805,34 @@ int main(int argc, char *argv[]) {
 
         process_event_constants(filepaths, output_ids_file);
     }
+    else if (mode == "all") {
+        const char *usage = "USAGE: mapjson all <game-version> [-j jobs] <groups_file> <layouts_file> <output_c_dir> <map_file> [additional_map_files]\n";
+        int arg = 3;
+        int jobs = 0;
+
+        if (argc > arg + 1 && string(argv[arg]) == "-j") {
+            jobs = std::atoi(argv[arg + 1]);
+            arg += 2;
+        }
+
+        if (argc < arg + 4)
+            FATAL_ERROR("%s", usage);
+
+        infer_separator(argv[arg]);
+        string groups_filepath(argv[arg]);
+        string layouts_filepath(argv[arg + 1]);
+        string output_c(argv[arg + 2]);
+        vector<string> filepaths(argv + arg + 3, argv + argc);
+
+        process_all(groups_filepath, layouts_filepath, output_c, filepaths, jobs);
+    }
     else {
-        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'event_constants', or 'groups'.\n");
+        FATAL_ERROR("ERROR: <mode> must be 'layouts', 'map', 'event_constants', 'groups', or 'all'.\n");
+    }
+
+    if (report_timing) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_time;
+        jsonreader::print_stats(stderr, "mapjson", elapsed.count());
     }
 
     return 0;
@@ -0,0 +1,533 @@
+// metatiles.cpp
+
+#include <iostream>
+using std::cout; using std::endl;
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <map>
+using std::map;
+
+#include <set>
+using std::set;
+
+#include <array>
+using std::array;
+
+#include <fstream>
+using std::ofstream; using std::ifstream;
+
+#include <sstream>
+using std::ostringstream;
+
+#include <regex>
+using std::regex; using std::smatch; using std::sregex_iterator;
+
+#include <cstdint>
+
+#include "json_reader.h"
+using jsonreader::Json;
+
+#include "metatiles.h"
+
+struct Tileset {
+    string name;
+    string directory;
+    bool secondary = false;
+    vector<uint16_t> metatiles;
+    vector<uint16_t> attributes;
+    int num_tiles = 0;
+    bool in_layout = false;
+    vector<bool> metatile_used;
+    vector<bool> tile_referenced;
+    vector<bool> tile_referenced_by_used;
+    vector<string> warnings;
+};
+
+string read_text_file(const string &filepath) {
+    ifstream in_file(filepath, std::ifstream::binary);
+
+    if (!in_file.is_open())
+        FATAL_ERROR("Cannot open file %s for reading.\n", filepath.c_str());
+
+    ostringstream text;
+    text << in_file.rdbuf();
+    return text.str();
+}
+
+vector<uint16_t> read_u16_file(const string &filepath) {
+    string data = read_text_file(filepath);
+
+    if (data.size() % 2 != 0)
+        FATAL_ERROR("%s has an odd size (%d bytes).\n", filepath.c_str(), (int)data.size());
+
+    vector<uint16_t> values(data.size() / 2);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = (uint8_t)data[i * 2] | ((uint8_t)data[i * 2 + 1] << 8);
+
+    return values;
+}
+
+void write_u16_file(const string &filepath, const vector<uint16_t> &values) {
+    string data;
+    for (uint16_t value : values) {
+        data += (char)(value & 0xFF);
+        data += (char)(value >> 8);
+    }
+
+    ofstream out_file(filepath, std::ofstream::binary);
+
+    if (!out_file.is_open())
+        FATAL_ERROR("Cannot open file %s for writing.\n", filepath.c_str());
+
+    out_file << data;
+}
+
+string hex(int value, int digits = 3) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+    return buffer;
+}
+
+// Reads a tileset's metatiles and attributes. Anything the game couldn't
+// draw is an error; palettes past the map palettes are only a warning.
+void load_metatiles(Tileset &tileset, const string &metatiles_filepath, const string &attributes_filepath) {
+    tileset.metatiles = read_u16_file(metatiles_filepath);
+    tileset.attributes = read_u16_file(attributes_filepath);
+
+    if (tileset.metatiles.size() % kTilesPerMetatile != 0)
+        FATAL_ERROR("%s isn't a whole number of metatiles (%d bytes).\n", metatiles_filepath.c_str(), (int)tileset.metatiles.size() * 2);
+
+    int num_metatiles = tileset.metatiles.size() / kTilesPerMetatile;
+
+    if (num_metatiles > kMetatilesPerTileset)
+        FATAL_ERROR("%s has %d metatiles, more than the %d a tileset can hold.\n", metatiles_filepath.c_str(), num_metatiles, kMetatilesPerTileset);
+
+    if ((int)tileset.attributes.size() != num_metatiles)
+        FATAL_ERROR("%s has attributes for %d metatiles, but %s has %d metatiles.\n", attributes_filepath.c_str(),
+                    (int)tileset.attributes.size(), metatiles_filepath.c_str(), num_metatiles);
+
+    int base_id = tileset.secondary ? kMetatilesPerTileset : 0;
+
+    for (int i = 0; i < num_metatiles; i++) {
+        int layer_type = tileset.attributes[i] >> 12;
+
+        if (layer_type > kMaxLayerType)
+            FATAL_ERROR("%s: metatile %s has unknown layer type %d.\n", attributes_filepath.c_str(), hex(base_id + i).c_str(), layer_type);
+
+        for (int j = 0; j < kTilesPerMetatile; j++) {
+            int palette = tileset.metatiles[i * kTilesPerMetatile + j] >> 12;
+
+            if (palette >= kNumPalettes) {
+                tileset.warnings.push_back("metatile " + hex(base_id + i) + " uses palette " + std::to_string(palette));
+                break;
+            }
+        }
+    }
+
+    tileset.metatile_used.assign(num_metatiles, false);
+}
+
+// Builds the packed layout described in metatiles.h.
+vector<uint16_t> pack_metatiles(const Tileset &tileset) {
+    int num_metatiles = tileset.attributes.size();
+    map<array<uint16_t, kTilesPerMetatile + 1>, int> entry_indices;
+    vector<uint16_t> entries;
+    vector<uint16_t> packed = { (uint16_t)num_metatiles, 0 };
+
+    for (int i = 0; i < num_metatiles; i++) {
+        array<uint16_t, kTilesPerMetatile + 1> entry;
+        entry[0] = tileset.attributes[i];
+        for (int j = 0; j < kTilesPerMetatile; j++)
+            entry[j + 1] = tileset.metatiles[i * kTilesPerMetatile + j];
+
+        auto inserted = entry_indices.emplace(entry, entry_indices.size());
+        if (inserted.second)
+            entries.insert(entries.end(), entry.begin(), entry.end());
+        packed.push_back(inserted.first->second);
+    }
+
+    packed[1] = entry_indices.size();
+
+    // The index table costs a u16 per metatile, so with few duplicates it's
+    // smaller to write every metatile's entry in order and leave it out.
+    if ((num_metatiles - packed[1]) * (kTilesPerMetatile + 1) <= num_metatiles) {
+        packed.resize(2);
+        packed[1] = num_metatiles;
+        for (int i = 0; i < num_metatiles; i++) {
+            packed.push_back(tileset.attributes[i]);
+            packed.insert(packed.end(), tileset.metatiles.begin() + i * kTilesPerMetatile,
+                          tileset.metatiles.begin() + (i + 1) * kTilesPerMetatile);
+        }
+        return packed;
+    }
+
+    packed.insert(packed.end(), entries.begin(), entries.end());
+
+    return packed;
+}
+
+int packed_size(const Tileset &tileset) {
+    return pack_metatiles(tileset).size() * 2;
+}
+
+// Whether pack_metatiles shares duplicate entries through an index table.
+bool is_indexed(const Tileset &tileset) {
+    return pack_metatiles(tileset)[1] < tileset.attributes.size();
+}
+
+int count_duplicates(const Tileset &tileset) {
+    set<vector<uint16_t>> entries;
+    for (size_t i = 0; i < tileset.attributes.size(); i++) {
+        vector<uint16_t> entry(tileset.metatiles.begin() + i * kTilesPerMetatile, tileset.metatiles.begin() + (i + 1) * kTilesPerMetatile);
+        entry.push_back(tileset.attributes[i]);
+        entries.insert(entry);
+    }
+    return tileset.attributes.size() - entries.size();
+}
+
+// Lists the set positions of a bit vector as ranges of ids starting at base_id.
+string format_ranges(const vector<bool> &bits, int base_id, bool value) {
+    string text;
+    for (size_t i = 0; i < bits.size(); i++) {
+        if (bits[i] != value)
+            continue;
+
+        size_t end = i;
+        while (end + 1 < bits.size() && bits[end + 1] == value)
+            end++;
+
+        text += (text.empty() ? "" : ", ") + hex(base_id + i);
+        if (end > i)
+            text += "-" + hex(base_id + end);
+        i = end;
+    }
+    return text;
+}
+
+int count(const vector<bool> &bits, bool value) {
+    int total = 0;
+    for (bool bit : bits)
+        total += bit == value;
+    return total;
+}
+
+// The tile count comes from the -num_tiles option the tiles are converted
+// with, or else from the size of the image.
+int get_num_tiles(const string &png_filepath, const string &options) {
+    smatch match;
+    if (std::regex_search(options, match, regex("-num_tiles\\s+(\\d+)")))
+        return std::stoi(match[1]);
+
+    string png = read_text_file(png_filepath);
+    if (png.size() < 24 || png.compare(1, 3, "PNG") != 0)
+        FATAL_ERROR("%s is not a PNG file.\n", png_filepath.c_str());
+
+    auto read_u32_be = [&](int offset) {
+        return ((uint8_t)png[offset] << 24) | ((uint8_t)png[offset + 1] << 16) | ((uint8_t)png[offset + 2] << 8) | (uint8_t)png[offset + 3];
+    };
+
+    return (read_u32_be(16) / 8) * (read_u32_be(20) / 8);
+}
+
+map<string, Tileset> load_tilesets(const string &headers_filepath, const string &metatiles_filepath, const vector<string> &graphics_filepaths) {
+    string metatiles_text = read_text_file(metatiles_filepath);
+    map<string, string> metatile_paths;
+    regex incbin_regex("const u16 (\\w+)\\[\\] = INCBIN_U16\\(\"([^\"]+)\"\\);");
+    for (auto it = sregex_iterator(metatiles_text.begin(), metatiles_text.end(), incbin_regex); it != sregex_iterator(); ++it)
+        metatile_paths[(*it)[1]] = (*it)[2];
+
+    map<string, std::pair<string, string>> tile_graphics;
+    regex incgfx_regex("const u32 (\\w+)\\[\\] = INCGFX_U32\\(\"([^\"]+)\", \"[^\"]*\"(?:, \"([^\"]*)\")?\\);");
+    for (const string &graphics_filepath : graphics_filepaths) {
+        string graphics_text = read_text_file(graphics_filepath);
+        for (auto it = sregex_iterator(graphics_text.begin(), graphics_text.end(), incgfx_regex); it != sregex_iterator(); ++it)
+            tile_graphics[(*it)[1]] = { (*it)[2], (*it)[3] };
+    }
+
+    auto find_path = [&](const map<string, string> &paths, const string &symbol, const string &tileset) {
+        auto it = paths.find(symbol);
+        if (it == paths.end())
+            FATAL_ERROR("Failed to find %s for %s in %s.\n", symbol.c_str(), tileset.c_str(), metatiles_filepath.c_str());
+        return it->second;
+    };
+
+    string headers_text = read_text_file(headers_filepath);
+    map<string, Tileset> tilesets;
+    regex tileset_regex("const struct Tileset (\\w+) =\\s*\\{([^}]*)\\};");
+    for (auto it = sregex_iterator(headers_text.begin(), headers_text.end(), tileset_regex); it != sregex_iterator(); ++it) {
+        Tileset tileset;
+        tileset.name = (*it)[1];
+        string fields = (*it)[2];
+
+        auto field = [&](const string &name) {
+            smatch match;
+            if (!std::regex_search(fields, match, regex("\\." + name + " = (\\w+)")))
+                FATAL_ERROR("Tileset %s in %s has no .%s.\n", tileset.name.c_str(), headers_filepath.c_str(), name.c_str());
+            return match[1].str();
+        };
+
+        tileset.secondary = field("isSecondary") == "TRUE";
+        string metatiles_path = find_path(metatile_paths, field("metatiles"), tileset.name);
+        load_metatiles(tileset, metatiles_path, find_path(metatile_paths, field("metatileAttributes"), tileset.name));
+        tileset.directory = metatiles_path.substr(0, metatiles_path.find_last_of('/'));
+
+        auto graphics = tile_graphics.find(field("tiles"));
+        if (graphics == tile_graphics.end())
+            FATAL_ERROR("Failed to find the graphics %s for %s.\n", field("tiles").c_str(), tileset.name.c_str());
+        tileset.num_tiles = get_num_tiles(graphics->second.first, graphics->second.second);
+
+        tileset.tile_referenced.assign(kTilesPerTileset, false);
+        tileset.tile_referenced_by_used.assign(kTilesPerTileset, false);
+        tilesets[tileset.name] = std::move(tileset);
+    }
+
+    return tilesets;
+}
+
+Tileset &get_tileset(map<string, Tileset> &tilesets, const string &name, const string &user) {
+    auto it = tilesets.find(name);
+    if (it == tilesets.end())
+        FATAL_ERROR("%s uses unknown tileset %s.\n", user.c_str(), name.c_str());
+    return it->second;
+}
+
+// Marks a metatile id (0-1023, as stored in map data) as used. Returns false
+// if the id is past the end of its tileset.
+bool mark_metatile(Tileset &primary, Tileset *secondary, int metatile_id) {
+    Tileset *tileset = metatile_id < kMetatilesPerTileset ? &primary : secondary;
+    int index = metatile_id % kMetatilesPerTileset;
+
+    if (tileset == nullptr || index >= (int)tileset->metatile_used.size())
+        return false;
+
+    tileset->metatile_used[index] = true;
+    return true;
+}
+
+// Marks the metatiles named by METATILE_ labels. Labels are grouped under a
+// comment naming their tileset; a label with an id in the other half of the
+// map's metatiles belongs to the tilesets the layouts pair it with.
+void mark_labels(map<string, Tileset> &tilesets, const set<std::pair<string, string>> &pairs, const string &labels_filepath) {
+    string text = read_text_file(labels_filepath);
+    std::istringstream lines(text);
+    string line;
+    Tileset *tileset = nullptr;
+    regex tileset_regex("^// (gTileset_\\w+)");
+    regex label_regex("^#define (METATILE_\\w+)\\s+(0x[0-9A-Fa-f]+|\\d+)");
+
+    while (std::getline(lines, line)) {
+        smatch match;
+        if (std::regex_search(line, match, tileset_regex)) {
+            tileset = &get_tileset(tilesets, match[1], labels_filepath);
+            continue;
+        }
+
+        if (tileset == nullptr || !std::regex_search(line, match, label_regex))
+            continue;
+
+        int id = std::stoi(match[2], nullptr, 0);
+
+        if ((id >= kMetatilesPerTileset) == tileset->secondary) {
+            if (!mark_metatile(*tileset, tileset, id))
+                tileset->warnings.push_back("label " + match[1].str() + " is past the last metatile");
+            continue;
+        }
+
+        for (const auto &pair : pairs) {
+            if (tileset->secondary && pair.second == tileset->name)
+                mark_metatile(tilesets[pair.first], tileset, id);
+            else if (!tileset->secondary && pair.first == tileset->name)
+                mark_metatile(*tileset, &tilesets[pair.second], id);
+        }
+    }
+}
+
+// Marks the metatiles each layout's map and border use, and returns the
+// primary/secondary pairs the layouts combine.
+set<std::pair<string, string>> mark_layouts(map<string, Tileset> &tilesets, const string &layouts_filepath, vector<string> &warnings) {
+    string err;
+    Json layouts_data = Json::parse_file(layouts_filepath, err);
+
+    if (layouts_data == Json())
+        FATAL_ERROR("%s\n", err.c_str());
+
+    set<std::pair<string, string>> pairs;
+
+    for (const Json &layout : layouts_data["layouts"].array_items()) {
+        if (layout.object_items().size() == 0)
+            continue;
+
+        string name = layout["name"].string_value();
+        Tileset &primary = get_tileset(tilesets, layout["primary_tileset"].string_value(), name);
+        string secondary_name = layout["secondary_tileset"].string_value();
+        // A layout may have no secondary tileset ("0" or "NULL").
+        Tileset *secondary = secondary_name == "0" || secondary_name == "NULL" ? nullptr : &get_tileset(tilesets, secondary_name, name);
+
+        primary.in_layout = true;
+        if (secondary != nullptr) {
+            secondary->in_layout = true;
+            pairs.emplace(primary.name, secondary->name);
+        }
+
+        for (const char *field : { "blockdata_filepath", "border_filepath" }) {
+            string filepath = layout[field].string_value();
+            set<int> bad_ids;
+
+            for (uint16_t block : read_u16_file(filepath))
+                if (!mark_metatile(primary, secondary, block & 0x3FF))
+                    bad_ids.insert(block & 0x3FF);
+
+            for (int id : bad_ids) {
+                if (id >= kMetatilesPerTileset && secondary == nullptr)
+                    warnings.push_back(filepath + ": metatile " + hex(id) + " needs a secondary tileset, but " + name + " has none");
+                else
+                    warnings.push_back(filepath + ": metatile " + hex(id) + " is past the end of " + (id < kMetatilesPerTileset ? primary.name : secondary_name));
+            }
+        }
+    }
+
+    return pairs;
+}
+
+// Marks the tiles each metatile draws. Tiles 0-511 belong to the primary
+// tileset and 512-1023 to the secondary one, so a metatile's tiles land in
+// every tileset it is paired with by some layout.
+void mark_tiles(map<string, Tileset> &tilesets, const set<std::pair<string, string>> &pairs) {
+    for (auto &entry : tilesets) {
+        Tileset &tileset = entry.second;
+        vector<Tileset *> other_half;
+
+        for (const auto &pair : pairs) {
+            if (tileset.secondary && pair.second == tileset.name)
+                other_half.push_back(&tilesets[pair.first]);
+            else if (!tileset.secondary && pair.first == tileset.name)
+                other_half.push_back(&tilesets[pair.second]);
+        }
+
+        for (size_t i = 0; i < tileset.metatiles.size(); i++) {
+            int tile = tileset.metatiles[i] & 0x3FF;
+            bool used = tileset.metatile_used[i / kTilesPerMetatile];
+            bool own_half = (tile >= kTilesPerTileset) == tileset.secondary;
+            vector<Tileset *> targets = own_half ? vector<Tileset *>{ &tileset } : other_half;
+
+            for (Tileset *target : targets) {
+                target->tile_referenced[tile % kTilesPerTileset] = true;
+                if (used)
+                    target->tile_referenced_by_used[tile % kTilesPerTileset] = true;
+            }
+        }
+    }
+}
+
+void print_tileset_report(const Tileset &tileset) {
+    int num_metatiles = tileset.metatile_used.size();
+    int base_id = tileset.secondary ? kMetatilesPerTileset : 0;
+
+    cout << tileset.name << " (" << tileset.directory << ")" << (tileset.in_layout ? "" : ", used by no layout") << endl;
+
+    int unused = count(tileset.metatile_used, false);
+    cout << "  metatiles: " << num_metatiles << ", " << unused << " unused";
+    if (unused > 0)
+        cout << ": " << format_ranges(tileset.metatile_used, base_id, false);
+    cout << endl;
+
+    int original_size = num_metatiles * (kTilesPerMetatile + 1) * 2;
+    cout << "  duplicates: " << count_duplicates(tileset);
+    if (is_indexed(tileset))
+        cout << ", packed layout " << original_size << " -> " << packed_size(tileset) << " bytes";
+    else
+        cout << ", not packed (interleaved layout, " << packed_size(tileset) << " bytes)";
+    cout << endl;
+
+    vector<bool> tiles(tileset.tile_referenced.begin(), tileset.tile_referenced.begin() + std::min(tileset.num_tiles, kTilesPerTileset));
+    vector<bool> tiles_used(tileset.tile_referenced_by_used.begin(), tileset.tile_referenced_by_used.begin() + tiles.size());
+    vector<bool> only_unused(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++)
+        only_unused[i] = tiles[i] && !tiles_used[i];
+
+    int unreferenced = count(tiles, false);
+    cout << "  tiles: " << tileset.num_tiles << ", " << unreferenced << " unreferenced";
+    if (unreferenced > 0)
+        cout << ": " << format_ranges(tiles, base_id, false);
+    cout << endl;
+
+    int only_unused_count = count(only_unused, true);
+    if (only_unused_count > 0)
+        cout << "  tiles only drawn by unused metatiles: " << only_unused_count << ": " << format_ranges(only_unused, base_id, true) << endl;
+
+    for (size_t i = tiles.size(); i < tileset.tile_referenced.size(); i++) {
+        if (tileset.tile_referenced[i]) {
+            cout << "  warning: metatiles draw tiles past the last tile, from " << hex(base_id + i) << endl;
+            break;
+        }
+    }
+
+    for (const string &warning : tileset.warnings)
+        cout << "  warning: " << warning << endl;
+}
+
+void report(const vector<string> &args) {
+    map<string, Tileset> tilesets = load_tilesets(args[1], args[2], vector<string>(args.begin() + 4, args.end()));
+    vector<string> layout_warnings;
+
+    set<std::pair<string, string>> pairs = mark_layouts(tilesets, args[0], layout_warnings);
+    mark_labels(tilesets, pairs, args[3]);
+    mark_tiles(tilesets, pairs);
+
+    int total_metatiles = 0, total_unused = 0, total_size = 0, total_packed = 0;
+
+    for (bool secondary : { false, true }) {
+        for (const auto &entry : tilesets) {
+            const Tileset &tileset = entry.second;
+            if (tileset.secondary != secondary)
+                continue;
+
+            print_tileset_report(tileset);
+
+            total_metatiles += tileset.metatile_used.size();
+            total_unused += count(tileset.metatile_used, false);
+            total_size += tileset.metatile_used.size() * (kTilesPerMetatile + 1) * 2;
+            if (is_indexed(tileset))
+                total_packed += packed_size(tileset);
+            else
+                total_packed += tileset.metatile_used.size() * (kTilesPerMetatile + 1) * 2;
+        }
+    }
+
+    for (const string &warning : layout_warnings)
+        cout << "warning: " << warning << endl;
+
+    cout << "total: " << tilesets.size() << " tilesets, " << total_metatiles << " metatiles, " << total_unused
+         << " unused, packed layouts " << total_size << " -> " << total_packed << " bytes" << endl;
+}
+
+void pack(const vector<string> &args) {
+    Tileset tileset;
+    load_metatiles(tileset, args[0], args[1]);
+
+    for (const string &warning : tileset.warnings)
+        fprintf(stderr, "%s: warning: %s\n", args[0].c_str(), warning.c_str());
+
+    write_u16_file(args[2], pack_metatiles(tileset));
+}
+
+int main(int argc, char *argv[]) {
+    string mode = argc > 1 ? argv[1] : "";
+    vector<string> args(argv + std::min(argc, 2), argv + argc);
+
+    if (mode == "pack" && args.size() == 3) {
+        pack(args);
+    } else if (mode == "report" && args.size() >= 5) {
+        report(args);
+    } else {
+        FATAL_ERROR("USAGE: metatiles pack <metatiles.bin> <metatile_attributes.bin> <output>\n"
+                    "       metatiles report <layouts.json> <tileset headers.h> <metatiles.h> <metatile_labels.h> <graphics.c/h>...\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+// metatiles.h
+
+#ifndef METATILES_H
+#define METATILES_H
+
+#include <cstdio>
+using std::fprintf; using std::exit;
+
+#include <cstdlib>
+
+#ifdef _MSC_VER
+
+#define FATAL_ERROR(format, ...)          \
+do                                        \
+{                                         \
+    fprintf(stderr, format, __VA_ARGS__); \
+    exit(1);                              \
+} while (0)
+
+#else
+
+#define FATAL_ERROR(format, ...)            \
+do                                          \
+{                                           \
+    fprintf(stderr, format, ##__VA_ARGS__); \
+    exit(1);                                \
+} while (0)
+
+#endif // _MSC_VER
+
+// Tileset limits, from include/fieldmap.h.
+const int kMetatilesPerTileset = 512;
+const int kTilesPerTileset = 512;
+const int kTilesPerMetatile = 8;
+const int kNumPalettes = 13;
+const int kMaxLayerType = 2;
+
+// Packed layout written by 'pack' (all values are little-endian u16):
+//   metatile count, entry count
+//   entry index for each metatile, only if entry count < metatile count
+//   entries: attributes (behavior and layer type), then the 8 tilemap entries
+// Metatiles with the same tiles and attributes share an entry, and each
+// entry carries everything DrawMetatile needs for one metatile. When sharing
+// wouldn't pay for the index table, the entry count equals the metatile count
+// and the entries are the metatiles in order.
+
+#endif // METATILES_H
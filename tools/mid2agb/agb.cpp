@@ -28,42 +28,98 @@
 #include "midi.h"
 #include "tables.h"
 
-int g_agbTrack;
-
-static std::string s_lastOpName;
-static int s_blockNum;
-static bool s_keepLastOpName;
-static int s_lastNote;
-static int s_lastVelocity;
-static bool s_noteChanged;
-static bool s_velocityChanged;
-static bool s_inPattern;
-static int s_extendedCommand;
-static int s_memaccOp;
-static int s_memaccParam1;
-static int s_memaccParam2;
+thread_local std::string g_agbOutput;
+thread_local int g_agbTrack;
+thread_local int g_agbByteCount;
+
+static thread_local std::string s_lastOpName;
+static thread_local int s_blockNum;
+static thread_local bool s_keepLastOpName;
+static thread_local int s_lastNote;
+static thread_local int s_lastVelocity;
+static thread_local bool s_noteChanged;
+static thread_local bool s_velocityChanged;
+static thread_local bool s_inPattern;
+static thread_local int s_patternSegments;
+static thread_local int s_extendedCommand;
+static thread_local int s_memaccOp;
+static thread_local int s_memaccParam1;
+static thread_local int s_memaccParam2;
+static thread_local bool s_measuring;
+
+// Appends to the output, unless the track is only being measured.
+static void EmitV(const char *format, std::va_list args)
+{
+    if (s_measuring)
+        return;
+
+    char buffer[256];
+    std::va_list argsCopy;
+    va_copy(argsCopy, args);
+    int length = std::vsnprintf(buffer, sizeof(buffer), format, argsCopy);
+    va_end(argsCopy);
+
+    if (length < (int)sizeof(buffer))
+    {
+        g_agbOutput.append(buffer, length);
+    }
+    else
+    {
+        std::size_t start = g_agbOutput.size();
+        g_agbOutput.resize(start + length + 1);
+        std::vsnprintf(&g_agbOutput[start], length + 1, format, args);
+        g_agbOutput.resize(start + length);
+    }
+}
+
+static void Emit(const char *format, ...)
+{
+    std::va_list args;
+    va_start(args, format);
+    EmitV(format, args);
+    va_end(args);
+}
+
+// Counts the bytes in the operands of a .byte directive.
+static int CountBytes(const char *operands)
+{
+    int count = 1;
+
+    for (; *operands != 0; operands++)
+        if (*operands == ',')
+            count++;
+
+    return count;
+}
 
 void PrintAgbHeader()
 {
-    std::fprintf(g_outputFile, "\t.include \"MPlayDef.s\"\n\n");
-    std::fprintf(g_outputFile, "\t.equ\t%s_grp, voicegroup%s\n", g_asmLabel.c_str(), g_voiceGroup.c_str());
-    std::fprintf(g_outputFile, "\t.equ\t%s_pri, %u\n", g_asmLabel.c_str(), g_priority);
+    g_agbOutput.clear();
+    g_agbByteCount = 0;
+    s_extendedCommand = 0;
+    s_memaccOp = 0;
+    s_memaccParam1 = 0;
+    s_memaccParam2 = 0;
+
+    Emit("\t.include \"MPlayDef.s\"\n\n");
+    Emit("\t.equ\t%s_grp, voicegroup%s\n", g_asmLabel.c_str(), g_voiceGroup.c_str());
+    Emit("\t.equ\t%s_pri, %u\n", g_asmLabel.c_str(), g_priority);
 
     if (g_reverb >= 0)
-        std::fprintf(g_outputFile, "\t.equ\t%s_rev, reverb_set+%u\n", g_asmLabel.c_str(), g_reverb);
+        Emit("\t.equ\t%s_rev, reverb_set+%u\n", g_asmLabel.c_str(), g_reverb);
     else
-        std::fprintf(g_outputFile, "\t.equ\t%s_rev, 0\n", g_asmLabel.c_str());
+        Emit("\t.equ\t%s_rev, 0\n", g_asmLabel.c_str());
 
-    std::fprintf(g_outputFile, "\t.equ\t%s_mvl, %u\n", g_asmLabel.c_str(), g_masterVolume);
-    std::fprintf(g_outputFile, "\t.equ\t%s_key, %u\n", g_asmLabel.c_str(), 0);
-    std::fprintf(g_outputFile, "\t.equ\t%s_tbs, %u\n", g_asmLabel.c_str(), g_clocksPerBeat);
-    std::fprintf(g_outputFile, "\t.equ\t%s_exg, %u\n", g_asmLabel.c_str(), g_exactGateTime);
-    std::fprintf(g_outputFile, "\t.equ\t%s_cmp, %u\n", g_asmLabel.c_str(), g_compressionEnabled);
+    Emit("\t.equ\t%s_mvl, %u\n", g_asmLabel.c_str(), g_masterVolume);
+    Emit("\t.equ\t%s_key, %u\n", g_asmLabel.c_str(), 0);
+    Emit("\t.equ\t%s_tbs, %u\n", g_asmLabel.c_str(), g_clocksPerBeat);
+    Emit("\t.equ\t%s_exg, %u\n", g_asmLabel.c_str(), g_exactGateTime);
+    Emit("\t.equ\t%s_cmp, %u\n", g_asmLabel.c_str(), g_compressionEnabled);
 
-    std::fprintf(g_outputFile, "\n\t.section .rodata\n");
-    std::fprintf(g_outputFile, "\t.global\t%s\n", g_asmLabel.c_str());
+    Emit("\n\t.section .rodata\n");
+    Emit("\t.global\t%s\n", g_asmLabel.c_str());
 
-    std::fprintf(g_outputFile, "\t.align\t2\n");
+    Emit("\t.align\t2\n");
 }
 
 void ResetTrackVars()
@@ -81,7 +137,8 @@ void PrintWait(int wait)
 {
     if (wait > 0)
     {
-        std::fprintf(g_outputFile, "\t.byte\tW%02d\n", wait);
+        Emit("\t.byte\tW%02d\n", wait);
+        g_agbByteCount++;
         s_velocityChanged = true;
         s_noteChanged = true;
         s_keepLastOpName = true;
@@ -92,28 +149,34 @@ void PrintOp(int wait, std::string name, const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t.byte\t\t");
+    Emit("\t.byte\t\t");
 
     if (format != nullptr)
     {
+        char operands[128];
+        std::vsnprintf(operands, sizeof(operands), format, args);
+
         if (!g_compressionEnabled || s_lastOpName != name)
         {
-            std::fprintf(g_outputFile, "%s, ", name.c_str());
+            Emit("%s, ", name.c_str());
             s_lastOpName = name;
+            g_agbByteCount++;
         }
         else
         {
-            std::fprintf(g_outputFile, "        ");
+            Emit("        ");
         }
-        std::vfprintf(g_outputFile, format, args);
+        Emit("%s", operands);
+        g_agbByteCount += CountBytes(operands);
     }
     else
     {
-        std::fputs(name.c_str(), g_outputFile);
+        Emit("%s", name.c_str());
         s_lastOpName = name;
+        g_agbByteCount++;
     }
 
-    std::fprintf(g_outputFile, "\n");
+    Emit("\n");
 
     va_end(args);
 
@@ -124,9 +187,10 @@ void PrintByte(const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t.byte\t");
-    std::vfprintf(g_outputFile, format, args);
-    std::fprintf(g_outputFile, "\n");
+    char operands[128];
+    std::vsnprintf(operands, sizeof(operands), format, args);
+    Emit("\t.byte\t%s\n", operands);
+    g_agbByteCount += CountBytes(operands);
     s_velocityChanged = true;
     s_noteChanged = true;
     s_keepLastOpName = true;
@@ -137,9 +201,10 @@ void PrintWord(const char *format, ...)
 {
     std::va_list args;
     va_start(args, format);
-    std::fprintf(g_outputFile, "\t .word\t");
-    std::vfprintf(g_outputFile, format, args);
-    std::fprintf(g_outputFile, "\n");
+    Emit("\t .word\t");
+    EmitV(format, args);
+    Emit("\n");
+    g_agbByteCount += 4;
     va_end(args);
 }
 
@@ -246,7 +311,7 @@ void PrintEndOfTieOp(const Event& event)
 void PrintSeqLoopLabel(const Event& event)
 {
     s_blockNum = event.param1 + 1;
-    std::fprintf(g_outputFile, "%s_%u_B%u:\n", g_asmLabel.c_str(), g_agbTrack, s_blockNum);
+    Emit("%s_%u_B%u:\n", g_asmLabel.c_str(), g_agbTrack, s_blockNum);
     PrintWait(event.time);
     ResetTrackVars();
 }
@@ -376,7 +441,7 @@ void PrintControllerOp(const Event& event)
         PrintWait(event.time);
         break;
     case 0x11:
-        std::fprintf(g_outputFile, "%s_%u_L%u:\n", g_asmLabel.c_str(), g_agbTrack, event.param2);
+        Emit("%s_%u_L%u:\n", g_asmLabel.c_str(), g_agbTrack, event.param2);
         PrintWait(event.time);
         ResetTrackVars();
         break;
@@ -414,10 +479,18 @@ void PrintControllerOp(const Event& event)
     }
 }
 
+// The number of stretches between pattern boundaries that a pattern spans.
+// The pattern search stores it in param1; Compress leaves that 0 for its
+// single-segment patterns.
+static int PatternSegmentCount(const Event& event)
+{
+    return event.param1 > 0 ? event.param1 : 1;
+}
+
 void PrintAgbTrack(std::vector<Event>& events)
 {
-    std::fprintf(g_outputFile, "\n@**************** Track %u (Midi-Chn.%u) ****************@\n\n", g_agbTrack, g_midiChan + 1);
-    std::fprintf(g_outputFile, "%s_%u:\n", g_asmLabel.c_str(), g_agbTrack);
+    Emit("\n@**************** Track %u (Midi-Chn.%u) ****************@\n\n", g_agbTrack, g_midiChan + 1);
+    Emit("%s_%u:\n", g_asmLabel.c_str(), g_agbTrack);
 
     int wholeNoteCount = 0;
     int loopEndBlockNum = 0;
@@ -448,15 +521,14 @@ void PrintAgbTrack(std::vector<Event>& events)
     {
         const Event& event = events[i];
 
-        if (IsPatternBoundary(event.type))
+        if (s_inPattern && IsPatternBoundary(event.type) && --s_patternSegments == 0)
         {
-            if (s_inPattern)
-                PrintByte("PEND");
+            PrintByte("PEND");
             s_inPattern = false;
         }
 
         if (event.type == EventType::WholeNoteMark || event.type == EventType::Pattern)
-            std::fprintf(g_outputFile, "@ %03d   ----------------------------------------\n", wholeNoteCount++);
+            Emit("@ %03d   ----------------------------------------\n", wholeNoteCount++);
 
         switch (event.type)
         {
@@ -487,9 +559,10 @@ void PrintAgbTrack(std::vector<Event>& events)
         case EventType::WholeNoteMark:
             if (event.param2 & 0x80000000)
             {
-                std::fprintf(g_outputFile, "%s_%u_%03lu:\n", g_asmLabel.c_str(), g_agbTrack, (unsigned long)(event.param2 & 0x7FFFFFFF));
+                Emit("%s_%u_%03lu:\n", g_asmLabel.c_str(), g_agbTrack, (unsigned long)(event.param2 & 0x7FFFFFFF));
                 ResetTrackVars();
                 s_inPattern = true;
+                s_patternSegments = PatternSegmentCount(event);
             }
             PrintWait(event.time);
             break;
@@ -497,8 +570,18 @@ void PrintAgbTrack(std::vector<Event>& events)
             PrintByte("PATT");
             PrintWord("%s_%u_%03lu", g_asmLabel.c_str(), g_agbTrack, event.param2);
 
-            while (!IsPatternBoundary(events[i + 1].type))
+            for (int segments = PatternSegmentCount(event); ; )
+            {
+                while (!IsPatternBoundary(events[i + 1].type))
+                    i++;
+
+                if (--segments == 0)
+                    break;
+
                 i++;
+                if (events[i].type == EventType::WholeNoteMark)
+                    Emit("@ %03d   ----------------------------------------\n", wholeNoteCount++);
+            }
 
             ResetTrackVars();
             break;
@@ -524,24 +607,52 @@ void PrintAgbTrack(std::vector<Event>& events)
     PrintByte("FINE");
 }
 
+int MeasureAgbTrack(std::vector<Event>& events)
+{
+    // Save the state that carries over from one track to the next.
+    int byteCount = g_agbByteCount;
+    int blockNum = s_blockNum;
+    int extendedCommand = s_extendedCommand;
+    int memaccOp = s_memaccOp;
+    int memaccParam1 = s_memaccParam1;
+    int memaccParam2 = s_memaccParam2;
+
+    s_measuring = true;
+    PrintAgbTrack(events);
+    s_measuring = false;
+
+    int size = g_agbByteCount - byteCount;
+
+    g_agbByteCount = byteCount;
+    s_blockNum = blockNum;
+    s_extendedCommand = extendedCommand;
+    s_memaccOp = memaccOp;
+    s_memaccParam1 = memaccParam1;
+    s_memaccParam2 = memaccParam2;
+
+    return size;
+}
+
 void PrintAgbFooter()
 {
     int trackCount = g_agbTrack - 1;
 
-    std::fprintf(g_outputFile, "\n@******************************************************@\n");
-    std::fprintf(g_outputFile, "\t.align\t2\n");
-    std::fprintf(g_outputFile, "\n%s:\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\t.byte\t%u\t@ NumTrks\n", trackCount);
-    std::fprintf(g_outputFile, "\t.byte\t%u\t@ NumBlks\n", 0);
-    std::fprintf(g_outputFile, "\t.byte\t%s_pri\t@ Priority\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\t.byte\t%s_rev\t@ Reverb.\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\n");
-    std::fprintf(g_outputFile, "\t.word\t%s_grp\n", g_asmLabel.c_str());
-    std::fprintf(g_outputFile, "\n");
+    Emit("\n@******************************************************@\n");
+    Emit("\t.align\t2\n");
+    g_agbByteCount = (g_agbByteCount + 3) & ~3;
+    g_agbByteCount += 8 + 4 * trackCount;
+    Emit("\n%s:\n", g_asmLabel.c_str());
+    Emit("\t.byte\t%u\t@ NumTrks\n", trackCount);
+    Emit("\t.byte\t%u\t@ NumBlks\n", 0);
+    Emit("\t.byte\t%s_pri\t@ Priority\n", g_asmLabel.c_str());
+    Emit("\t.byte\t%s_rev\t@ Reverb.\n", g_asmLabel.c_str());
+    Emit("\n");
+    Emit("\t.word\t%s_grp\n", g_asmLabel.c_str());
+    Emit("\n");
 
     // track pointers
     for (int i = 1; i <= trackCount; i++)
-        std::fprintf(g_outputFile, "\t.word\t%s_%u\n", g_asmLabel.c_str(), i);
+        Emit("\t.word\t%s_%u\n", g_asmLabel.c_str(), i);
 
-    std::fprintf(g_outputFile, "\n\t.end\n");
+    Emit("\n\t.end\n");
 }
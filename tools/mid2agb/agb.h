@@ -21,13 +21,21 @@
 #ifndef AGB_H
 #define AGB_H
 
+#include <string>
 #include <vector>
 #include "midi.h"
 
 void PrintAgbHeader();
 void PrintAgbTrack(std::vector<Event>& events);
+// Returns the size in bytes of the track PrintAgbTrack would print.
+int MeasureAgbTrack(std::vector<Event>& events);
 void PrintAgbFooter();
 
-extern int g_agbTrack;
+// The assembly printed so far for the song being converted. Like all of
+// the conversion state, it's separate for each thread.
+extern thread_local std::string g_agbOutput;
+extern thread_local int g_agbTrack;
+// Bytes of song data printed so far.
+extern thread_local int g_agbByteCount;
 
 #endif // AGB_H
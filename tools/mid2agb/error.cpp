@@ -21,6 +21,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstdarg>
+#include "error.h"
+
+thread_local std::string g_errorFilename;
 
 // Reports an error diagnostic and terminates the program.
 [[noreturn]] void RaiseError(const char* format, ...)
@@ -30,7 +33,10 @@
     std::va_list args;
     va_start(args, format);
     std::vsnprintf(buffer, bufferSize, format, args);
-    std::fprintf(stderr, "error: %s\n", buffer);
+    if (g_errorFilename.empty())
+        std::fprintf(stderr, "error: %s\n", buffer);
+    else
+        std::fprintf(stderr, "error: %s: %s\n", g_errorFilename.c_str(), buffer);
     va_end(args);
     std::exit(1);
 }
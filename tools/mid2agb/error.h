@@ -21,6 +21,11 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <string>
+
+// When set, error messages name this file. Separate for each thread.
+extern thread_local std::string g_errorFilename;
+
 [[noreturn]] void RaiseError(const char* format, ...);
 
 #endif // ERROR_H
@@ -23,33 +23,64 @@
 #include <cstring>
 #include <cctype>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <set>
+#include <thread>
+#include <vector>
 #include "main.h"
 #include "error.h"
 #include "midi.h"
 #include "agb.h"
 
-FILE* g_inputFile = nullptr;
-FILE* g_outputFile = nullptr;
+thread_local FILE* g_inputFile = nullptr;
 
-std::string g_asmLabel;
-int g_masterVolume = 127;
-std::string g_voiceGroup = "_dummy";
-int g_priority = 0;
-int g_reverb = -1;
-int g_clocksPerBeat = 1;
-bool g_exactGateTime = false;
-bool g_compressionEnabled = true;
+thread_local std::string g_asmLabel;
+thread_local int g_masterVolume;
+thread_local std::string g_voiceGroup;
+thread_local int g_priority;
+thread_local int g_reverb;
+thread_local int g_clocksPerBeat;
+thread_local bool g_exactGateTime;
+thread_local bool g_compressionEnabled;
+thread_local bool g_findPatterns;
+thread_local bool g_printSize;
+
+// Batch mode (-C) options, which apply to the whole run.
+static std::string s_configFilename;
+static int s_jobs = 0;
+
+static void SetDefaultOptions()
+{
+    g_asmLabel.clear();
+    g_masterVolume = 127;
+    g_voiceGroup = "_dummy";
+    g_priority = 0;
+    g_reverb = -1;
+    g_clocksPerBeat = 1;
+    g_exactGateTime = false;
+    g_compressionEnabled = true;
+    g_findPatterns = false;
+    g_printSize = false;
+}
 
 [[noreturn]] static void PrintUsage()
 {
     std::printf(
         "Usage: MID2AGB name [options]\n"
+        "       MID2AGB -C midi.cfg [-J jobs] [options] [song...]\n"
         "\n"
         "    input_file  filename(.mid) of MIDI file\n"
         "   output_file  filename(.s) for AGB file (default:input_file)\n"
         "\n"
+        "  -C???  convert every song listed in a config file (or just the named\n"
+        "         ones), each with the options on its line, writing only the .s\n"
+        "         files that change\n"
+        "  -J???  number of songs to convert at once (default:all CPUs)\n"
+        "\n"
         "options  -L???  label for assembler (default:output_file)\n"
         "         -V???  master volume (default:127)\n"
         "         -G???  voice group label (default:_dummy)\n"
@@ -58,6 +89,8 @@ bool g_compressionEnabled = true;
         "            -X  48 clocks/beat (default:24 clocks/beat)\n"
         "            -E  exact gate-time\n"
         "            -N  no compression\n"
+        "            -O  search for repeated runs of bars to share through patterns\n"
+        "            -S  print the size of the song data\n"
     );
     std::exit(1);
 }
@@ -127,12 +160,12 @@ static const char *GetArgument(int argc, char **argv, int& index)
     }
 }
 
-int main(int argc, char** argv)
+// Applies the options in argv, collecting the other arguments in files.
+// With perSong set, the batch mode options are skipped over, since they
+// were already applied to the whole run.
+static void ParseArguments(int argc, char **argv, std::vector<std::string>& files, bool perSong)
 {
-    std::string inputFilename;
-    std::string outputFilename;
-
-    for (int i = 1; i < argc; i++)
+    for (int i = 0; i < argc; i++)
     {
         const char *option = argv[i];
 
@@ -142,6 +175,13 @@ int main(int argc, char** argv)
 
             switch (std::toupper(option[1]))
             {
+            case 'C':
+                arg = GetArgument(argc, argv, i);
+                if (arg == nullptr)
+                    PrintUsage();
+                if (!perSong)
+                    s_configFilename = arg;
+                break;
             case 'E':
                 g_exactGateTime = true;
                 break;
@@ -151,6 +191,13 @@ int main(int argc, char** argv)
                     PrintUsage();
                 g_voiceGroup = arg;
                 break;
+            case 'J':
+                arg = GetArgument(argc, argv, i);
+                if (arg == nullptr)
+                    PrintUsage();
+                if (!perSong)
+                    s_jobs = std::stoi(arg);
+                break;
             case 'L':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
@@ -160,6 +207,9 @@ int main(int argc, char** argv)
             case 'N':
                 g_compressionEnabled = false;
                 break;
+            case 'O':
+                g_findPatterns = true;
+                break;
             case 'P':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
@@ -172,6 +222,9 @@ int main(int argc, char** argv)
                     PrintUsage();
                 g_reverb = std::stoi(arg);
                 break;
+            case 'S':
+                g_printSize = true;
+                break;
             case 'V':
                 arg = GetArgument(argc, argv, i);
                 if (arg == nullptr)
@@ -187,27 +240,14 @@ int main(int argc, char** argv)
         }
         else
         {
-            if (inputFilename.empty())
-                inputFilename = argv[i];
-            else if (outputFilename.empty())
-                outputFilename = argv[i];
-            else
-                PrintUsage();
+            files.push_back(option);
         }
     }
+}
 
-    if (inputFilename.empty())
-        PrintUsage();
-
-    if (GetExtension(inputFilename) != "mid")
-        RaiseError("input filename extension is not \"mid\"");
-
-    if (outputFilename.empty())
-        outputFilename = StripExtension(inputFilename) + ".s";
-
-    if (GetExtension(outputFilename) != "s")
-        RaiseError("output filename extension is not \"s\"");
-
+// Converts a MIDI file with the current options and returns the assembly.
+static std::string ConvertSong(const std::string& inputFilename, const std::string& outputFilename)
+{
     if (g_asmLabel.empty())
         g_asmLabel = BaseName(outputFilename);
 
@@ -216,18 +256,183 @@ int main(int argc, char** argv)
     if (g_inputFile == nullptr)
         RaiseError("failed to open \"%s\" for reading", inputFilename.c_str());
 
-    g_outputFile = std::fopen(outputFilename.c_str(), "w");
-
-    if (g_outputFile == nullptr)
-        RaiseError("failed to open \"%s\" for writing", outputFilename.c_str());
-
     ReadMidiFileHeader();
     PrintAgbHeader();
     ReadMidiTracks();
     PrintAgbFooter();
 
     std::fclose(g_inputFile);
-    std::fclose(g_outputFile);
+    g_inputFile = nullptr;
+
+    if (g_printSize)
+        std::printf("%s: %d bytes\n", outputFilename.c_str(), g_agbByteCount);
+
+    return g_agbOutput;
+}
+
+static void WriteFile(const std::string& filename, const std::string& text)
+{
+    FILE *fp = std::fopen(filename.c_str(), "w");
+
+    if (fp == nullptr)
+        RaiseError("failed to open \"%s\" for writing", filename.c_str());
+
+    if (std::fwrite(text.data(), 1, text.size(), fp) != text.size() || std::fclose(fp) != 0)
+        RaiseError("failed to write \"%s\"", filename.c_str());
+}
+
+// Leaves the file untouched if it already holds text, so make doesn't
+// reassemble songs that didn't change.
+static void WriteFileIfChanged(const std::string& filename, const std::string& text)
+{
+    std::ifstream ifs(filename);
+
+    if (ifs.is_open())
+    {
+        std::stringstream oldText;
+        oldText << ifs.rdbuf();
+        if (oldText.str() == text)
+            return;
+    }
+
+    WriteFile(filename, text);
+}
+
+struct ConfigEntry
+{
+    std::string name;
+    std::vector<std::string> options;
+};
+
+// Reads lines of the form "name[.mid]: options", as in sound/songs/midi/midi.cfg.
+static std::vector<ConfigEntry> ReadConfig(const std::string& filename)
+{
+    std::ifstream ifs(filename);
+
+    if (!ifs.is_open())
+        RaiseError("failed to open \"%s\" for reading", filename.c_str());
+
+    std::vector<ConfigEntry> entries;
+    std::string line;
+
+    while (std::getline(ifs, line))
+    {
+        std::istringstream words(line);
+        ConfigEntry entry;
+
+        if (!(words >> entry.name))
+            continue;
+
+        if (entry.name.back() == ':')
+            entry.name.pop_back();
+
+        if (GetExtension(entry.name) == "mid")
+            entry.name = StripExtension(entry.name);
+
+        std::string option;
+        while (words >> option)
+            entry.options.push_back(option);
+
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+// Converts the named songs in the config file, or all of them if songs is
+// empty. Songs live next to it, and each is converted on whichever thread
+// is free with the command line options followed by the ones on its line.
+static int ConvertConfig(int argc, char **argv, const std::vector<std::string>& songs)
+{
+    std::string dir;
+    std::size_t slashPos = s_configFilename.find_last_of("/\\");
+
+    if (slashPos != std::string::npos)
+        dir = s_configFilename.substr(0, slashPos + 1);
+
+    std::vector<ConfigEntry> entries = ReadConfig(s_configFilename);
+
+    if (!songs.empty())
+    {
+        std::vector<ConfigEntry> selected;
+
+        for (const std::string& song : songs)
+        {
+            std::string name = BaseName(song);
+            auto it = std::find_if(entries.begin(), entries.end(), [&](const ConfigEntry& entry) { return entry.name == name; });
+
+            if (it == entries.end())
+                RaiseError("\"%s\" isn't listed in \"%s\"", name.c_str(), s_configFilename.c_str());
+
+            selected.push_back(*it);
+        }
+
+        entries = selected;
+    }
+    std::atomic<std::size_t> next(0);
+
+    auto worker = [&]() {
+        std::size_t i;
+        while ((i = next++) < entries.size())
+        {
+            std::vector<std::string> args(argv, argv + argc);
+            args.insert(args.end(), entries[i].options.begin(), entries[i].options.end());
+
+            std::vector<char *> argPointers;
+            for (std::string& arg : args)
+                argPointers.push_back(&arg[0]);
+
+            // The songs named on the command line come back as files.
+            std::vector<std::string> files;
+            SetDefaultOptions();
+            ParseArguments(argPointers.size(), argPointers.data(), files, true);
+
+            std::string inputFilename = dir + entries[i].name + ".mid";
+            std::string outputFilename = dir + entries[i].name + ".s";
+            g_errorFilename = inputFilename;
+            WriteFileIfChanged(outputFilename, ConvertSong(inputFilename, outputFilename));
+        }
+    };
+
+    std::size_t jobs = s_jobs > 0 ? s_jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, entries.size());
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < jobs; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> files;
+
+    SetDefaultOptions();
+    ParseArguments(argc - 1, argv + 1, files, false);
+
+    if (!s_configFilename.empty())
+        return ConvertConfig(argc - 1, argv + 1, files);
+
+    if (files.empty() || files.size() > 2)
+        PrintUsage();
+
+    std::string inputFilename = files[0];
+    std::string outputFilename = files.size() > 1 ? files[1] : "";
+
+    if (GetExtension(inputFilename) != "mid")
+        RaiseError("input filename extension is not \"mid\"");
+
+    if (outputFilename.empty())
+        outputFilename = StripExtension(inputFilename) + ".s";
+
+    if (GetExtension(outputFilename) != "s")
+        RaiseError("output filename extension is not \"s\"");
+
+    WriteFile(outputFilename, ConvertSong(inputFilename, outputFilename));
 
     return 0;
 }
@@ -23,7 +23,9 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <map>
 #include <memory>
+#include <numeric>
 #include "midi.h"
 #include "main.h"
 #include "error.h"
@@ -38,21 +40,21 @@ enum class MidiEventCategory
     Invalid,
 };
 
-MidiFormat g_midiFormat;
-std::int_fast32_t g_midiTrackCount;
-std::int16_t g_midiTimeDiv;
+thread_local MidiFormat g_midiFormat;
+thread_local std::int_fast32_t g_midiTrackCount;
+thread_local std::int16_t g_midiTimeDiv;
 
-int g_midiChan;
-std::int32_t g_initialWait;
+thread_local int g_midiChan;
+thread_local std::int32_t g_initialWait;
 
-static long s_trackDataStart;
-static std::vector<Event> s_seqEvents;
-static std::vector<Event> s_trackEvents;
-static std::int32_t s_absoluteTime;
-static int s_blockCount = 0;
-static int s_minNote;
-static int s_maxNote;
-static int s_runningStatus;
+static thread_local long s_trackDataStart;
+static thread_local std::vector<Event> s_seqEvents;
+static thread_local std::vector<Event> s_trackEvents;
+static thread_local std::int32_t s_absoluteTime;
+static thread_local int s_blockCount;
+static thread_local int s_minNote;
+static thread_local int s_maxNote;
+static thread_local int s_runningStatus;
 
 void Seek(long offset)
 {
@@ -146,6 +148,8 @@ void ReadMidiFileHeader()
         RaiseError("unsupported MIDI format (%u)", midiFormat);
 
     g_midiFormat = (MidiFormat)midiFormat;
+    s_seqEvents.clear();
+    s_blockCount = 0;
     g_midiTrackCount = ReadInt16();
     g_midiTimeDiv = ReadInt16();
 
@@ -773,7 +777,17 @@ void CalculateWaits(std::vector<Event>& events)
     }
 }
 
-int CalculateCompressionScore(std::vector<Event>& events, int index)
+int NextPatternBoundary(std::vector<Event>& events, int index)
+{
+    do
+    {
+        index++;
+    } while (!IsPatternBoundary(events[index].type));
+
+    return index;
+}
+
+int CalculateCompressionScore(std::vector<Event>& events, int index, int end)
 {
     int score = 0;
     std::uint8_t lastParam1 = events[index].param1;
@@ -785,7 +799,7 @@ int CalculateCompressionScore(std::vector<Event>& events, int index)
     if (events[index].time > 0)
         score++;
 
-    for (int i = index + 1; !IsPatternBoundary(events[i].type); i++)
+    for (int i = index + 1; i < end; i++)
     {
         if (events[i].type == EventType::Note)
         {
@@ -906,13 +920,218 @@ void Compress(std::vector<Event>& events)
                 return;
         }
 
-        if (CalculateCompressionScore(events, i) >= 6)
+        if (CalculateCompressionScore(events, i, NextPatternBoundary(events, i)) >= 6)
         {
             CompressWholeNote(events, i);
         }
     }
 }
 
+// A stretch of a track between two pattern boundaries, as seen by the
+// pattern search (-O). Patterns are runs of segments that start at a whole
+// note mark; Compress only makes patterns of single segments.
+struct Segment
+{
+    int start;  // index of the WholeNoteMark or EndOfTie that starts it
+    int end;    // index of the next pattern boundary
+    int score;  // estimated size in bytes
+};
+
+// The printer keeps state for these controllers, which it wouldn't see if
+// they were skipped over by a PATT.
+bool CanMoveToPattern(const Event& event)
+{
+    if (event.type != EventType::Controller)
+        return true;
+
+    switch (event.param1)
+    {
+    case 0x0C:
+    case 0x0D:
+    case 0x0E:
+    case 0x0F:
+    case 0x10:
+    case 0x11:
+    case 0x1D:
+    case 0x1E:
+    case 0x1F:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Bytes a PATT costs: the command, its pointer and the operation name that
+// has to be repeated after it returns.
+const int kPatternCallSize = 6;
+
+struct Repeat
+{
+    int length = 0;
+    int savings = 0;
+    std::vector<int> positions;
+};
+
+// Finds the repeated run of tokens that saves the most bytes when every
+// occurrence after the first becomes a PATT. Equal runs are adjacent in the
+// suffix array, so each run of length len that occurs more than once is a
+// group of consecutive suffixes whose common prefix is at least len.
+Repeat FindBestRepeat(const std::vector<int>& tokens, const std::vector<bool>& canStart, const std::vector<int>& scoreSums)
+{
+    int n = tokens.size();
+    std::vector<int> suffixes(n);
+    std::iota(suffixes.begin(), suffixes.end(), 0);
+    std::sort(suffixes.begin(), suffixes.end(), [&](int a, int b) {
+        return std::lexicographical_compare(tokens.begin() + a, tokens.end(), tokens.begin() + b, tokens.end());
+    });
+
+    std::vector<int> lcp(n, 0);
+    int maxLcp = 0;
+
+    for (int i = 1; i < n; i++)
+    {
+        int a = suffixes[i - 1];
+        int b = suffixes[i];
+        while (a + lcp[i] < n && b + lcp[i] < n && tokens[a + lcp[i]] == tokens[b + lcp[i]])
+            lcp[i]++;
+        maxLcp = std::max(maxLcp, lcp[i]);
+    }
+
+    Repeat best;
+    std::vector<int> positions;
+
+    for (int len = 1; len <= maxLcp; len++)
+    {
+        for (int lo = 0; lo < n; )
+        {
+            int hi = lo + 1;
+            while (hi < n && lcp[hi] >= len)
+                hi++;
+
+            // Keep the occurrences that don't overlap an earlier one, if they
+            // start with a segment that can hold a label or PATT (the suffixes
+            // of a group all start with the same token).
+            positions.clear();
+
+            if (hi - lo >= 2 && canStart[suffixes[lo]])
+            {
+                positions.assign(suffixes.begin() + lo, suffixes.begin() + hi);
+                std::sort(positions.begin(), positions.end());
+
+                int kept = 0;
+                for (int pos : positions)
+                    if (kept == 0 || pos >= positions[kept - 1] + len)
+                        positions[kept++] = pos;
+                positions.resize(kept);
+            }
+
+            if (positions.size() >= 2)
+            {
+                int size = scoreSums[positions[0] + len] - scoreSums[positions[0]];
+                int savings = (positions.size() - 1) * (size - kPatternCallSize) - 1; // 1 for PEND
+
+                if (savings > best.savings)
+                {
+                    best.length = len;
+                    best.savings = savings;
+                    best.positions = positions;
+                }
+            }
+
+            lo = hi;
+        }
+    }
+
+    return best;
+}
+
+void FindPatterns(std::vector<Event>& events)
+{
+    std::vector<Segment> segments;
+    std::map<std::vector<std::int32_t>, int> segmentIds;
+    std::vector<std::int32_t> key;
+
+    // Each segment becomes a token, equal for segments with equal events.
+    // Segments that can't be put in a pattern, and breaks between segments
+    // that don't follow one another directly, get unique negative tokens so
+    // no repeat spans them.
+    std::vector<int> tokens;
+    std::vector<int> tokenSegments;
+    std::vector<bool> canStart;
+    int nextSeparator = -1;
+
+    for (int i = 0; events[i].type != EventType::EndOfTrack; i++)
+    {
+        if (events[i].type != EventType::WholeNoteMark && events[i].type != EventType::EndOfTie)
+            continue;
+
+        Segment segment;
+        segment.start = i;
+        segment.end = NextPatternBoundary(events, i);
+        segment.score = CalculateCompressionScore(events, segment.start, segment.end);
+
+        // A whole note mark's own number doesn't count.
+        key.clear();
+        bool movable = true;
+
+        for (int j = segment.start; j < segment.end; j++)
+        {
+            const Event& event = events[j];
+            bool isMark = (j == segment.start && event.type == EventType::WholeNoteMark);
+            key.insert(key.end(), { event.time, (std::int32_t)event.type, event.note, event.param1, isMark ? 0 : event.param2 });
+            movable = movable && CanMoveToPattern(event);
+        }
+
+        if (!segments.empty() && segments.back().end != segment.start)
+        {
+            tokens.push_back(nextSeparator--);
+            tokenSegments.push_back(-1);
+            canStart.push_back(false);
+        }
+
+        if (movable)
+            tokens.push_back(segmentIds.emplace(key, segmentIds.size()).first->second);
+        else
+            tokens.push_back(nextSeparator--);
+
+        tokenSegments.push_back(segments.size());
+        canStart.push_back(events[i].type == EventType::WholeNoteMark);
+        segments.push_back(segment);
+        i = segment.end - 1;
+    }
+
+    std::vector<int> scoreSums(tokens.size() + 1, 0);
+
+    for (std::size_t i = 0; i < tokens.size(); i++)
+        scoreSums[i + 1] = scoreSums[i] + (tokenSegments[i] >= 0 ? segments[tokenSegments[i]].score : 0);
+
+    for (;;)
+    {
+        Repeat repeat = FindBestRepeat(tokens, canStart, scoreSums);
+
+        if (repeat.savings <= 0)
+            break;
+
+        // The first occurrence stays in place as the pattern's body.
+        Event& body = events[segments[tokenSegments[repeat.positions[0]]].start];
+        body.param1 = repeat.length;
+        body.param2 |= 0x80000000;
+
+        for (std::size_t i = 1; i < repeat.positions.size(); i++)
+        {
+            Event& call = events[segments[tokenSegments[repeat.positions[i]]].start];
+            call.type = EventType::Pattern;
+            call.param1 = repeat.length;
+            call.param2 = body.param2 & 0x7FFFFFFF;
+        }
+
+        // Patterns don't nest, so no segment can be used again.
+        for (int pos : repeat.positions)
+            for (int j = 0; j < repeat.length; j++)
+                tokens[pos + j] = nextSeparator--;
+    }
+}
+
 void ReadMidiTracks()
 {
     long trackHeaderStart = 14;
@@ -952,8 +1171,21 @@ void ReadMidiTracks()
                 events = SplitTime(*events);
                 CalculateWaits(*events);
 
-                if (g_compressionEnabled)
+                if (g_compressionEnabled && g_findPatterns)
+                {
+                    // The search's size estimates are rough, so keep the
+                    // whole note patterns if they turn out smaller.
+                    std::unique_ptr<std::vector<Event>> wholeNoteEvents(new std::vector<Event>(*events));
+                    Compress(*wholeNoteEvents);
+                    FindPatterns(*events);
+
+                    if (MeasureAgbTrack(*wholeNoteEvents) < MeasureAgbTrack(*events))
+                        events = std::move(wholeNoteEvents);
+                }
+                else if (g_compressionEnabled)
+                {
                     Compress(*events);
+                }
 
                 PrintAgbTrack(*events);
 
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Reports how many bytes of ROM mid2agb's pattern search (-O) saves on each
+# song in sound/songs/midi, converted with its midi.cfg options. Run from the
+# repository root after building mid2agb. Usage: pattern_report.sh
+
+MID2AGB=${MID2AGB:-tools/mid2agb/mid2agb}
+MIDI_DIR=sound/songs/midi
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+mkdir -p "$TMP/plain" "$TMP/patterns"
+
+while read -r mid flags; do
+    # Entries may omit the .mid extension.
+    name=${mid%:}
+    name=${name%.mid}
+    # shellcheck disable=SC2086
+    plain=$("$MID2AGB" "$MIDI_DIR/$name.mid" "$TMP/plain/$name.s" $flags -S) || exit 1
+    # shellcheck disable=SC2086
+    patterns=$("$MID2AGB" "$MIDI_DIR/$name.mid" "$TMP/patterns/$name.s" $flags -O -S) || exit 1
+    echo "$name ${plain##*: } ${patterns##*: }"
+done < "$MIDI_DIR/midi.cfg" | awk '
+{
+    saved = $2 - $4
+    printf "%s: %d -> %d bytes (%d saved)\n", $1, $2, $4, saved
+    before += $2
+    after += $4
+}
+END {
+    if (before > 0)
+        printf "total: %d -> %d bytes (%d saved, %.1f%%)\n", before, after, before - after, 100 * (before - after) / before
+}'
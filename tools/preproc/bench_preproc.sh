@@ -0,0 +1,25 @@
+#!/bin/sh
+# Reports preproc's throughput (MB/s of preprocessed C input) on the largest
+# files under src/. Run from the repository root after a build, so that the
+# INCGFX assets exist. Usage: bench_preproc.sh [COUNT]
+
+COUNT=${1:-10}
+CPP=${CPP:-cpp}
+ASSETS=${ASSETS:-build/assets}
+PREPROC=tools/preproc/preproc
+TMP=$(mktemp)
+trap 'rm -f "$TMP"' EXIT
+
+for src in $(ls -S src/*.c | head -n "$COUNT"); do
+    $CPP -iquote include -I tools/agbcc/include -Wno-trigraphs -DMODERN=0 -std=gnu89 "$src" -o "$TMP" || exit 1
+    $PREPROC -t -i -g "$ASSETS" "$src" charmap.txt < "$TMP" 2>&1 >/dev/null | grep 'processed' || exit 1
+done | awk '
+{
+    print
+    bytes += $3
+    us += $(NF - 3)
+}
+END {
+    if (us > 0)
+        printf "total: %d bytes in %d us (%.1f MB/s)\n", bytes, us, bytes / us
+}'
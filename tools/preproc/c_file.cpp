@@ -33,6 +33,66 @@
 #include "string_parser.h"
 #include "io.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A small set of characters that the scanner stops at. Find uses SSE2 to
+// test 16 bytes at a time when it is available.
+class ScanSet
+{
+public:
+    explicit ScanSet(const char* stops)
+    {
+        std::memset(m_isStop, 0, sizeof(m_isStop));
+        m_count = 0;
+
+        for (; *stops != 0 && m_count < kMaxStops; stops++)
+        {
+            m_isStop[(unsigned char)*stops] = true;
+#ifdef __SSE2__
+            m_vectors[m_count] = _mm_set1_epi8(*stops);
+#endif
+            m_count++;
+        }
+    }
+
+    // Returns the position of the first stop character in [pos, end), or end.
+    long Find(const char* buffer, long pos, long end) const
+    {
+#if defined(__SSE2__) && defined(__GNUC__)
+        while (end - pos >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)(buffer + pos));
+            __m128i hits = _mm_cmpeq_epi8(chunk, m_vectors[0]);
+
+            for (int i = 1; i < m_count; i++)
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, m_vectors[i]));
+
+            int mask = _mm_movemask_epi8(hits);
+
+            if (mask != 0)
+                return pos + __builtin_ctz(mask);
+
+            pos += 16;
+        }
+#endif
+        while (pos < end && !m_isStop[(unsigned char)buffer[pos]])
+            pos++;
+
+        return pos;
+    }
+
+private:
+    static const int kMaxStops = 8;
+
+    bool m_isStop[256];
+    int m_count;
+#ifdef __SSE2__
+    __m128i m_vectors[kMaxStops];
+#endif
+};
+
 CFile::CFile(const char * filenameCStr, bool isStdin, const char * graphicsRootCStr)
 {
     if (isStdin)
@@ -66,114 +126,151 @@ CFile::~CFile()
     free(m_buffer);
 }
 
+void CFile::FlushOutput()
+{
+    std::fwrite(m_output.data(), 1, m_output.size(), stdout);
+    m_output.clear();
+}
+
 void CFile::Preproc()
 {
+    // Characters that can change state or start a conversion. Everything
+    // between them is copied to the output unchanged, so the scanner jumps
+    // straight from one to the next.
+    static const ScanSet codeStops("_I\"'\n");
+    static const ScanSet doubleQuotedStops("\"\\\n");
+    static const ScanSet singleQuotedStops("'\\\n");
+
     char stringChar = 0;
 
     while (m_pos < m_size)
     {
-        if (m_location.acceptLineMarker)
+        // Line markers are only recognized at the start of a line, which the
+        // per-character path below handles.
+        if (!m_location.acceptLineMarker)
         {
-            if (m_buffer[m_pos] == '#')
-            {
-                long hashPos = m_pos;
+            const ScanSet& stops = stringChar == 0 ? codeStops
+                : stringChar == '"' ? doubleQuotedStops : singleQuotedStops;
+            long end = stops.Find(m_buffer, m_pos, m_size);
 
-                long startPos;
-                long lineNum;
-                std::string filename;
+            Emit(&m_buffer[m_pos], end - m_pos);
+            m_pos = end;
 
-                m_pos++;
+            if (m_pos >= m_size)
+                break;
+        }
 
-                if (m_buffer[m_pos] != ' ')
-                    goto linemarker_error;
-                m_pos++;
+        PreprocChar(stringChar);
+    }
 
-                startPos = m_pos;
-                if (!IsAsciiDigit(m_buffer[m_pos]))
-                    goto linemarker_error;
-                do
-                    m_pos++;
-                while (IsAsciiDigit(m_buffer[m_pos]));
-                lineNum = atol(&m_buffer[startPos]);
+    FlushOutput();
+}
 
-                if (m_buffer[m_pos] != ' ')
-                    goto linemarker_error;
-                m_pos++;
+// Processes the character at m_pos, which may start a line marker, a
+// conversion, or the end of a string or character literal.
+void CFile::PreprocChar(char& stringChar)
+{
+    if (m_location.acceptLineMarker)
+    {
+        if (m_buffer[m_pos] == '#')
+        {
+            long hashPos = m_pos;
+
+            long startPos;
+            long lineNum;
+            std::string filename;
+
+            m_pos++;
+
+            if (m_buffer[m_pos] != ' ')
+                goto linemarker_error;
+            m_pos++;
 
-                if (m_buffer[m_pos] != '"')
-                    goto linemarker_error;
+            startPos = m_pos;
+            if (!IsAsciiDigit(m_buffer[m_pos]))
+                goto linemarker_error;
+            do
                 m_pos++;
+            while (IsAsciiDigit(m_buffer[m_pos]));
+            lineNum = atol(&m_buffer[startPos]);
 
-                startPos = m_pos;
-                while (m_pos < m_size && m_buffer[m_pos] != '"')
-                    m_pos++;
-                filename = std::string(&m_buffer[startPos], m_pos - startPos);
+            if (m_buffer[m_pos] != ' ')
+                goto linemarker_error;
+            m_pos++;
+
+            if (m_buffer[m_pos] != '"')
+                goto linemarker_error;
+            m_pos++;
 
-                if (m_buffer[m_pos] != '"')
-                    goto linemarker_error;
+            startPos = m_pos;
+            while (m_pos < m_size && m_buffer[m_pos] != '"')
                 m_pos++;
+            filename = std::string(&m_buffer[startPos], m_pos - startPos);
+
+            if (m_buffer[m_pos] != '"')
+                goto linemarker_error;
+            m_pos++;
 
-                while (m_pos < m_size && m_buffer[m_pos] != '\n')
-                    m_pos++;
-                if (m_buffer[m_pos] != '\n')
-                    goto linemarker_error;
+            while (m_pos < m_size && m_buffer[m_pos] != '\n')
                 m_pos++;
+            if (m_buffer[m_pos] != '\n')
+                goto linemarker_error;
+            m_pos++;
 
-                m_location.lineNum = lineNum - 1;
-                m_location.filename = std::move(filename);
+            m_location.lineNum = lineNum - 1;
+            m_location.filename = std::move(filename);
 linemarker_error:
-                m_location.acceptLineMarker = false;
-                // Re-parse this line so that it's available to cc1.
-                m_pos = hashPos;
-            }
-            else if (!IsAsciiWhitespace(m_buffer[m_pos]))
-            {
-                m_location.acceptLineMarker = false;
-            }
+            m_location.acceptLineMarker = false;
+            // Re-parse this line so that it's available to cc1.
+            m_pos = hashPos;
+        }
+        else if (!IsAsciiWhitespace(m_buffer[m_pos]))
+        {
+            m_location.acceptLineMarker = false;
         }
+    }
 
-        if (stringChar)
+    if (stringChar)
+    {
+        if (m_buffer[m_pos] == stringChar)
         {
-            if (m_buffer[m_pos] == stringChar)
-            {
-                std::putchar(stringChar);
-                m_pos++;
-                stringChar = 0;
-            }
-            else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
-            {
-                std::putchar('\\');
-                std::putchar(stringChar);
-                m_pos += 2;
-            }
-            else
-            {
-                if (m_buffer[m_pos] == '\n')
-                    Newline();
-                std::putchar(m_buffer[m_pos]);
-                m_pos++;
-            }
+            Emit(stringChar);
+            m_pos++;
+            stringChar = 0;
+        }
+        else if (m_buffer[m_pos] == '\\' && m_buffer[m_pos + 1] == stringChar)
+        {
+            Emit('\\');
+            Emit(stringChar);
+            m_pos += 2;
         }
         else
         {
-            TryConvertString();
-            TryConvertIncbin();
-            TryConvertIncgfx();
+            if (m_buffer[m_pos] == '\n')
+                Newline();
+            Emit(m_buffer[m_pos]);
+            m_pos++;
+        }
+    }
+    else
+    {
+        TryConvertString();
+        TryConvertIncbin();
+        TryConvertIncgfx();
 
-            if (m_pos >= m_size)
-                break;
+        if (m_pos >= m_size)
+            return;
 
-            char c = m_buffer[m_pos++];
+        char c = m_buffer[m_pos++];
 
-            std::putchar(c);
+        Emit(c);
 
-            if (c == '\n')
-                Newline();
-            else if (c == '"')
-                stringChar = '"';
-            else if (c == '\'')
-                stringChar = '\'';
-        }
+        if (c == '\n')
+            Newline();
+        else if (c == '"')
+            stringChar = '"';
+        else if (c == '\'')
+            stringChar = '\'';
     }
 }
 
@@ -194,7 +291,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos += 2;
         Newline();
-        std::putchar('\n');
+        Emit('\n');
         return true;
     }
 
@@ -202,7 +299,7 @@ bool CFile::ConsumeNewline()
     {
         m_pos++;
         Newline();
-        std::putchar('\n');
+        Emit('\n');
         return true;
     }
 
@@ -223,13 +320,13 @@ void CFile::SkipWhitespace()
 
 void CFile::TryConvertString()
 {
+    if (m_buffer[m_pos] != '_' || (m_pos > 0 && IsIdentifierChar(m_buffer[m_pos - 1])))
+        return;
+
     long oldPos = m_pos;
     auto oldLocation = m_location;
     bool noTerminator = false;
 
-    if (m_buffer[m_pos] != '_' || (m_pos > 0 && IsIdentifierChar(m_buffer[m_pos - 1])))
-        return;
-
     m_pos++;
 
     if (m_buffer[m_pos] == '_')
@@ -251,7 +348,7 @@ void CFile::TryConvertString()
 
     SkipWhitespace();
 
-    std::printf("{ ");
+    Emit("{ ", 2);
 
     while (1)
     {
@@ -273,7 +370,11 @@ void CFile::TryConvertString()
             }
 
             for (int i = 0; i < length; i++)
-                printf("0x%02X, ", s[i]);
+            {
+                static const char hexDigits[] = "0123456789ABCDEF";
+                char text[] = { '0', 'x', hexDigits[s[i] >> 4], hexDigits[s[i] & 0xF], ',', ' ' };
+                Emit(text, sizeof(text));
+            }
         }
         else if (m_buffer[m_pos] == ')')
         {
@@ -292,9 +393,9 @@ void CFile::TryConvertString()
     }
 
     if (noTerminator)
-        std::printf(" }");
+        Emit(" }", 2);
     else
-        std::printf("0xFF }");
+        Emit("0xFF }", 6);
 }
 
 bool CFile::CheckIdentifier(const std::string& ident)
@@ -362,27 +463,131 @@ std::unique_ptr<unsigned char[]> CFile::ReadWholeFile(const std::string& path, i
     return buffer;
 }
 
-int ExtractData(const std::unique_ptr<unsigned char[]>& buffer, int offset, int size)
+static const char s_digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Writes exactly four digits of v (< 10000), keeping leading zeros.
+static inline char* FormatFourDigits(char* out, std::uint32_t v)
+{
+    std::memcpy(out, s_digitPairs + (v / 100) * 2, 2);
+    std::memcpy(out + 2, s_digitPairs + (v % 100) * 2, 2);
+    return out + 4;
+}
+
+// Writes v (< 10000) without leading zeros.
+static inline char* FormatUpToFourDigits(char* out, std::uint32_t v)
 {
-    switch (size)
+    if (v >= 1000)
+        return FormatFourDigits(out, v);
+
+    if (v >= 100)
+    {
+        *out++ = '0' + v / 100;
+        v %= 100;
+    }
+    else if (v < 10)
     {
-    case 1:
-        return buffer[offset];
-    case 2:
-        return (buffer[offset + 1] << 8)
-            | buffer[offset];
-    case 4:
-        return (buffer[offset + 3] << 24)
-            | (buffer[offset + 2] << 16)
-            | (buffer[offset + 1] << 8)
-            | buffer[offset];
-    default:
-        FATAL_ERROR("Invalid size passed to ExtractData.\n");
+        *out++ = '0' + v;
+        return out;
     }
+
+    std::memcpy(out, s_digitPairs + v * 2, 2);
+    return out + 2;
+}
+
+// Writes "<decimal>u," for value at out and returns the end of the text.
+// Splitting into groups of four digits keeps the number of data-dependent
+// branches small, which matters for the near-random values in tile data.
+static inline char* FormatIncbinValue(char* out, std::uint32_t value)
+{
+    if (value >= 100000000)
+    {
+        out = FormatUpToFourDigits(out, value / 100000000);
+        value %= 100000000;
+        out = FormatFourDigits(out, value / 10000);
+        out = FormatFourDigits(out, value % 10000);
+    }
+    else if (value >= 10000)
+    {
+        out = FormatUpToFourDigits(out, value / 10000);
+        out = FormatFourDigits(out, value % 10000);
+    }
+    else
+    {
+        out = FormatUpToFourDigits(out, value);
+    }
+
+    *out++ = 'u';
+    *out++ = ',';
+    return out;
+}
+
+// Writes each little-endian value in data as "<decimal>u," -- the same text
+// std::printf("%uu,") produced -- formatting into a fixed chunk that is
+// passed to Emit in one piece. Large INCGFXs expand to millions of values,
+// so printf's per-call parsing and locking used to dominate preproc's runtime.
+void CFile::EmitIncbinData(const unsigned char* data, int count, int size)
+{
+    // Preformatted text for every byte value, padded to 8 chars so it can be
+    // copied without a variable-length memcpy. The last char is the length.
+    static char s_byteText[256][8];
+    static bool s_byteTextReady = false;
+
+    if (!s_byteTextReady)
+    {
+        for (int i = 0; i < 256; i++)
+            s_byteText[i][7] = FormatIncbinValue(s_byteText[i], i) - s_byteText[i];
+        s_byteTextReady = true;
+    }
+
+    // Longest entry is "4294967295u," (12 chars).
+    const int maxEntryLength = 12;
+    char chunk[1 << 16];
+    char* out = chunk;
+    char* const end = chunk + sizeof(chunk) - maxEntryLength;
+
+    for (int i = 0; i < count; i++, data += size)
+    {
+        switch (size)
+        {
+        case 1:
+            std::memcpy(out, s_byteText[data[0]], 8);
+            out += s_byteText[data[0]][7];
+            break;
+        case 2:
+            out = FormatIncbinValue(out, data[0] | (data[1] << 8));
+            break;
+        case 4:
+            out = FormatIncbinValue(out, data[0] | (data[1] << 8) | (data[2] << 16) | ((std::uint32_t)data[3] << 24));
+            break;
+        default:
+            FATAL_ERROR("Invalid size passed to EmitIncbinData.\n");
+        }
+
+        if (out >= end)
+        {
+            Emit(chunk, out - chunk);
+            out = chunk;
+        }
+    }
+
+    Emit(chunk, out - chunk);
 }
 
 void CFile::TryConvertIncbin()
 {
+    if (m_buffer[m_pos] != 'I')
+        return;
+
     std::string idents[3] = { "INCBIN_U8", "INCBIN_U16", "INCBIN_U32" };
     int incbinType = -1;
 
@@ -416,7 +621,7 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("{");
+    Emit('{');
 
     while (true)
     {
@@ -429,15 +634,7 @@ void CFile::TryConvertIncbin()
         if ((fileSize % size) != 0)
             RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
 
-        int count = fileSize / size;
-        int offset = 0;
-
-        for (int i = 0; i < count; i++)
-        {
-            int data = ExtractData(buffer, offset, size);
-            offset += size;
-            std::printf("%uu,", data);
-        }
+        EmitIncbinData(buffer.get(), fileSize / size, size);
 
         SkipWhitespace();
 
@@ -452,11 +649,14 @@ void CFile::TryConvertIncbin()
 
     m_pos++;
 
-    std::printf("}");
+    Emit('}');
 }
 
 void CFile::TryConvertIncgfx()
 {
+    if (m_buffer[m_pos] != 'I')
+        return;
+
     if (!CheckIdentifier("INCGFX_"))
         return;
 
@@ -543,18 +743,11 @@ void CFile::TryConvertIncgfx()
     if ((fileSize % size) != 0)
         RaiseError("Size %d doesn't evenly divide file size %d.\n", size, fileSize);
 
-    std::printf("{");
+    Emit('{');
 
-    int count = fileSize / size;
-    int offset = 0;
-    for (int i = 0; i < count; i++)
-    {
-        int data = ExtractData(buffer, offset, size);
-        offset += size;
-        std::printf("%uu,", data);
-    }
+    EmitIncbinData(buffer.get(), fileSize / size, size);
 
-    std::printf("}");
+    Emit('}');
 }
 
 // Reports a diagnostic message.
@@ -578,6 +771,7 @@ do                                        \
 // Reports an error diagnostic and terminates the program.
 void CFile::RaiseError(const char* format, ...)
 {
+    FlushOutput();
     DO_REPORT("error");
     std::exit(1);
 }
@@ -35,6 +35,7 @@ public:
     CFile(const CFile&) = delete;
     ~CFile();
     void Preproc();
+    long InputSize() const { return m_size; }
 
 private:
     char* m_buffer;
@@ -47,6 +48,27 @@ private:
     } m_location;
     bool m_isStdin;
     std::string m_graphicsRoot;
+    std::string m_output;
+
+    // Output is collected here and written in large blocks rather than one
+    // character at a time.
+    static const std::size_t kOutputFlushSize = 1 << 20;
+
+    void Emit(char c)
+    {
+        m_output += c;
+    }
+
+    void Emit(const char* s, long length)
+    {
+        m_output.append(s, length);
+
+        if (m_output.size() >= kOutputFlushSize)
+            FlushOutput();
+    }
+
+    void FlushOutput();
+    void PreprocChar(char& stringChar);
 
     bool ConsumeHorizontalWhitespace();
     bool ConsumeNewline();
@@ -58,6 +80,7 @@ private:
     std::string ReadString();
     void TryConvertIncbin();
     void TryConvertIncgfx();
+    void EmitIncbinData(const unsigned char* data, int count, int size);
     void ReportDiagnostic(const char* type, const char* format, std::va_list args);
     void RaiseError(const char* format, ...);
     void RaiseWarning(const char* format, ...);
@@ -21,6 +21,18 @@
 #include <cstdio>
 #include <cstdint>
 #include <cstdarg>
+#include <cstring>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
 #include "preproc.h"
 #include "charmap.h"
 #include "char_util.h"
@@ -369,16 +381,149 @@ void CharmapReader::SkipWhitespace()
         m_pos++;
 }
 
-Charmap::Charmap(std::string filename)
+// Compiled charmap layout. Everything is in host byte order; the file is a
+// local build artifact and is rebuilt whenever it doesn't match the source.
+//
+//   CompiledCharmapHeader
+//   CompiledCharmapCharSlot[charSlotCount]          (code -1 marks an empty slot)
+//   CompiledCharmapConstantSlot[constantSlotCount]  (nameLength 0 marks an empty slot)
+//   CompiledCharmapSequence[128]                    (escapes, indexed by code)
+//   string pool
+//
+// Both hash tables use linear probing and are at most half full.
+
+static const char kCompiledCharmapMagic[8] = { 'P', 'P', 'C', 'H', 'M', 'A', 'P', 0 };
+static const std::uint32_t kCompiledCharmapVersion = 1;
+static const std::uint32_t kCompiledCharmapByteOrderMark = 0x01020304;
+
+struct CharmapSourceInfo
+{
+    std::uint64_t size;
+    std::int64_t mtimeSec;
+    std::int64_t mtimeNsec;
+};
+
+struct CompiledCharmapHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::uint64_t sourceSize;
+    std::int64_t sourceMtimeSec;
+    std::int64_t sourceMtimeNsec;
+    std::uint32_t totalSize;
+    std::uint32_t charSlotCount;
+    std::uint32_t constantSlotCount;
+    std::uint32_t charTableOffset;
+    std::uint32_t constantTableOffset;
+    std::uint32_t escapeTableOffset;
+    std::uint32_t poolOffset;
+};
+
+struct CompiledCharmapSequence
+{
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+struct CompiledCharmapCharSlot
+{
+    std::int32_t code;
+    CompiledCharmapSequence sequence;
+};
+
+struct CompiledCharmapConstantSlot
+{
+    std::uint32_t hash;
+    std::uint32_t nameOffset;
+    std::uint32_t nameLength;
+    CompiledCharmapSequence sequence;
+};
+
+static std::uint32_t HashCode(std::int32_t code)
+{
+    std::uint32_t hash = (std::uint32_t)code * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+static std::uint32_t HashName(const char* name, std::size_t length)
+{
+    std::uint32_t hash = 2166136261u;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static std::uint32_t SlotCountFor(std::size_t entries)
+{
+    std::uint32_t count = 1;
+
+    while (count < entries * 2)
+        count *= 2;
+
+    return count;
+}
+
+static bool GetSourceInfo(const std::string& filename, CharmapSourceInfo& info)
+{
+    struct stat st;
+
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    info.size = st.st_size;
+    info.mtimeSec = st.st_mtime;
+#if defined(__APPLE__)
+    info.mtimeNsec = st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    info.mtimeNsec = 0;
+#else
+    info.mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+Charmap::Charmap(std::string filename, std::string compiledFilename)
+    : m_data(nullptr), m_size(0), m_mappedData(nullptr)
+{
+    CharmapSourceInfo source;
+    bool useCompiled = !compiledFilename.empty() && GetSourceInfo(filename, source);
+
+    if (useCompiled && TryLoadCompiled(compiledFilename, source))
+        return;
+
+    Parse(filename);
+
+    if (useCompiled)
+        WriteCompiled(compiledFilename, source);
+}
+
+Charmap::~Charmap()
+{
+#ifndef _WIN32
+    if (m_mappedData != nullptr)
+        munmap(m_mappedData, m_size);
+#endif
+}
+
+void Charmap::Parse(std::string filename)
 {
     CharmapReader reader(filename);
+    std::map<std::int32_t, std::string> chars;
+    std::string escapes[128];
+    std::map<std::string, std::string> constants;
 
     for (;;)
     {
         Lhs lhs = reader.ReadLhs();
 
         if (lhs.type == LhsType::None)
-            return;
+            break;
 
         reader.ExpectEqualsSign();
 
@@ -387,22 +532,277 @@ Charmap::Charmap(std::string filename)
         switch (lhs.type)
         {
         case LhsType::Char:
-            if (m_chars.find(lhs.code) != m_chars.end())
+            if (chars.find(lhs.code) != chars.end())
                 reader.RaiseError("redefining char");
-            m_chars[lhs.code] = sequence;
+            chars[lhs.code] = sequence;
             break;
         case LhsType::Escape:
-            if (m_escapes[lhs.code].length() != 0)
+            if (escapes[lhs.code].length() != 0)
                 reader.RaiseError("redefining escape");
-            m_escapes[lhs.code] = sequence;
+            escapes[lhs.code] = sequence;
             break;
         case LhsType::Constant:
-            if (m_constants.find(lhs.name) != m_constants.end())
+            if (constants.find(lhs.name) != constants.end())
                 reader.RaiseError("redefining constant");
-            m_constants[lhs.name] = sequence;
+            constants[lhs.name] = sequence;
             break;
         }
 
         reader.ExpectEmptyRestOfLine();
     }
+
+    // Flatten the maps into the compiled layout.
+    std::uint32_t charSlotCount = SlotCountFor(chars.size());
+    std::uint32_t constantSlotCount = SlotCountFor(constants.size());
+
+    std::vector<CompiledCharmapCharSlot> charSlots(charSlotCount);
+    std::vector<CompiledCharmapConstantSlot> constantSlots(constantSlotCount);
+    CompiledCharmapSequence escapeTable[128];
+    std::string pool;
+
+    auto addToPool = [&pool](const std::string& str) {
+        CompiledCharmapSequence entry = { (std::uint32_t)pool.size(), (std::uint32_t)str.size() };
+        pool += str;
+        return entry;
+    };
+
+    for (auto& slot : charSlots)
+        slot = CompiledCharmapCharSlot{ -1, { 0, 0 } };
+
+    for (auto& slot : constantSlots)
+        slot = CompiledCharmapConstantSlot{ 0, 0, 0, { 0, 0 } };
+
+    for (const auto& entry : chars)
+    {
+        std::uint32_t i = HashCode(entry.first) & (charSlotCount - 1);
+
+        while (charSlots[i].code != -1)
+            i = (i + 1) & (charSlotCount - 1);
+
+        charSlots[i].code = entry.first;
+        charSlots[i].sequence = addToPool(entry.second);
+    }
+
+    for (const auto& entry : constants)
+    {
+        std::uint32_t hash = HashName(entry.first.data(), entry.first.size());
+        std::uint32_t i = hash & (constantSlotCount - 1);
+
+        while (constantSlots[i].nameLength != 0)
+            i = (i + 1) & (constantSlotCount - 1);
+
+        CompiledCharmapSequence name = addToPool(entry.first);
+        constantSlots[i].hash = hash;
+        constantSlots[i].nameOffset = name.offset;
+        constantSlots[i].nameLength = name.length;
+        constantSlots[i].sequence = addToPool(entry.second);
+    }
+
+    for (int i = 0; i < 128; i++)
+        escapeTable[i] = addToPool(escapes[i]);
+
+    CompiledCharmapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kCompiledCharmapMagic, sizeof(header.magic));
+    header.version = kCompiledCharmapVersion;
+    header.byteOrderMark = kCompiledCharmapByteOrderMark;
+    header.charSlotCount = charSlotCount;
+    header.constantSlotCount = constantSlotCount;
+    header.charTableOffset = sizeof(header);
+    header.constantTableOffset = header.charTableOffset + charSlotCount * sizeof(CompiledCharmapCharSlot);
+    header.escapeTableOffset = header.constantTableOffset + constantSlotCount * sizeof(CompiledCharmapConstantSlot);
+    header.poolOffset = header.escapeTableOffset + sizeof(escapeTable);
+    header.totalSize = header.poolOffset + pool.size();
+
+    m_ownedData.resize(header.totalSize);
+    unsigned char* data = m_ownedData.data();
+    std::memcpy(data, &header, sizeof(header));
+    std::memcpy(data + header.charTableOffset, charSlots.data(), charSlotCount * sizeof(CompiledCharmapCharSlot));
+    std::memcpy(data + header.constantTableOffset, constantSlots.data(), constantSlotCount * sizeof(CompiledCharmapConstantSlot));
+    std::memcpy(data + header.escapeTableOffset, escapeTable, sizeof(escapeTable));
+    std::memcpy(data + header.poolOffset, pool.data(), pool.size());
+
+    m_data = data;
+    m_size = m_ownedData.size();
+}
+
+bool Charmap::TryLoadCompiled(std::string compiledFilename, const CharmapSourceInfo& source)
+{
+    const unsigned char* data;
+    std::size_t size;
+
+#ifdef _WIN32
+    FILE* fp = std::fopen(compiledFilename.c_str(), "rb");
+
+    if (fp == nullptr)
+        return false;
+
+    std::fseek(fp, 0, SEEK_END);
+    long fileSize = std::ftell(fp);
+    std::rewind(fp);
+
+    if (fileSize < (long)sizeof(CompiledCharmapHeader))
+    {
+        std::fclose(fp);
+        return false;
+    }
+
+    m_ownedData.resize(fileSize);
+    bool readOk = std::fread(m_ownedData.data(), fileSize, 1, fp) == 1;
+    std::fclose(fp);
+
+    if (!readOk)
+        return false;
+
+    data = m_ownedData.data();
+    size = m_ownedData.size();
+#else
+    int fd = open(compiledFilename.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CompiledCharmapHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size = st.st_size;
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapped == MAP_FAILED)
+        return false;
+
+    data = (const unsigned char*)mapped;
+#endif
+
+    CompiledCharmapHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    bool valid = std::memcmp(header.magic, kCompiledCharmapMagic, sizeof(header.magic)) == 0
+        && header.version == kCompiledCharmapVersion
+        && header.byteOrderMark == kCompiledCharmapByteOrderMark
+        && header.sourceSize == source.size
+        && header.sourceMtimeSec == source.mtimeSec
+        && header.sourceMtimeNsec == source.mtimeNsec
+        && header.totalSize == size
+        && header.charSlotCount != 0 && (header.charSlotCount & (header.charSlotCount - 1)) == 0
+        && header.constantSlotCount != 0 && (header.constantSlotCount & (header.constantSlotCount - 1)) == 0
+        && header.charTableOffset == sizeof(header)
+        && header.constantTableOffset == header.charTableOffset + header.charSlotCount * sizeof(CompiledCharmapCharSlot)
+        && header.escapeTableOffset == header.constantTableOffset + header.constantSlotCount * sizeof(CompiledCharmapConstantSlot)
+        && header.poolOffset == header.escapeTableOffset + 128 * sizeof(CompiledCharmapSequence)
+        && header.poolOffset <= size;
+
+    if (!valid)
+    {
+#ifdef _WIN32
+        m_ownedData.clear();
+#else
+        munmap((void*)data, size);
+#endif
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+#ifndef _WIN32
+    m_mappedData = (void*)data;
+#endif
+    return true;
+}
+
+// Writes the compiled charmap next to its final path and renames it into
+// place, so parallel preproc runs never see a partially written file.
+// Failing to write it is not an error; the next run will just parse again.
+void Charmap::WriteCompiled(std::string compiledFilename, const CharmapSourceInfo& source)
+{
+    CompiledCharmapHeader header;
+    std::memcpy(&header, m_data, sizeof(header));
+    header.sourceSize = source.size;
+    header.sourceMtimeSec = source.mtimeSec;
+    header.sourceMtimeNsec = source.mtimeNsec;
+
+    std::string tempFilename = compiledFilename + ".tmp" + std::to_string(getpid());
+    FILE* fp = std::fopen(tempFilename.c_str(), "wb");
+
+    if (fp == nullptr)
+        return;
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1
+        && std::fwrite(m_data + sizeof(header), m_size - sizeof(header), 1, fp) == 1;
+
+    if (std::fclose(fp) != 0)
+        ok = false;
+
+    if (!ok || std::rename(tempFilename.c_str(), compiledFilename.c_str()) != 0)
+        std::remove(tempFilename.c_str());
+}
+
+std::string Charmap::Sequence(std::uint32_t offset, std::uint32_t length)
+{
+    const CompiledCharmapHeader* header = (const CompiledCharmapHeader*)m_data;
+
+    if ((std::uint64_t)header->poolOffset + offset + length > m_size)
+        return std::string();
+
+    return std::string((const char*)m_data + header->poolOffset + offset, length);
+}
+
+std::string Charmap::Char(std::int32_t code)
+{
+    const CompiledCharmapHeader* header = (const CompiledCharmapHeader*)m_data;
+    const CompiledCharmapCharSlot* slots = (const CompiledCharmapCharSlot*)(m_data + header->charTableOffset);
+    std::uint32_t mask = header->charSlotCount - 1;
+
+    for (std::uint32_t i = HashCode(code) & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++)
+    {
+        if (slots[i].code == code)
+            return Sequence(slots[i].sequence.offset, slots[i].sequence.length);
+
+        if (slots[i].code == -1)
+            break;
+    }
+
+    return std::string();
+}
+
+std::string Charmap::Escape(unsigned char code)
+{
+    const CompiledCharmapHeader* header = (const CompiledCharmapHeader*)m_data;
+    const CompiledCharmapSequence* escapes = (const CompiledCharmapSequence*)(m_data + header->escapeTableOffset);
+
+    if (code >= 128)
+        return std::string();
+
+    return Sequence(escapes[code].offset, escapes[code].length);
+}
+
+std::string Charmap::Constant(std::string identifier)
+{
+    const CompiledCharmapHeader* header = (const CompiledCharmapHeader*)m_data;
+    const CompiledCharmapConstantSlot* slots = (const CompiledCharmapConstantSlot*)(m_data + header->constantTableOffset);
+    const char* pool = (const char*)m_data + header->poolOffset;
+    std::uint32_t hash = HashName(identifier.data(), identifier.size());
+    std::uint32_t mask = header->constantSlotCount - 1;
+
+    for (std::uint32_t i = hash & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++)
+    {
+        const CompiledCharmapConstantSlot& slot = slots[i];
+
+        if (slot.nameLength == 0)
+            break;
+
+        if (slot.hash == hash
+         && slot.nameLength == identifier.size()
+         && (std::uint64_t)header->poolOffset + slot.nameOffset + slot.nameLength <= m_size
+         && std::memcmp(pool + slot.nameOffset, identifier.data(), slot.nameLength) == 0)
+            return Sequence(slot.sequence.offset, slot.sequence.length);
+    }
+
+    return std::string();
 }
@@ -23,42 +23,36 @@
 
 #include <cstdint>
 #include <string>
-#include <map>
+#include <cstddef>
 #include <vector>
 
+struct CharmapSourceInfo;
+
+// A charmap is stored as a flat block of hash tables and a string pool so
+// that a compiled copy can be written to disk and memory-mapped by later
+// runs instead of re-parsing charmap.txt. See charmap.cpp for the layout.
 class Charmap
 {
 public:
-    Charmap(std::string filename);
-
-    std::string Char(std::int32_t code)
-    {
-        auto it = m_chars.find(code);
-
-        if (it == m_chars.end())
-            return std::string();
-
-        return it->second;
-    }
-
-    std::string Escape(unsigned char code)
-    {
-        return m_escapes[code];
-    }
-
-    std::string Constant(std::string identifier)
-    {
-        auto it = m_constants.find(identifier);
+    Charmap(std::string filename, std::string compiledFilename = "");
+    Charmap(const Charmap&) = delete;
+    ~Charmap();
 
-        if (it == m_constants.end())
-            return std::string();
+    std::string Char(std::int32_t code);
+    std::string Escape(unsigned char code);
+    std::string Constant(std::string identifier);
 
-        return it->second;
-    }
+    bool LoadedCompiled() const { return m_mappedData != nullptr; }
 private:
-    std::map<std::int32_t, std::string> m_chars;
-    std::string m_escapes[128];
-    std::map<std::string, std::string> m_constants;
+    const unsigned char* m_data;
+    std::size_t m_size;
+    void* m_mappedData;
+    std::vector<unsigned char> m_ownedData;
+
+    void Parse(std::string filename);
+    bool TryLoadCompiled(std::string compiledFilename, const CharmapSourceInfo& source);
+    void WriteCompiled(std::string compiledFilename, const CharmapSourceInfo& source);
+    std::string Sequence(std::uint32_t offset, std::uint32_t length);
 };
 
 #endif // CHARMAP_H
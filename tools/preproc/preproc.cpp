@@ -20,6 +20,7 @@
 
 #include <string>
 #include <stack>
+#include <chrono>
 #include <unistd.h>
 #include "preproc.h"
 #include "asm_file.h"
@@ -132,10 +133,21 @@ void PreprocAsmFile(std::string filename, bool isStdin, bool doEnum)
     }
 }
 
-void PreprocCFile(const char * filename, bool isStdin, const char * graphicsRoot)
+void PreprocCFile(const char * filename, bool isStdin, const char * graphicsRoot, bool reportTiming)
 {
     CFile cFile(filename, isStdin, graphicsRoot);
+
+    auto start = std::chrono::steady_clock::now();
     cFile.Preproc();
+
+    if (reportTiming)
+    {
+        std::fflush(stdout);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        long long us = elapsed.count() > 0 ? elapsed.count() : 1;
+        std::fprintf(stderr, "preproc: processed %ld bytes of \"%s\" in %lld us (%.1f MB/s)\n",
+            cFile.InputSize(), filename, us, cFile.InputSize() / (double)us);
+    }
 }
 
 const char* GetFileExtension(const char* filename)
@@ -161,7 +173,7 @@ const char* GetFileExtension(const char* filename)
 
 static void UsageAndExit(const char *program)
 {
-    std::fprintf(stderr, "Usage: %s [-i] [-e] [-g PATH] SRC_FILE CHARMAP_FILE\nwhere -i denotes if input is from stdin\n      -e enables enum handling\n-g specifies the root for INCGFX\n", program);
+    std::fprintf(stderr, "Usage: %s [-i] [-e] [-g PATH] [-c CACHE] [-t] SRC_FILE CHARMAP_FILE\nwhere -i denotes if input is from stdin\n      -e enables enum handling\n-g specifies the root for INCGFX\n-c loads the compiled charmap CACHE, rebuilding it if CHARMAP_FILE changed\n-t reports the charmap load time and C throughput on stderr\n", program);
     std::exit(EXIT_FAILURE);
 }
 
@@ -173,9 +185,11 @@ int main(int argc, char **argv)
     bool isStdin = false;
     bool doEnum = false;
     const char *graphicsRoot = "";
+    const char *charmapCache = "";
+    bool reportTiming = false;
 
-    /* preproc [-i] [-e] [-g PATH] SRC_FILE CHARMAP_FILE */
-    while ((opt = getopt(argc, argv, "ieg:")) != -1)
+    /* preproc [-i] [-e] [-g PATH] [-c CACHE] [-t] SRC_FILE CHARMAP_FILE */
+    while ((opt = getopt(argc, argv, "ieg:c:t")) != -1)
     {
         switch (opt)
         {
@@ -188,6 +202,12 @@ int main(int argc, char **argv)
         case 'g':
             graphicsRoot = optarg;
             break;
+        case 'c':
+            charmapCache = optarg;
+            break;
+        case 't':
+            reportTiming = true;
+            break;
         default:
             UsageAndExit(argv[0]);
             break;
@@ -200,7 +220,15 @@ int main(int argc, char **argv)
     source = argv[optind + 0];
     charmap = argv[optind + 1];
 
-    g_charmap = new Charmap(charmap);
+    auto charmapStart = std::chrono::steady_clock::now();
+    g_charmap = new Charmap(charmap, charmapCache);
+
+    if (reportTiming)
+    {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - charmapStart);
+        std::fprintf(stderr, "preproc: %s charmap \"%s\" in %lld us\n",
+            g_charmap->LoadedCompiled() ? "loaded compiled" : "parsed", charmap, (long long)elapsed.count());
+    }
 
 #ifdef _WIN32
 	// On Windows, piping from stdout can break newlines. Treat stdout as binary stream to avoid this.
@@ -220,7 +248,7 @@ int main(int argc, char **argv)
     {
         if (doEnum)
             FATAL_ERROR("-e is invalid for C sources\n");
-        PreprocCFile(source, isStdin, graphicsRoot);
+        PreprocCFile(source, isStdin, graphicsRoot, reportTiming);
     }
     else
     {
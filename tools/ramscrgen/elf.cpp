@@ -1,217 +1,356 @@
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
+#include <chrono>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include "ramscrgen.h"
 #include "elf.h"
 
-#define SHN_COMMON 0xFFF2
-
-static std::string s_elfPath;
-static std::string s_archiveFilePath;
-static std::string s_archiveObjectPath;
-
-static FILE *s_file;
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-static std::uint32_t s_sectionHeaderOffset;
-static int s_sectionHeaderEntrySize;
-static int s_sectionCount;
-static int s_shstrtabIndex;
+#define SHN_COMMON 0xFFF2
+#define SHN_LORESERVE 0xFF00
+#define SHF_ALLOC 0x2
+#define STT_FUNC 2
 
-static std::uint32_t s_symtabOffset;
-static std::uint32_t s_strtabOffset;
-static std::uint32_t s_pseudoCommonSectionIndex;
+typedef std::vector<std::pair<std::string, std::uint32_t>> SymbolList;
 
-static std::uint32_t s_symbolCount;
-static std::uint32_t s_elfFileOffset;
+static ElfReadStats s_stats;
 
-struct Symbol
+// The contents of a file, mapped into memory (or read in one go on Windows).
+class MappedFile
 {
-    std::uint32_t nameOffset;
-    std::uint32_t size;
+public:
+    MappedFile(const std::string& path, const std::string& displayPath);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::uint8_t *Data() const { return m_data; }
+    std::size_t Size() const { return m_size; }
+
+private:
+    const std::uint8_t *m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<std::uint8_t> m_buffer;
+#else
+    void *m_mapping = nullptr;
+#endif
 };
 
-static void Seek(long offset)
+MappedFile::MappedFile(const std::string& path, const std::string& displayPath)
 {
-    if (std::fseek(s_file, s_elfFileOffset + offset, SEEK_SET) != 0)
-        FATAL_ERROR("error: failed to seek to %ld in \"%s\"", offset, s_elfPath.c_str());
+#ifdef _WIN32
+    std::ifstream ifs(path, std::ios::binary);
+
+    if (!ifs.is_open())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", displayPath.c_str());
+
+    m_buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", displayPath.c_str());
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", displayPath.c_str());
+
+    m_size = st.st_size;
+
+    if (m_size > 0)
+    {
+        m_mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (m_mapping == MAP_FAILED)
+            FATAL_ERROR("error: failed to map \"%s\"\n", displayPath.c_str());
+
+        m_data = static_cast<const std::uint8_t *>(m_mapping);
+    }
+
+    close(fd);
+#endif
 }
 
-static void Skip(long offset)
+MappedFile::~MappedFile()
 {
-    if (std::fseek(s_file, offset, SEEK_CUR) != 0)
-        FATAL_ERROR("error: failed to skip %ld bytes in \"%s\"", offset, s_elfPath.c_str());
+#ifndef _WIN32
+    if (m_mapping != nullptr)
+        munmap(m_mapping, m_size);
+#endif
 }
 
-static std::uint32_t ReadInt8()
+// Reads the common symbols of a 32-bit little-endian ELF object straight
+// from its mapping, checking every access against the file's size.
+class ElfReader
 {
-    int c = std::fgetc(s_file);
-
-    if (c < 0)
-        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", s_elfPath.c_str());
+public:
+    ElfReader(const std::string& path, const MappedFile& file)
+        : m_path(path), m_data(file.Data()), m_size(file.Size()) {}
+
+    SymbolList GetCommonSymbols();
+    void ReadContents(std::vector<ElfSection>& sections, std::vector<ElfSymbol>& symbols);
+
+private:
+    std::string m_path;
+    const std::uint8_t *m_data;
+    std::size_t m_size;
+
+    std::uint32_t m_sectionHeaderOffset;
+    int m_sectionHeaderEntrySize;
+    int m_sectionCount;
+    int m_shstrtabIndex;
+
+    std::uint32_t m_symtabOffset;
+    std::uint32_t m_strtabOffset;
+    std::uint32_t m_pseudoCommonSectionIndex;
+    std::uint32_t m_symbolCount;
+
+    void Check(std::uint64_t offset, std::uint64_t length);
+    std::uint32_t ReadInt16(std::uint64_t offset);
+    std::uint32_t ReadInt32(std::uint64_t offset);
+    const char *ReadString(std::uint64_t offset);
+    void VerifyElfIdent();
+    void ReadElfHeader();
+    std::uint64_t SectionHeader(int index);
+    void FindTableOffsets();
+};
 
-    return c;
+void ElfReader::Check(std::uint64_t offset, std::uint64_t length)
+{
+    if (offset + length > m_size)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", m_path.c_str());
 }
 
-static std::uint32_t ReadInt16()
+std::uint32_t ElfReader::ReadInt16(std::uint64_t offset)
 {
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    return val;
+    Check(offset, 2);
+    const std::uint8_t *p = m_data + offset;
+    return p[0] | (p[1] << 8);
 }
 
-static std::uint32_t ReadInt32()
+std::uint32_t ElfReader::ReadInt32(std::uint64_t offset)
 {
-    std::uint32_t val = 0;
-    val |= ReadInt8();
-    val |= ReadInt8() << 8;
-    val |= ReadInt8() << 16;
-    val |= ReadInt8() << 24;
-    return val;
+    Check(offset, 4);
+    const std::uint8_t *p = m_data + offset;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
 }
 
-static std::string ReadString()
+const char *ElfReader::ReadString(std::uint64_t offset)
 {
-    std::string s;
-    char c;
+    Check(offset, 1);
+    const char *s = reinterpret_cast<const char *>(m_data + offset);
 
-    while ((c = ReadInt8()) != 0)
-        s += c;
+    if (std::memchr(s, 0, m_size - offset) == nullptr)
+        FATAL_ERROR("error: unexpected EOF when reading ELF file \"%s\"\n", m_path.c_str());
 
     return s;
 }
 
-static void VerifyElfIdent()
+void ElfReader::VerifyElfIdent()
 {
     char expectedMagic[4] = { 0x7F, 'E', 'L', 'F' };
-    char magic[4];
 
-    if (std::fread(magic, 4, 1, s_file) != 1)
-        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", s_elfPath.c_str());
+    if (m_size < 4)
+        FATAL_ERROR("error: failed to read ELF magic from \"%s\"\n", m_path.c_str());
 
-    if (std::memcmp(magic, expectedMagic, 4) != 0)
-        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", s_elfPath.c_str());
+    if (std::memcmp(m_data, expectedMagic, 4) != 0)
+        FATAL_ERROR("error: ELF magic did not match in \"%s\"\n", m_path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", s_elfPath.c_str());
+    if (m_size < 5 || m_data[4] != 1)
+        FATAL_ERROR("error: \"%s\" not 32-bit ELF\n", m_path.c_str());
 
-    if (std::fgetc(s_file) != 1)
-        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", s_elfPath.c_str());
+    if (m_size < 6 || m_data[5] != 1)
+        FATAL_ERROR("error: \"%s\" not little-endian ELF\n", m_path.c_str());
 }
 
-static void ReadElfHeader()
+void ElfReader::ReadElfHeader()
 {
-    Seek(0x20);
-    s_sectionHeaderOffset = ReadInt32();
-    Seek(0x2E);
-    s_sectionHeaderEntrySize = ReadInt16();
-    s_sectionCount = ReadInt16();
-    s_shstrtabIndex = ReadInt16();
+    m_sectionHeaderOffset = ReadInt32(0x20);
+    m_sectionHeaderEntrySize = ReadInt16(0x2E);
+    m_sectionCount = ReadInt16(0x30);
+    m_shstrtabIndex = ReadInt16(0x32);
 }
 
-static std::string GetSectionName(std::uint32_t shstrtabOffset, int index)
+std::uint64_t ElfReader::SectionHeader(int index)
 {
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * index);
-    std::uint32_t nameOffset = ReadInt32();
-    Seek(shstrtabOffset + nameOffset);
-    return ReadString();
+    return (std::uint64_t)m_sectionHeaderOffset + (std::uint64_t)m_sectionHeaderEntrySize * index;
 }
 
-static void FindTableOffsets()
+void ElfReader::FindTableOffsets()
 {
-    s_symtabOffset = 0;
-    s_strtabOffset = 0;
-    s_pseudoCommonSectionIndex = 0;
+    m_symtabOffset = 0;
+    m_strtabOffset = 0;
+    m_pseudoCommonSectionIndex = 0;
+    m_symbolCount = 0;
 
-    Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * s_shstrtabIndex + 0x10);
-    std::uint32_t shstrtabOffset = ReadInt32();
+    std::uint32_t shstrtabOffset = ReadInt32(SectionHeader(m_shstrtabIndex) + 0x10);
 
-    for (int i = 0; i < s_sectionCount; i++)
+    for (int i = 0; i < m_sectionCount; i++)
     {
-        std::string name = GetSectionName(shstrtabOffset, i);
+        const char *name = ReadString((std::uint64_t)shstrtabOffset + ReadInt32(SectionHeader(i)));
 
-        if (name == ".symtab")
+        if (std::strcmp(name, ".symtab") == 0)
+        {
+            if (m_symtabOffset)
+                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", m_path.c_str());
+            m_symtabOffset = ReadInt32(SectionHeader(i) + 0x10);
+            m_symbolCount = ReadInt32(SectionHeader(i) + 0x14) / 16;
+        }
+        else if (std::strcmp(name, ".strtab") == 0)
         {
-            if (s_symtabOffset)
-                FATAL_ERROR("error: mutiple .symtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_symtabOffset = ReadInt32();
-            std::uint32_t size = ReadInt32();
-            s_symbolCount = size / 16;
+            if (m_strtabOffset)
+                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", m_path.c_str());
+            m_strtabOffset = ReadInt32(SectionHeader(i) + 0x10);
         }
-        else if (name == ".strtab")
+        else if (std::strcmp(name, "common_data") == 0)
         {
-            if (s_strtabOffset)
-                FATAL_ERROR("error: mutiple .strtab sections found in \"%s\"\n", s_elfPath.c_str());
-            Seek(s_sectionHeaderOffset + s_sectionHeaderEntrySize * i + 0x10);
-            s_strtabOffset = ReadInt32();
-        } else if (name == "common_data") {
-            if (s_pseudoCommonSectionIndex) {
-                FATAL_ERROR("error: mutiple common_data sections found in \"%s\"\n", s_elfPath.c_str());
-            }
-            s_pseudoCommonSectionIndex = i;
+            if (m_pseudoCommonSectionIndex)
+                FATAL_ERROR("error: mutiple common_data sections found in \"%s\"\n", m_path.c_str());
+            m_pseudoCommonSectionIndex = i;
         }
     }
 
-    if (!s_symtabOffset)
-        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", s_elfPath.c_str());
+    if (!m_symtabOffset)
+        FATAL_ERROR("error: couldn't find .symtab section in \"%s\"\n", m_path.c_str());
 
-    if (!s_strtabOffset)
-        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", s_elfPath.c_str());
+    if (!m_strtabOffset)
+        FATAL_ERROR("error: couldn't find .strtab section in \"%s\"\n", m_path.c_str());
 }
 
-static std::vector<std::pair<std::string, std::uint32_t>> GetCommonSymbols_Shared()
+SymbolList ElfReader::GetCommonSymbols()
 {
     VerifyElfIdent();
     ReadElfHeader();
     FindTableOffsets();
 
-    std::vector<std::pair<std::string, std::uint32_t>> commonSymbols;
+    SymbolList commonSymbols;
 
-    if (s_pseudoCommonSectionIndex) {
-        std::vector<Symbol> commonSymbolVec;
-    
-        Seek(s_symtabOffset);
-    
-        for (std::uint32_t i = 0; i < s_symbolCount; i++)
-        {
-            Symbol sym;
-            sym.nameOffset = ReadInt32();
-            Skip(4);
-            sym.size = ReadInt32();
-            Skip(2);
-            std::uint16_t sectionIndex = ReadInt16();
-            if (sectionIndex == s_pseudoCommonSectionIndex)
-                commonSymbolVec.push_back(sym);
-        }
-    
-        for (const Symbol& sym : commonSymbolVec)
+    if (m_pseudoCommonSectionIndex)
+    {
+        Check(m_symtabOffset, (std::uint64_t)m_symbolCount * 16);
+
+        for (std::uint32_t i = 0; i < m_symbolCount; i++)
         {
-            Seek(s_strtabOffset + sym.nameOffset);
-            std::string name = ReadString();
-            if (name == "$d" || name == "") {
+            std::uint64_t entry = m_symtabOffset + (std::uint64_t)i * 16;
+
+            if (ReadInt16(entry + 14) != m_pseudoCommonSectionIndex)
+                continue;
+
+            const char *name = ReadString((std::uint64_t)m_strtabOffset + ReadInt32(entry));
+
+            if (std::strcmp(name, "$d") == 0 || name[0] == 0)
                 continue;
-            }
-            commonSymbols.emplace_back(name, sym.size);
+
+            commonSymbols.emplace_back(name, ReadInt32(entry + 8));
         }
     }
 
+    s_stats.symbols += commonSymbols.size();
+
     return commonSymbols;
 }
 
+void ElfReader::ReadContents(std::vector<ElfSection>& sections, std::vector<ElfSymbol>& symbols)
+{
+    VerifyElfIdent();
+    ReadElfHeader();
+    FindTableOffsets();
+
+    std::uint32_t shstrtabOffset = ReadInt32(SectionHeader(m_shstrtabIndex) + 0x10);
+    std::vector<bool> allocated(m_sectionCount);
+
+    for (int i = 0; i < m_sectionCount; i++)
+    {
+        std::uint64_t header = SectionHeader(i);
+
+        if (!(ReadInt32(header + 0x8) & SHF_ALLOC))
+            continue;
+
+        allocated[i] = true;
+
+        std::uint32_t size = ReadInt32(header + 0x14);
+
+        if (size != 0)
+            sections.push_back({ ReadString((std::uint64_t)shstrtabOffset + ReadInt32(header)), ReadInt32(header + 0xC), size });
+    }
+
+    Check(m_symtabOffset, (std::uint64_t)m_symbolCount * 16);
+
+    for (std::uint32_t i = 0; i < m_symbolCount; i++)
+    {
+        std::uint64_t entry = m_symtabOffset + (std::uint64_t)i * 16;
+        std::uint32_t sectionIndex = ReadInt16(entry + 14);
+        int type = m_data[entry + 12] & 0xF;
+
+        // Only no-type, object and function symbols that live in memory.
+        if (type > STT_FUNC || sectionIndex == 0 || sectionIndex >= SHN_LORESERVE
+         || sectionIndex >= (std::uint32_t)m_sectionCount || !allocated[sectionIndex])
+            continue;
+
+        const char *name = ReadString((std::uint64_t)m_strtabOffset + ReadInt32(entry));
+
+        if (name[0] == 0 || name[0] == '$')
+            continue;
+
+        std::uint32_t address = ReadInt32(entry + 4);
+
+        // Thumb function addresses have the low bit set.
+        if (type == STT_FUNC)
+            address &= ~1u;
+
+        symbols.push_back({ name, address, ReadInt32(entry + 8) });
+    }
+}
+
 std::vector<std::pair<std::string, std::uint32_t>> GetCommonSymbols(std::string sourcePath, std::string path)
 {
-    s_elfFileOffset = 0;
+    // Each object is read once, however many directives name it.
+    static std::unordered_map<std::string, SymbolList> s_cache;
+
     if (path[0] == '*')
         FATAL_ERROR("error: library common syms are unsupported (filename: \"%s\")\n", path.c_str());
 
-    s_elfPath = sourcePath + "/" + path;
-    s_file = std::fopen(s_elfPath.c_str(), "rb");
+    std::string elfPath = sourcePath + "/" + path;
+    auto it = s_cache.find(elfPath);
+
+    if (it != s_cache.end())
+        return it->second;
 
-    if (s_file == NULL)
-        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+    auto startTime = std::chrono::steady_clock::now();
 
-    return GetCommonSymbols_Shared();
+    MappedFile file(elfPath, path);
+    SymbolList commonSymbols = ElfReader(elfPath, file).GetCommonSymbols();
+
+    s_stats.objects++;
+    s_stats.bytes += file.Size();
+    s_stats.microseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    return s_cache.emplace(elfPath, std::move(commonSymbols)).first->second;
+}
+
+void ReadElfFile(std::string path, std::vector<ElfSection>& sections, std::vector<ElfSymbol>& symbols)
+{
+    MappedFile file(path, path);
+    ElfReader(path, file).ReadContents(sections, symbols);
+}
+
+ElfReadStats GetElfReadStats()
+{
+    return s_stats;
 }
@@ -27,4 +27,32 @@
 
 std::vector<std::pair<std::string, std::uint32_t>> GetCommonSymbols(std::string sourcePath, std::string path);
 
+// Totals over the objects read so far, for the -t report.
+struct ElfReadStats
+{
+    unsigned long objects;
+    unsigned long long bytes;
+    unsigned long symbols;
+    long long microseconds;
+};
+
+ElfReadStats GetElfReadStats();
+
+struct ElfSection
+{
+    std::string name;
+    std::uint32_t address;
+    std::uint32_t size;
+};
+
+struct ElfSymbol
+{
+    std::string name;
+    std::uint32_t address;
+    std::uint32_t size;
+};
+
+// Reads the allocated sections and the data and code symbols of a linked ELF file.
+void ReadElfFile(std::string path, std::vector<ElfSection>& sections, std::vector<ElfSymbol>& symbols);
+
 #endif // ELF_H
@@ -0,0 +1,391 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include "ramscrgen.h"
+#include "sym_file.h"
+#include "elf.h"
+#include "map_file.h"
+#include "footprint.h"
+
+enum Region
+{
+    kEwram,
+    kIwram,
+    kRom,
+    kRegionCount,
+    kNoRegion = kRegionCount
+};
+
+static const char *const kRegionNames[kRegionCount] = { "EWRAM", "IWRAM", "ROM" };
+static const long long kRegionCapacities[kRegionCount] = { 0x40000, 0x8000, 0x2000000 };
+
+// Bytes not covered by any object's input sections.
+static const char *const kOtherModule = "<padding and linker script>";
+
+struct Symbol
+{
+    std::string name;
+    std::string module;
+    std::uint32_t address;
+    std::uint32_t size;
+    Region region;
+};
+
+struct Footprint
+{
+    long long used[kRegionCount] = {};
+    std::map<std::string, std::vector<long long>> modules;
+    std::vector<Symbol> symbols;
+};
+
+static Region GetRegion(std::uint32_t address)
+{
+    switch (address >> 24)
+    {
+    case 0x02:
+        return kEwram;
+    case 0x03:
+        return kIwram;
+    case 0x08:
+    case 0x09:
+        return kRom;
+    default:
+        return kNoRegion;
+    }
+}
+
+static std::vector<long long>& ModuleSizes(Footprint& footprint, const std::string& module)
+{
+    std::vector<long long>& sizes = footprint.modules[module];
+    sizes.resize(kRegionCount);
+    return sizes;
+}
+
+// Maps each common symbol to the object that defines it, following the
+// common symbol file the same way as the COMMON linker script is generated.
+static std::unordered_map<std::string, std::pair<std::string, std::uint32_t>> ReadCommonSymbols(std::string commonSymPath, std::string sourcePath)
+{
+    std::unordered_map<std::string, std::pair<std::string, std::uint32_t>> commonSymbols;
+    SymFile symFile(commonSymPath);
+
+    while (!symFile.IsAtEnd())
+    {
+        symFile.HandleLangConditional("ENGLISH");
+
+        if (symFile.GetDirective() != Directive::Include)
+        {
+            symFile.SkipLine();
+            continue;
+        }
+
+        std::string object = symFile.ReadPath();
+        symFile.ExpectEmptyRestOfLine();
+
+        if (object[0] == '*')
+            continue;
+
+        for (const auto& symbol : GetCommonSymbols(sourcePath, object))
+            commonSymbols[symbol.first] = std::make_pair(object, symbol.second);
+    }
+
+    return commonSymbols;
+}
+
+// Finds the module name the map uses for an object named relative to the source path.
+static std::string FindModule(const Footprint& footprint, const std::string& object)
+{
+    for (const auto& module : footprint.modules)
+    {
+        const std::string& name = module.first;
+
+        if (name == object || (name.size() > object.size()
+         && name.compare(name.size() - object.size(), object.size(), object) == 0
+         && name[name.size() - object.size() - 1] == '/'))
+            return name;
+    }
+
+    return object;
+}
+
+static Footprint ReadFootprint(const FootprintBuild& build, std::string commonSymPath)
+{
+    Footprint footprint;
+    std::vector<ElfSection> elfSections;
+    std::vector<ElfSymbol> elfSymbols;
+
+    ReadElfFile(build.elfPath, elfSections, elfSymbols);
+
+    for (const ElfSection& section : elfSections)
+    {
+        Region region = GetRegion(section.address);
+        if (region != kNoRegion)
+            footprint.used[region] += section.size;
+    }
+
+    std::vector<MapSection> inputSections;
+
+    for (MapSection& section : ReadMapFile(build.mapPath))
+    {
+        Region region = GetRegion(section.address);
+
+        if (region == kNoRegion || section.object.empty())
+            continue;
+
+        ModuleSizes(footprint, section.object)[region] += section.size;
+        inputSections.push_back(std::move(section));
+    }
+
+    std::sort(inputSections.begin(), inputSections.end(), [](const MapSection& a, const MapSection& b) {
+        return a.address < b.address;
+    });
+
+    std::unordered_map<std::string, std::pair<std::string, std::uint32_t>> commonSymbols;
+
+    if (!build.sourcePath.empty())
+        commonSymbols = ReadCommonSymbols(commonSymPath, build.sourcePath);
+
+    std::unordered_map<std::string, std::string> commonModules;
+
+    for (const ElfSymbol& elfSymbol : elfSymbols)
+    {
+        Symbol symbol = { elfSymbol.name, "", elfSymbol.address, elfSymbol.size, GetRegion(elfSymbol.address) };
+
+        if (symbol.region == kNoRegion)
+            continue;
+
+        auto next = std::upper_bound(inputSections.begin(), inputSections.end(), symbol.address, [](std::uint32_t address, const MapSection& section) {
+            return address < section.address;
+        });
+
+        if (next != inputSections.begin() && symbol.address - (next - 1)->address < (next - 1)->size)
+        {
+            symbol.module = (next - 1)->object;
+        }
+        else
+        {
+            // Symbols placed by the generated COMMON linker script belong to
+            // no input section; their objects come from the common symbol file.
+            auto common = commonSymbols.find(symbol.name);
+
+            if (common == commonSymbols.end())
+            {
+                symbol.module = kOtherModule;
+            }
+            else
+            {
+                auto module = commonModules.find(common->second.first);
+                if (module == commonModules.end())
+                    module = commonModules.emplace(common->second.first, FindModule(footprint, common->second.first)).first;
+                symbol.module = module->second;
+                symbol.size = common->second.second;
+                ModuleSizes(footprint, symbol.module)[symbol.region] += symbol.size;
+                commonSymbols.erase(common);
+            }
+        }
+
+        if (symbol.size != 0)
+            footprint.symbols.push_back(std::move(symbol));
+    }
+
+    std::vector<long long>& other = ModuleSizes(footprint, kOtherModule);
+
+    for (int region = 0; region < kRegionCount; region++)
+    {
+        other[region] = footprint.used[region];
+
+        for (const auto& module : footprint.modules)
+            if (module.first != kOtherModule)
+                other[region] -= module.second[region];
+    }
+
+    return footprint;
+}
+
+static long long RamSize(const std::vector<long long>& sizes)
+{
+    return sizes[kEwram] + sizes[kIwram];
+}
+
+static bool IsRam(Region region)
+{
+    return region == kEwram || region == kIwram;
+}
+
+static void PrintReport(const FootprintBuild& build, const Footprint& footprint, std::size_t symbolCount)
+{
+    std::printf("%s\n\n", build.elfPath.c_str());
+    std::printf("%-8s %10s %10s %10s\n", "region", "used", "free", "capacity");
+
+    for (int region = 0; region < kRegionCount; region++)
+        std::printf("%-8s %10lld %10lld %10lld\n", kRegionNames[region], footprint.used[region],
+            kRegionCapacities[region] - footprint.used[region], kRegionCapacities[region]);
+
+    std::vector<std::pair<std::string, std::vector<long long>>> modules(footprint.modules.begin(), footprint.modules.end());
+
+    std::stable_sort(modules.begin(), modules.end(), [](const std::pair<std::string, std::vector<long long>>& a, const std::pair<std::string, std::vector<long long>>& b) {
+        if (RamSize(a.second) != RamSize(b.second))
+            return RamSize(a.second) > RamSize(b.second);
+        return a.second[kRom] > b.second[kRom];
+    });
+
+    std::printf("\n%-48s %10s %10s %10s\n", "module", "EWRAM", "IWRAM", "ROM");
+
+    for (const auto& module : modules)
+        if (module.second[kEwram] || module.second[kIwram] || module.second[kRom])
+            std::printf("%-48s %10lld %10lld %10lld\n", module.first.c_str(), module.second[kEwram], module.second[kIwram], module.second[kRom]);
+
+    std::vector<const Symbol *> symbols;
+
+    for (const Symbol& symbol : footprint.symbols)
+        symbols.push_back(&symbol);
+
+    std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol *a, const Symbol *b) {
+        return a->size > b->size;
+    });
+
+    for (int ram = 1; ram >= 0; ram--)
+    {
+        std::printf("\nlargest %s symbols\n%10s %-6s %-10s %s\n", ram ? "RAM" : "ROM", "size", "region", "address", "symbol");
+
+        std::size_t count = 0;
+
+        for (std::size_t i = 0; i < symbols.size() && count < symbolCount; i++)
+        {
+            if (IsRam(symbols[i]->region) != (ram != 0))
+                continue;
+
+            std::printf("%10u %-6s 0x%08X %s (%s)\n", symbols[i]->size, kRegionNames[symbols[i]->region], symbols[i]->address,
+                symbols[i]->name.c_str(), symbols[i]->module.c_str());
+            count++;
+        }
+    }
+}
+
+struct SymbolChange
+{
+    const Symbol *symbol;
+    long long change;
+    const char *note;
+};
+
+static void PrintDiff(const FootprintBuild& base, const Footprint& oldFootprint, const Footprint& newFootprint, std::size_t symbolCount)
+{
+    std::printf("\nchanges since %s\n\n", base.elfPath.c_str());
+    std::printf("%-8s %10s %10s %10s\n", "region", "base", "new", "change");
+
+    for (int region = 0; region < kRegionCount; region++)
+        std::printf("%-8s %10lld %10lld %+10lld\n", kRegionNames[region], oldFootprint.used[region], newFootprint.used[region],
+            newFootprint.used[region] - oldFootprint.used[region]);
+
+    std::map<std::string, std::vector<long long>> moduleChanges;
+
+    for (const auto& module : newFootprint.modules)
+        moduleChanges[module.first] = module.second;
+
+    for (const auto& module : oldFootprint.modules)
+    {
+        std::vector<long long>& change = moduleChanges[module.first];
+        change.resize(kRegionCount);
+        for (int region = 0; region < kRegionCount; region++)
+            change[region] -= module.second[region];
+    }
+
+    std::vector<std::pair<std::string, std::vector<long long>>> modules;
+
+    for (const auto& module : moduleChanges)
+        if (module.second[kEwram] || module.second[kIwram] || module.second[kRom])
+            modules.push_back(module);
+
+    std::stable_sort(modules.begin(), modules.end(), [](const std::pair<std::string, std::vector<long long>>& a, const std::pair<std::string, std::vector<long long>>& b) {
+        if (RamSize(a.second) != RamSize(b.second))
+            return RamSize(a.second) > RamSize(b.second);
+        return a.second[kRom] > b.second[kRom];
+    });
+
+    std::printf("\n%-48s %10s %10s %10s\n", "module", "EWRAM", "IWRAM", "ROM");
+
+    for (const auto& module : modules)
+        std::printf("%-48s %+10lld %+10lld %+10lld\n", module.first.c_str(), module.second[kEwram], module.second[kIwram], module.second[kRom]);
+
+    // Static symbols can share a name, so symbols are matched within their module.
+    std::map<std::pair<std::string, std::string>, const Symbol *> oldSymbols;
+    std::vector<SymbolChange> changes;
+
+    for (const Symbol& symbol : oldFootprint.symbols)
+        oldSymbols[std::make_pair(symbol.module, symbol.name)] = &symbol;
+
+    for (const Symbol& symbol : newFootprint.symbols)
+    {
+        auto old = oldSymbols.find(std::make_pair(symbol.module, symbol.name));
+
+        if (old == oldSymbols.end())
+        {
+            changes.push_back({ &symbol, symbol.size, "added" });
+        }
+        else
+        {
+            if (old->second->size != symbol.size)
+                changes.push_back({ &symbol, (long long)symbol.size - old->second->size, "" });
+            oldSymbols.erase(old);
+        }
+    }
+
+    for (const auto& old : oldSymbols)
+        changes.push_back({ old.second, -(long long)old.second->size, "removed" });
+
+    std::stable_sort(changes.begin(), changes.end(), [](const SymbolChange& a, const SymbolChange& b) {
+        if (IsRam(a.symbol->region) != IsRam(b.symbol->region))
+            return IsRam(a.symbol->region);
+        return a.change > b.change;
+    });
+
+    std::printf("\n%10s %-6s %s\n", "change", "region", "symbol");
+
+    for (std::size_t i = 0; i < changes.size() && i < symbolCount; i++)
+        std::printf("%+10lld %-6s %s (%s)%s%s\n", changes[i].change, kRegionNames[changes[i].symbol->region],
+            changes[i].symbol->name.c_str(), changes[i].symbol->module.c_str(), changes[i].note[0] ? " " : "", changes[i].note);
+
+    if (changes.size() > symbolCount)
+        std::printf("(%lu more)\n", (unsigned long)(changes.size() - symbolCount));
+
+    long long ewramGrowth = newFootprint.used[kEwram] - oldFootprint.used[kEwram];
+    long long iwramGrowth = newFootprint.used[kIwram] - oldFootprint.used[kIwram];
+
+    if (ewramGrowth + iwramGrowth > 0)
+        std::printf("\nRAM usage grew by %lld bytes (EWRAM %+lld, IWRAM %+lld)\n", ewramGrowth + iwramGrowth, ewramGrowth, iwramGrowth);
+}
+
+void PrintFootprint(const FootprintBuild& build, const FootprintBuild *base, std::string commonSymPath, std::size_t symbolCount)
+{
+    Footprint footprint = ReadFootprint(build, commonSymPath);
+
+    PrintReport(build, footprint, symbolCount);
+
+    if (base != nullptr)
+        PrintDiff(*base, ReadFootprint(*base, commonSymPath), footprint, symbolCount);
+}
@@ -20,10 +20,12 @@
 
 #include <cstdio>
 #include <cstring>
+#include <chrono>
 #include <string>
 #include "ramscrgen.h"
 #include "sym_file.h"
 #include "elf.h"
+#include "footprint.h"
 
 void HandleCommonInclude(std::string filename, std::string sourcePath, std::string symOrderPath, std::string lang)
 {
@@ -105,15 +107,82 @@ void ConvertSymFile(std::string filename, std::string sectionName, std::string l
     }
 }
 
+// Splits "ELF,MAP[,SRC_PATH]" into the parts of a build.
+FootprintBuild ParseFootprintBuild(std::string paths, const char *option)
+{
+    FootprintBuild build;
+    std::size_t commaPos = paths.find(',');
+
+    if (commaPos == std::string::npos)
+        FATAL_ERROR("error: missing comma in argument after \"%s\"\n", option);
+
+    build.elfPath = paths.substr(0, commaPos);
+    build.mapPath = paths.substr(commaPos + 1);
+    commaPos = build.mapPath.find(',');
+    if (commaPos != std::string::npos) {
+        build.sourcePath = build.mapPath.substr(commaPos + 1);
+        build.mapPath = build.mapPath.substr(0, commaPos);
+    }
+
+    return build;
+}
+
+int FootprintMain(int argc, char **argv)
+{
+    if (argc < 3)
+        FATAL_ERROR("error: missing ELF,MAP after \"-f\"\n");
+
+    FootprintBuild build = ParseFootprintBuild(argv[2], "-f");
+    FootprintBuild base;
+    bool hasBase = false;
+    std::string commonSymPath = "sym_common.txt";
+    unsigned long symbolCount = 30;
+
+    for (int i = 3; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            FATAL_ERROR("error: missing value after \"%s\"\n", argv[i]);
+
+        if (std::strcmp(argv[i], "-b") == 0)
+        {
+            base = ParseFootprintBuild(argv[++i], "-b");
+            hasBase = true;
+        }
+        else if (std::strcmp(argv[i], "-c") == 0)
+        {
+            commonSymPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-n") == 0)
+        {
+            char *end;
+            symbolCount = std::strtoul(argv[++i], &end, 10);
+            if (*end != 0)
+                FATAL_ERROR("error: invalid symbol count \"%s\"\n", argv[i]);
+        }
+        else
+        {
+            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[i]);
+        }
+    }
+
+    PrintFootprint(build, hasBase ? &base : nullptr, commonSymPath, symbolCount);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
+    if (argc > 1 && std::strcmp(argv[1], "-f") == 0)
+        return FootprintMain(argc, argv);
+
     if (argc < 4)
     {
-        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH]", argv[0]);
+        fprintf(stderr, "Usage: %s SECTION_NAME SYM_FILE LANG [-c SRC_PATH,COMMON_SYM_PATH] [-t]\n"
+                        "       %s -f ELF,MAP[,SRC_PATH] [-b BASE_ELF,BASE_MAP[,BASE_SRC_PATH]] [-c COMMON_SYM_FILE] [-n COUNT]", argv[0], argv[0]);
         return 1;
     }
 
     bool common = false;
+    bool printTiming = false;
     std::string sectionName = std::string(argv[1]);
     std::string symFileName = std::string(argv[2]);
     std::string lang = std::string(argv[3]);
@@ -121,16 +190,22 @@ int main(int argc, char **argv)
     std::string commonSymPath;
     std::string libSourcePath;
 
-    if (argc > 4)
+    for (int i = 4; i < argc; i++)
     {
-        if (std::strcmp(argv[4], "-c") != 0)
-            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[4]);
+        if (std::strcmp(argv[i], "-t") == 0)
+        {
+            printTiming = true;
+            continue;
+        }
 
-        if (argc < 6)
+        if (std::strcmp(argv[i], "-c") != 0)
+            FATAL_ERROR("error: unrecognized argument \"%s\"\n", argv[i]);
+
+        if (i + 1 >= argc)
             FATAL_ERROR("error: missing SRC_PATH,COMMON_SYM_PATH after \"-c\"\n");
 
         common = true;
-        std::string paths = std::string(argv[5]);
+        std::string paths = std::string(argv[++i]);
         std::size_t commaPos = paths.find(',');
 
         if (commaPos == std::string::npos)
@@ -147,6 +222,18 @@ int main(int argc, char **argv)
         }
     }
 
+    auto startTime = std::chrono::steady_clock::now();
+
     ConvertSymFile(symFileName, sectionName, lang, common, sourcePath, commonSymPath, libSourcePath);
+
+    if (printTiming)
+    {
+        // Goes to stderr so that the linker script on stdout is unaffected.
+        long long totalTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+        ElfReadStats stats = GetElfReadStats();
+        fprintf(stderr, "%s: %lld us total, %lld us reading %lu objects (%llu bytes, %lu common symbols)\n",
+            symFileName.c_str(), totalTime, stats.microseconds, stats.objects, stats.bytes, stats.symbols);
+    }
+
     return 0;
 }
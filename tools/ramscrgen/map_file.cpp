@@ -0,0 +1,114 @@
+// Copyright(c) 2016 YamaArashi
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "ramscrgen.h"
+#include "map_file.h"
+
+static bool IsHexNumber(const std::string& token)
+{
+    return token.size() > 2 && token[0] == '0' && token[1] == 'x';
+}
+
+static std::vector<std::string> Tokenize(const std::string& line)
+{
+    std::istringstream stream(line);
+    std::vector<std::string> tokens;
+    std::string token;
+
+    while (stream >> token)
+        tokens.push_back(token);
+
+    return tokens;
+}
+
+// Collects the input sections from the memory map part of the file.
+// Symbol and assignment lines are indented further and are skipped.
+std::vector<MapSection> ReadMapFile(std::string path)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        FATAL_ERROR("error: failed to open \"%s\" for reading\n", path.c_str());
+
+    std::vector<MapSection> sections;
+    std::string line;
+    std::string pendingName;
+    bool inMemoryMap = false;
+
+    while (std::getline(file, line))
+    {
+        if (!inMemoryMap)
+        {
+            inMemoryMap = line.compare(0, 28, "Linker script and memory map") == 0;
+            continue;
+        }
+
+        if (line.size() < 2 || line[0] != ' ')
+        {
+            pendingName.clear();
+            continue;
+        }
+
+        std::vector<std::string> tokens = Tokenize(line);
+        std::string name;
+
+        if (line[1] != ' ')
+        {
+            name = tokens[0];
+            tokens.erase(tokens.begin());
+        }
+        else if (!pendingName.empty())
+        {
+            // A long section name is printed on a line of its own.
+            name = pendingName;
+        }
+
+        pendingName.clear();
+
+        if (tokens.empty())
+        {
+            pendingName = name;
+            continue;
+        }
+
+        if (name.empty() || tokens.size() < 2 || !IsHexNumber(tokens[0]) || !IsHexNumber(tokens[1]))
+            continue;
+
+        MapSection section;
+        section.name = name;
+        section.address = std::strtoul(tokens[0].c_str(), nullptr, 16);
+        section.size = std::strtoul(tokens[1].c_str(), nullptr, 16);
+
+        for (std::size_t i = 2; i < tokens.size(); i++)
+            section.object += (i > 2 ? " " : "") + tokens[i];
+
+        if (section.size != 0)
+            sections.push_back(section);
+    }
+
+    if (!inMemoryMap)
+        FATAL_ERROR("error: \"%s\" is not a linker map file\n", path.c_str());
+
+    return sections;
+}
@@ -19,17 +19,23 @@
 // THE SOFTWARE.
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
+#include <sstream>
 #include <string>
 #include <iostream>
+#include <thread>
 #include <tuple>
 #include <fstream>
+#include <vector>
 #include "scaninc.h"
 #include "source_file.h"
 
@@ -44,88 +50,104 @@ bool CanOpenFile(std::string path)
     return true;
 }
 
-const char *const USAGE = "Usage: scaninc [-I INCLUDE_PATH] [-M DEPENDENCY_OUT_PATH] [-g PATH] FILE_PATH\n";
+const char *const USAGE =
+    "Usage: scaninc [-I INCLUDE_PATH] [-M DEPENDENCY_OUT_PATH] [-g PATH] FILE_PATH\n"
+    "       scaninc -B OBJ_DIR [-j JOBS] [-I INCLUDE_PATH] [-g PATH] FILE_PATH...\n"
+    "-B writes OBJ_DIR/FILE_PATH with a .d extension for every FILE_PATH in one run\n";
 
-int main(int argc, char **argv)
+// The includes, INCBINs and INCGFXs of a single file, with the includes
+// already resolved against the include path. This only depends on the file
+// itself, so it is computed once and shared by every source that reaches it.
+struct ScannedFile
 {
-    std::queue<std::string> filesToProcess;
-    std::set<std::string> dependencies;
-    std::set<std::string> dependencies_includes;
-    std::map<std::string, std::pair<std::string, std::string>> dependencies_gfx_rules;
+    std::set<std::string> incbins;
+    std::set<Incgfx> incgfxs;
+    std::vector<std::string> includes;
+};
 
-    std::vector<std::string> includeDirs;
+class DependencyScanner
+{
+public:
+    DependencyScanner(const std::vector<std::string>& includeDirs) : m_includeDirs(includeDirs) {}
+    const ScannedFile& Scan(const std::string& filePath);
 
-    bool makeformat = false;
-    std::string make_outfile;
-    std::string gfx_root;
+private:
+    std::vector<std::string> m_includeDirs;
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<ScannedFile>> m_files;
+};
 
-    argc--;
-    argv++;
+const ScannedFile& DependencyScanner::Scan(const std::string& filePath)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_files.find(filePath);
+        if (it != m_files.end())
+            return *it->second;
+    }
+
+    // Parse without holding the lock. Two threads may occasionally scan the
+    // same header at once; both get the same result and the first one is kept.
+    std::unique_ptr<ScannedFile> scanned(new ScannedFile);
+    SourceFile file(filePath);
+
+    std::vector<std::string> includeDirs = m_includeDirs;
+    includeDirs.push_back(file.GetSrcDir());
+    scanned->incbins = file.GetIncbins();
+    scanned->incgfxs = file.GetIncgfxs();
 
-    while (argc > 1)
+    for (auto include : file.GetIncludes())
     {
-        std::string arg(argv[0]);
-        if (arg.substr(0, 2) == "-I")
+        bool exists = false;
+        std::string path("");
+        for (auto includeDir : includeDirs)
         {
-            std::string includeDir = arg.substr(2);
-            if (includeDir.empty())
+            path = includeDir + include;
+            if (CanOpenFile(path))
             {
-                argc--;
-                argv++;
-                includeDir = std::string(argv[0]);
+                exists = true;
+                break;
             }
-            if (!includeDir.empty() && includeDir.back() != '/')
-            {
-                includeDir += '/';
-            }
-            includeDirs.push_back(includeDir);
-        }
-        else if(arg.substr(0, 2) == "-M")
-        {
-            makeformat = true;
-            argc--;
-            argv++;
-            make_outfile = std::string(argv[0]);
-        }
-        else if (arg.substr(0, 2) == "-g")
-        {
-            argc--;
-            argv++;
-            gfx_root = std::string(argv[0]);
         }
-        else
+        if (!exists && (file.FileType() == SourceFileType::Asm || file.FileType() == SourceFileType::Inc))
         {
-            FATAL_ERROR(USAGE);
+            path = include;
+            if (CanOpenFile(path))
+                exists = true;
         }
-        argc--;
-        argv++;
-    }
+        if (!exists)
+            continue;
 
-    if (argc != 1) {
-        FATAL_ERROR(USAGE);
+        scanned->includes.push_back(path);
     }
 
-    size_t ext_pos = make_outfile.find_last_of(".");
-    auto object_file = make_outfile.substr(0, ext_pos + 1) + "o";
-    if (gfx_root.empty()) gfx_root = "./";
-    if (gfx_root[gfx_root.length() - 1] != '/') gfx_root.push_back('/');
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return *m_files.emplace(filePath, std::move(scanned)).first->second;
+}
 
-    std::string initialPath(argv[0]);
+struct Dependencies
+{
+    std::set<std::string> all;
+    std::set<std::string> includes;
+    std::map<std::string, std::pair<std::string, std::string>> gfxRules;
+};
+
+static void CollectDependencies(DependencyScanner& scanner, const std::string& initialPath, const std::string& gfx_root, Dependencies& deps)
+{
+    std::queue<std::string> filesToProcess;
 
     filesToProcess.push(initialPath);
 
     while (!filesToProcess.empty())
     {
-        std::string filePath = filesToProcess.front();
-        SourceFile file(filePath);
+        const ScannedFile& file = scanner.Scan(filesToProcess.front());
         filesToProcess.pop();
 
-        includeDirs.push_back(file.GetSrcDir());
-        for (auto incbin : file.GetIncbins())
+        for (auto incbin : file.incbins)
         {
-            dependencies.insert(incbin);
+            deps.all.insert(incbin);
         }
-        for (auto incgfx : file.GetIncgfxs())
+        for (auto incgfx : file.incgfxs)
         {
             // WARNING: This must stay in-sync with 'tools/preproc/c_file.cpp'.
             std::string arguments_as_path;
@@ -145,109 +167,254 @@ int main(int argc, char **argv)
                 : "\t@mkdir -p '" + target.substr(0, target_slash_pos) + "'\n";
             auto rule = mk_target_basedir + "\t$(GFX) $< $@ " + incgfx.arguments + "\n";
 
-            dependencies.insert(target);
+            deps.all.insert(target);
 
             // If "foo.4bpp.lz" we want a rule for "foo.4bpp", the ".lz"
             // doesn't require any arguments.
             size_t dot_pos = incgfx.extensions.find_first_of('.', 1);
             auto firstTarget = gfx_root + incgfx.source + arguments_as_path + incgfx.extensions.substr(0, dot_pos);
-            dependencies_gfx_rules[firstTarget] = std::make_pair(incgfx.source, rule);
+            deps.gfxRules[firstTarget] = std::make_pair(incgfx.source, rule);
         }
-        for (auto include : file.GetIncludes())
+        for (const std::string &path : file.includes)
         {
-            bool exists = false;
-            std::string path("");
-            for (auto includeDir : includeDirs)
-            {
-                path = includeDir + include;
-                if (CanOpenFile(path))
-                {
-                    exists = true;
-                    break;
-                }
-            }
-            if (!exists && (file.FileType() == SourceFileType::Asm || file.FileType() == SourceFileType::Inc))
-            {
-                path = include;
-                if (CanOpenFile(path))
-                    exists = true;
-            }
-            if (!exists)
-                continue;
-
-            dependencies_includes.insert(path);
-            bool inserted = dependencies.insert(path).second;
-            if (inserted && exists)
+            deps.includes.insert(path);
+            bool inserted = deps.all.insert(path).second;
+            if (inserted)
             {
                 filesToProcess.push(path);
             }
         }
-        includeDirs.pop_back();
     }
+}
 
-    if (!makeformat)
+// Formats the make rules for one object file. The rule that makes the
+// dependency file depend on the headers is left out in batch mode, because
+// the batch run refreshes every dependency file on its own.
+static std::string FormatMakeRules(const Dependencies& deps, const std::string& make_outfile, bool selfRule)
+{
+    std::ostringstream output;
+
+    size_t ext_pos = make_outfile.find_last_of(".");
+    auto object_file = make_outfile.substr(0, ext_pos + 1) + "o";
+
+    // Print a make rule for the object file
+    output << object_file.c_str() << ":";
+    for (const std::string &path : deps.all)
     {
-        for (const std::string &path : dependencies)
-        {
-            std::printf("%s\n", path.c_str());
-        }
-        std::cout << std::endl;
+        output << " " << path;
     }
-    else
-    {
-        // Write out make rules to a file
-        std::ofstream output(make_outfile);
+    output << '\n';
 
-        // Print a make rule for the object file
-        output << object_file.c_str() << ":";
-        for (const std::string &path : dependencies)
+    // Dependency list rule.
+    // Although these rules are identical, they need to be separate, else make will trigger the rule again after the file is created for the first time.
+    if (selfRule)
+    {
+        output << make_outfile.c_str() << ":";
+        for (const std::string &path : deps.includes)
         {
             output << " " << path;
         }
         output << '\n';
+    }
 
-        // Dependency list rule.
-        // Although these rules are identical, they need to be separate, else make will trigger the rule again after the file is created for the first time.
-        output << make_outfile.c_str() << ":";
-        for (const std::string &path : dependencies_includes)
+    // Dummy rules
+    // If a dependency is deleted, make will try to make it, instead of rescanning the dependencies before trying to do that.
+    for (const std::string &path : deps.all)
+    {
+        output << path << ":\n";
+    }
+
+    // Graphics rules
+    // GNU make will issue a warning if there is more than one
+    // recipe for a target. This would occur whenever a target is
+    // 'INCGFX'ed multiple times, which is something that happens a
+    // few times in vanilla. As a workaround, we define a variable
+    // with the target's name sanitized and only emit the recipe if
+    // the target is not yet defined. This is safe, because
+    // targets with the same name necessarily have the same recipe.
+    for (auto gfx_rule : deps.gfxRules)
+    {
+        std::string gfx_var_name = gfx_rule.first;
+        gfx_var_name.erase(
+            std::remove_if(
+                gfx_var_name.begin(), 
+                gfx_var_name.end(), 
+                [] (char c) { return c == '#' || c == ':' || c == '='; } // invalid chars in GNU Make variables
+            ), gfx_var_name.end()
+        );
+        
+        output
+            << "ifndef " << gfx_var_name << "\n"
+            << gfx_var_name << " := defined\n"
+            << gfx_rule.first << ": " << gfx_rule.second.first << "\n" << gfx_rule.second.second
+            << "endif\n";
+    }
+
+    return output.str();
+}
+
+// Writes contents to path unless the file already holds exactly that, so
+// that unchanged dependency files keep their timestamps.
+static bool WriteIfChanged(const std::string& path, const std::string& contents)
+{
+    std::ifstream existing(path, std::ios::binary);
+
+    if (existing)
+    {
+        std::ostringstream current;
+        current << existing.rdbuf();
+        if (current.str() == contents)
+            return false;
+    }
+
+    std::ofstream output(path, std::ios::binary);
+    output << contents;
+    output.close();
+
+    if (!output)
+        FATAL_ERROR("Failed to write \"%s\".\n", path.c_str());
+
+    return true;
+}
+
+// Scans every source on a pool of threads. Headers are parsed once for the
+// whole run instead of once per source.
+static void RunBatch(const std::vector<std::string>& sources, const std::string& objDir, const std::vector<std::string>& includeDirs, const std::string& gfx_root, int jobs)
+{
+    DependencyScanner scanner(includeDirs);
+    std::atomic<size_t> next(0);
+    std::atomic<int> written(0);
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < sources.size())
         {
-            output << " " << path;
+            const std::string& source = sources[i];
+            size_t ext_pos = source.find_last_of(".");
+            std::string make_outfile = objDir + source.substr(0, ext_pos) + ".d";
+
+            Dependencies deps;
+            CollectDependencies(scanner, source, gfx_root, deps);
+
+            if (WriteIfChanged(make_outfile, FormatMakeRules(deps, make_outfile, false)))
+                written++;
         }
-        output << '\n';
+    };
 
-        // Dummy rules
-        // If a dependency is deleted, make will try to make it, instead of rescanning the dependencies before trying to do that.
-        for (const std::string &path : dependencies)
+    if (jobs <= 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < jobs; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    std::fprintf(stderr, "scaninc: updated %d of %zu dependency files\n", written.load(), sources.size());
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> includeDirs;
+
+    bool makeformat = false;
+    std::string make_outfile;
+    std::string gfx_root;
+    std::string batch_objdir;
+    int jobs = 0;
+
+    argc--;
+    argv++;
+
+    while (argc > 0 && argv[0][0] == '-')
+    {
+        std::string arg(argv[0]);
+        if (arg.substr(0, 2) == "-I")
         {
-            output << path << ":\n";
+            std::string includeDir = arg.substr(2);
+            if (includeDir.empty())
+            {
+                if (argc < 2)
+                    FATAL_ERROR(USAGE);
+                argc--;
+                argv++;
+                includeDir = std::string(argv[0]);
+            }
+            if (!includeDir.empty() && includeDir.back() != '/')
+            {
+                includeDir += '/';
+            }
+            includeDirs.push_back(includeDir);
         }
+        else if (arg.length() == 2 && (arg[1] == 'M' || arg[1] == 'g' || arg[1] == 'B' || arg[1] == 'j'))
+        {
+            if (argc < 2)
+                FATAL_ERROR(USAGE);
+            argc--;
+            argv++;
+            std::string value(argv[0]);
 
-        // Graphics rules
-        // GNU make will issue a warning if there is more than one
-        // recipe for a target. This would occur whenever a target is
-        // 'INCGFX'ed multiple times, which is something that happens a
-        // few times in vanilla. As a workaround, we define a variable
-        // with the target's name sanitized and only emit the recipe if
-        // the target is not yet defined. This is safe, because
-        // targets with the same name necessarily have the same recipe.
-        for (auto gfx_rule : dependencies_gfx_rules)
+            switch (arg[1])
+            {
+            case 'M':
+                makeformat = true;
+                make_outfile = value;
+                break;
+            case 'g':
+                gfx_root = value;
+                break;
+            case 'B':
+                batch_objdir = value;
+                break;
+            case 'j':
+                jobs = std::atoi(value.c_str());
+                break;
+            }
+        }
+        else
         {
-            std::string gfx_var_name = gfx_rule.first;
-            gfx_var_name.erase(
-                std::remove_if(
-                    gfx_var_name.begin(), 
-                    gfx_var_name.end(), 
-                    [] (char c) { return c == '#' || c == ':' || c == '='; } // invalid chars in GNU Make variables
-                ), gfx_var_name.end()
-            );
-            
-            output
-                << "ifndef " << gfx_var_name << "\n"
-                << gfx_var_name << " := defined\n"
-                << gfx_rule.first << ": " << gfx_rule.second.first << "\n" << gfx_rule.second.second
-                << "endif\n";
+            FATAL_ERROR(USAGE);
         }
+        argc--;
+        argv++;
+    }
+
+    if (gfx_root.empty()) gfx_root = "./";
+    if (gfx_root[gfx_root.length() - 1] != '/') gfx_root.push_back('/');
+
+    if (!batch_objdir.empty())
+    {
+        if (makeformat || argc < 1)
+            FATAL_ERROR(USAGE);
+        if (batch_objdir.back() != '/')
+            batch_objdir += '/';
+
+        RunBatch(std::vector<std::string>(argv, argv + argc), batch_objdir, includeDirs, gfx_root, jobs);
+        return 0;
+    }
+
+    if (argc != 1) {
+        FATAL_ERROR(USAGE);
+    }
 
+    DependencyScanner scanner(includeDirs);
+    Dependencies deps;
+    CollectDependencies(scanner, std::string(argv[0]), gfx_root, deps);
+
+    if (!makeformat)
+    {
+        for (const std::string &path : deps.all)
+        {
+            std::printf("%s\n", path.c_str());
+        }
+        std::cout << std::endl;
+    }
+    else
+    {
+        // Write out make rules to a file
+        std::ofstream output(make_outfile);
+        output << FormatMakeRules(deps, make_outfile, true);
         output.flush();
         output.close();
     }
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Times wav2agb on a synthetic mono sample in each supported sample format
+# (8, 16, 24 and 32 bit PCM, 32 and 64 bit float), so changes to the wav
+# reader can be measured per bit depth. Set WAV2AGB_BASE to another wav2agb
+# binary to time it too and check that both produce the same output.
+# Usage: bench_wav_reader.sh [SECONDS] [WAV2AGB_FLAGS...]
+
+SECONDS_OF_AUDIO=${1:-60}
+[ $# -gt 0 ] && shift
+FLAGS=${*:--b}
+WAV2AGB=${WAV2AGB:-$(dirname "$0")/wav2agb}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+python3 - "$TMP" "$SECONDS_OF_AUDIO" <<'EOF' || exit 1
+import math, struct, sys
+
+out_dir, seconds = sys.argv[1], int(sys.argv[2])
+rate = 13379
+count = rate * seconds
+# A chirp plus a little deterministic noise, so every format sees varied samples.
+signal = [0.8 * math.sin(2 * math.pi * (110 + i * 0.05) * i / rate)
+          + 0.1 * (((i * 2654435761) & 0xFFFF) / 32768.0 - 1.0) for i in range(count)]
+
+formats = [
+    ("u8", 1, 8, lambda s: struct.pack("<B", max(0, min(255, int(s * 128 + 128))))),
+    ("s16", 1, 16, lambda s: struct.pack("<h", max(-32768, min(32767, int(s * 32768))))),
+    ("s24", 1, 24, lambda s: struct.pack("<i", max(-8388608, min(8388607, int(s * 8388608))))[:3]),
+    ("s32", 1, 32, lambda s: struct.pack("<i", max(-2**31, min(2**31 - 1, int(s * 2**31))))),
+    ("f32", 3, 32, lambda s: struct.pack("<f", s)),
+    ("f64", 3, 64, lambda s: struct.pack("<d", s)),
+]
+
+for name, tag, bits, pack in formats:
+    data = b"".join(pack(s) for s in signal)
+    block = bits // 8
+    fmt = struct.pack("<HHIIHH", tag, 1, rate, rate * block, block, bits)
+    with open("%s/%s.wav" % (out_dir, name), "wb") as f:
+        f.write(b"RIFF" + struct.pack("<I", 4 + 8 + len(fmt) + 8 + len(data)) + b"WAVE")
+        f.write(b"fmt " + struct.pack("<I", len(fmt)) + fmt)
+        f.write(b"data" + struct.pack("<I", len(data)) + data)
+EOF
+
+now_us() {
+    python3 -c 'import time; print(int(time.time() * 1000000))'
+}
+
+run() {
+    start=$(now_us)
+    # shellcheck disable=SC2086
+    "$1" $FLAGS "$2" "$3" >/dev/null || exit 1
+    echo $(($(now_us) - start))
+}
+
+mkdir -p "$TMP/new" "$TMP/base"
+for fmt in u8 s16 s24 s32 f32 f64; do
+    wav="$TMP/$fmt.wav"
+    size=$(wc -c < "$wav")
+    us=$(run "$WAV2AGB" "$wav" "$TMP/new/$fmt.out")
+    line="$fmt: $size bytes in $us us"
+    if [ -n "$WAV2AGB_BASE" ]; then
+        base_us=$(run "$WAV2AGB_BASE" "$wav" "$TMP/base/$fmt.out")
+        line="$line (base $base_us us)"
+        cmp -s "$TMP/new/$fmt.out" "$TMP/base/$fmt.out" || line="$line OUTPUT DIFFERS"
+    fi
+    echo "$line"
+done
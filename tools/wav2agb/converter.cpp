@@ -2,8 +2,11 @@
 
 #include <stdexcept>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <vector>
+#include <atomic>
+#include <thread>
 
 #include <cmath>
 #include <cstdarg>
@@ -13,7 +16,7 @@
 
 #include "wav_file.h"
 
-static void agb_out(std::ofstream& ofs, const char *msg, ...) {
+static void agb_out(std::ostream& ofs, const char *msg, ...) {
     char buf[256];
     va_list args;
     va_start(args, msg);
@@ -22,7 +25,7 @@ static void agb_out(std::ofstream& ofs, const char *msg, ...) {
     ofs << buf;
 }
 
-static void data_write(std::ofstream& ofs, uint32_t& block_pos, int data, bool hex) {
+static void data_write(std::ostream& ofs, uint32_t& block_pos, int data, bool hex) {
     if (block_pos++ == 0) {
         if (hex)
             agb_out(ofs, "\n    .byte   0x%02X", data);
@@ -53,17 +56,21 @@ const T& clamp(const T& v, const T& lo, const T& hi) {
     return (v < lo) ? lo : (hi < v) ? hi : v;
 }
 
-static void convert_uncompressed(wav_file& wf, std::ofstream& ofs)
+// Samples are converted this many at a time.
+static const size_t READ_CHUNK_SIZE = 4096;
+
+static void convert_uncompressed(const wav_file& wf, std::ostream& ofs)
 {
     int loop_sample = 0;
 
     uint32_t block_pos = 0;
+    double ds[READ_CHUNK_SIZE];
 
     for (size_t i = 0; i < wf.loopEnd; i++) {
-        double ds;
-        wf.readData(i, &ds, 1);
+        if (i % READ_CHUNK_SIZE == 0)
+            wf.readData(i, ds, std::min<size_t>(READ_CHUNK_SIZE, wf.loopEnd - i));
         // TODO apply dither noise
-        int s = clamp(static_cast<int>(floor(ds * 128.0)), -128, 127);
+        int s = clamp(static_cast<int>(floor(ds[i % READ_CHUNK_SIZE] * 128.0)), -128, 127);
 
         if (wf.loopEnabled && i == wf.loopStart)
             loop_sample = s;
@@ -74,13 +81,15 @@ static void convert_uncompressed(wav_file& wf, std::ofstream& ofs)
     data_write(ofs, block_pos, loop_sample, false);
 }
 
-static void convert_uncompressed_bin(wav_file& wf, std::vector<uint8_t>& data)
+static void convert_uncompressed_bin(const wav_file& wf, std::vector<uint8_t>& data)
 {
+    double ds[READ_CHUNK_SIZE];
+
     for (size_t i = 0; i < wf.loopEnd; i++) {
-        double ds;
-        wf.readData(i, &ds, 1);
+        if (i % READ_CHUNK_SIZE == 0)
+            wf.readData(i, ds, std::min<size_t>(READ_CHUNK_SIZE, wf.loopEnd - i));
         // TODO apply dither noise
-        int s = clamp(static_cast<int>(floor(ds * 128.0)), -128, 127);
+        int s = clamp(static_cast<int>(floor(ds[i % READ_CHUNK_SIZE] * 128.0)), -128, 127);
 
         bin_write_u8(data, static_cast<uint8_t>(s));
     }
@@ -104,6 +113,12 @@ static bool wav_rate_override = false;
 
 static bool dpcm_verbose = false;
 static bool dpcm_lookahead_fast = false;
+static bool dpcm_trellis = false;
+static size_t dpcm_jobs = 0;
+// Blocks are only spread over threads in runs of at least this many, so
+// short samples don't pay for starting threads.
+static const size_t DPCM_MIN_BLOCKS_PER_JOB = 16;
+static bool skip_unchanged_outputs = false;
 static bool dpcm_include_padding = true;
 static size_t dpcm_enc_lookahead = 3;
 static const size_t DPCM_BLK_SIZE = 0x40;
@@ -162,7 +177,7 @@ static void dpcm_lookahead(
     minimumError = std::numeric_limits<int>::max();
     minimumErrorIndex = dpcmLookupTable.size();
     const int s = clamp(static_cast<int>(floor(sampleBuf[0] * 128.0)), -128, 127);
-    const std::vector<size_t> indexCandicateSet = dpcm_lookahead_fast? dpcmFastLookupTable[s - prevLevel + 255]: dpcmIndexTable;
+    const std::vector<size_t>& indexCandicateSet = dpcm_lookahead_fast? dpcmFastLookupTable[s - prevLevel + 255]: dpcmIndexTable;
 
     for (auto i : indexCandicateSet) {
         int newLevel = prevLevel + dpcmLookupTable[i];
@@ -189,104 +204,195 @@ static void dpcm_lookahead(
     }
 }
 
-static double calculate_snr(const std::vector<double>& uncompressedData, const std::vector<int>& decompressedData)
+// Finds the indices that minimise the total squared error of samples
+// 1..count-1 of a block, by dynamic programming over the 256 decoder levels:
+// each step keeps the cheapest path reaching every level, so the whole
+// block is searched in O(count * 256 * 16) rather than exponentially in the
+// lookahead.
+static void dpcm_encode_block_trellis(const double *ds, int initialLevel, size_t count, size_t *indices)
 {
-    int sum_son = 0;
-    int sum_mum = 0;
+    static const int LEVELS = 256;
+    static const int UNREACHABLE = std::numeric_limits<int>::max();
 
-    assert(uncompressedData.size() == decompressedData.size());
+    int cost[LEVELS];
+    int nextCost[LEVELS];
+    uint8_t choice[DPCM_BLK_SIZE][LEVELS];
 
-    for (size_t i = 0; i < uncompressedData.size(); i++) {
-        const int s = clamp(static_cast<int>(floor(uncompressedData[i] * 128.0)), -128, 127) + 128;
-        sum_son += s * s;
-        const int sub = decompressedData[i] + 128 - s;
-        sum_mum += sub * sub;
-    }
+    std::fill(std::begin(cost), std::end(cost), UNREACHABLE);
+    cost[initialLevel + 128] = 0;
 
-    if (sum_mum == 0) {
-        return 100;
+    for (size_t j = 1; j < count; j++) {
+        // TODO apply dither noise
+        const int s = clamp(static_cast<int>(floor(ds[j] * 128.0)), -128, 127);
+
+        std::fill(std::begin(nextCost), std::end(nextCost), UNREACHABLE);
+
+        for (int prev = 0; prev < LEVELS; prev++) {
+            if (cost[prev] == UNREACHABLE)
+                continue;
+            for (size_t i = 0; i < dpcmLookupTable.size(); i++) {
+                int next = prev + dpcmLookupTable[i];
+                if (next < 0 || next >= LEVELS)
+                    continue;
+                int error = cost[prev] + squared(s - (next - 128));
+                if (error < nextCost[next]) {
+                    nextCost[next] = error;
+                    choice[j][next] = static_cast<uint8_t>(i);
+                }
+            }
+        }
+
+        std::copy(std::begin(nextCost), std::end(nextCost), std::begin(cost));
     }
 
-    return 10 * std::log10((double)sum_son / sum_mum);
+    int level = static_cast<int>(std::min_element(std::begin(cost), std::end(cost)) - std::begin(cost));
+    for (size_t j = count - 1; j >= 1; j--) {
+        indices[j] = choice[j][level];
+        level -= dpcmLookupTable[indices[j]];
+    }
 }
 
-template<typename InitialSampleWriter, typename CompressedDataWriter>
-static void convert_dpcm_impl(wav_file& wf, InitialSampleWriter writeInitialSample, CompressedDataWriter writeCompressedData)
+// Greedy search: each sample takes the first step of the best path over the
+// next dpcm_enc_lookahead samples.
+static void dpcm_encode_block_lookahead(const double *ds, int initialLevel, size_t count, size_t *indices)
 {
     int minimumError;
-    size_t minimumErrorIndex;
+    int s = initialLevel;
+
+    for (size_t j = 1; j < count; j++) {
+        size_t sampleBufReadLen = std::min(dpcm_enc_lookahead, DPCM_BLK_SIZE - j);
+        dpcm_lookahead(minimumError, indices[j], &ds[j], sampleBufReadLen, s);
+        s += dpcmLookupTable[indices[j]];
+    }
+}
 
-    std::vector<double> uncompressedData;
-    std::vector<int> decompressedData;
+struct dpcm_block {
+    int initialSample;
+    // Samples encoded, including the initial one.
+    size_t count;
+    size_t indices[DPCM_BLK_SIZE];
+};
 
-    const auto startTime = std::chrono::high_resolution_clock::now();
+static void dpcm_encode_block(const double *ds, size_t samplesLeft, bool trellis, dpcm_block& block)
+{
+    // TODO apply dither noise
+    block.initialSample = clamp(static_cast<int>(floor(ds[0] * 128.0)), -128, 127);
+    block.count = dpcm_include_padding ? DPCM_BLK_SIZE : std::min(DPCM_BLK_SIZE, samplesLeft);
 
-    for (size_t i = 0; i < wf.loopEnd; i += DPCM_BLK_SIZE) {
+    if (trellis)
+        dpcm_encode_block_trellis(ds, block.initialSample, block.count, block.indices);
+    else
+        dpcm_encode_block_lookahead(ds, block.initialSample, block.count, block.indices);
+}
+
+// Reads block b, padding it with zeros past the end of the sample.
+static void dpcm_read_block(const wav_file& wf, size_t b, double *ds)
+{
+    size_t start = b * DPCM_BLK_SIZE;
+    size_t samples_in_block = std::min<size_t>(DPCM_BLK_SIZE, wf.loopEnd - start);
+    wf.readData(start, ds, samples_in_block);
+    std::fill(ds + samples_in_block, ds + DPCM_BLK_SIZE, 0.0);
+}
+
+static std::vector<dpcm_block> dpcm_encode(const wav_file& wf, bool trellis)
+{
+    std::vector<dpcm_block> blocks((wf.loopEnd + DPCM_BLK_SIZE - 1) / DPCM_BLK_SIZE);
+
+    // Every block starts from an absolute sample, so they can be encoded in
+    // any order: each thread takes the next unclaimed block until none are
+    // left, and the results land in their own slots.
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t b;
         double ds[DPCM_BLK_SIZE];
-        size_t samples_in_block = std::min(DPCM_BLK_SIZE, wf.loopEnd - i);
-        wf.readData(i, ds, samples_in_block);
-        // Pad remaining samples in block with zeros if needed
-        for (size_t j = samples_in_block; j < DPCM_BLK_SIZE; j++) {
-            ds[j] = 0.0;
-        }
-        if (dpcm_verbose) {
-            uncompressedData.insert(uncompressedData.end(), std::begin(ds), std::end(ds));
+        while ((b = next++) < blocks.size()) {
+            dpcm_read_block(wf, b, ds);
+            dpcm_encode_block(ds, wf.loopEnd - b * DPCM_BLK_SIZE, trellis, blocks[b]);
         }
-        // TODO apply dither noise
-        int s = clamp(static_cast<int>(floor(ds[0] * 128.0)), -128, 127);
+    };
+
+    size_t jobs = dpcm_jobs != 0 ? dpcm_jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, std::max<size_t>(1, blocks.size() / DPCM_MIN_BLOCKS_PER_JOB));
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < jobs; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    return blocks;
+}
 
-        writeInitialSample(s);
-        if (dpcm_verbose) {
-            decompressedData.push_back(s);
+static double calculate_snr(const wav_file& wf, const std::vector<dpcm_block>& blocks)
+{
+    int64_t sum_son = 0;
+    int64_t sum_mum = 0;
+    double ds[DPCM_BLK_SIZE];
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        dpcm_read_block(wf, b, ds);
+        int level = blocks[b].initialSample;
+        for (size_t j = 0; j < blocks[b].count; j++) {
+            if (j > 0)
+                level += dpcmLookupTable[blocks[b].indices[j]];
+            const int s = clamp(static_cast<int>(floor(ds[j] * 128.0)), -128, 127) + 128;
+            sum_son += s * s;
+            const int sub = level + 128 - s;
+            sum_mum += sub * sub;
         }
+    }
 
-        size_t innerLoopCount = 1;
-        size_t samples_to_process = dpcm_include_padding ? DPCM_BLK_SIZE : samples_in_block;
-        uint8_t outData = 0;
-        size_t sampleBufReadLen;
-
-        goto initial_loop_enter;
-
-        do {
-            if (innerLoopCount >= samples_to_process)
-                break;
-            sampleBufReadLen = std::min(dpcm_enc_lookahead, DPCM_BLK_SIZE - innerLoopCount);
-            dpcm_lookahead(
-                    minimumError, minimumErrorIndex,
-                    &ds[innerLoopCount], sampleBufReadLen, s);
-            outData = static_cast<uint8_t>((minimumErrorIndex & 0xF) << 4);
-            s += dpcmLookupTable[minimumErrorIndex];
-            if (dpcm_verbose) {
-                decompressedData.push_back(s);
-            }
-            innerLoopCount += 1;
-initial_loop_enter:
-            if (innerLoopCount >= samples_to_process)
-                break;
-            sampleBufReadLen = std::min(dpcm_enc_lookahead, DPCM_BLK_SIZE - innerLoopCount);
-            dpcm_lookahead(
-                    minimumError, minimumErrorIndex,
-                    &ds[innerLoopCount], sampleBufReadLen, s);
-            outData |= static_cast<uint8_t>(minimumErrorIndex & 0xF);
-            s += dpcmLookupTable[minimumErrorIndex];
-            innerLoopCount += 1;
-            if (dpcm_verbose) {
-                decompressedData.push_back(s);
-            }
-            writeCompressedData(outData);
-        } while (innerLoopCount < DPCM_BLK_SIZE);
+    if (sum_mum == 0) {
+        return 100;
     }
 
+    return 10 * std::log10((double)sum_son / sum_mum);
+}
+
+static std::vector<dpcm_block> dpcm_encode_timed(const wav_file& wf, bool trellis, double& durSecs)
+{
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    std::vector<dpcm_block> blocks = dpcm_encode(wf, trellis);
     const auto endTime = std::chrono::high_resolution_clock::now();
 
+    const auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime);
+    durSecs = static_cast<double>(dur.count()) / 1000000000.0;
+    return blocks;
+}
+
+template<typename InitialSampleWriter, typename CompressedDataWriter>
+static void convert_dpcm_impl(const wav_file& wf, InitialSampleWriter writeInitialSample, CompressedDataWriter writeCompressedData)
+{
+    double durSecs;
+    std::vector<dpcm_block> blocks = dpcm_encode_timed(wf, dpcm_trellis, durSecs);
+
     if (dpcm_verbose) {
-        const auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime);
-        const double durSecs = static_cast<double>(dur.count()) / 1000000000.0;
-        printf("SNR: %.2fdB, run time: %.2fs\n", calculate_snr(uncompressedData, decompressedData), durSecs);
+        // Run the other encoder too, so the two can be compared.
+        double otherDurSecs;
+        std::vector<dpcm_block> otherBlocks = dpcm_encode_timed(wf, !dpcm_trellis, otherDurSecs);
+
+        const std::vector<dpcm_block>& lookaheadBlocks = dpcm_trellis ? otherBlocks : blocks;
+        const std::vector<dpcm_block>& trellisBlocks = dpcm_trellis ? blocks : otherBlocks;
+        printf("lookahead %zu%s: SNR: %.2fdB, run time: %.2fs%s\n", dpcm_enc_lookahead, dpcm_lookahead_fast ? " fast" : "",
+            calculate_snr(wf, lookaheadBlocks), dpcm_trellis ? otherDurSecs : durSecs, dpcm_trellis ? "" : " (used)");
+        printf("trellis: SNR: %.2fdB, run time: %.2fs%s\n",
+            calculate_snr(wf, trellisBlocks), dpcm_trellis ? durSecs : otherDurSecs, dpcm_trellis ? " (used)" : "");
+    }
+
+    // The first byte holds the second sample in its low nibble; after that
+    // each byte holds two samples, high nibble first. A byte is only written
+    // once both of its samples are encoded.
+    for (const dpcm_block& block : blocks) {
+        writeInitialSample(block.initialSample);
+        if (block.count > 1)
+            writeCompressedData(static_cast<uint8_t>(block.indices[1] & 0xF));
+        for (size_t j = 2; j + 1 < block.count; j += 2)
+            writeCompressedData(static_cast<uint8_t>(((block.indices[j] & 0xF) << 4) | (block.indices[j + 1] & 0xF)));
     }
 }
 
-static void convert_dpcm(wav_file& wf, std::ofstream& ofs)
+static void convert_dpcm(const wav_file& wf, std::ostream& ofs)
 {
     uint32_t block_pos = 0;
     convert_dpcm_impl(wf,
@@ -294,7 +400,7 @@ static void convert_dpcm(wav_file& wf, std::ofstream& ofs)
         [&](uint8_t outData) { data_write(ofs, block_pos, outData, true); });
 }
 
-static void convert_dpcm_bin(wav_file& wf, std::vector<uint8_t>& data)
+static void convert_dpcm_bin(const wav_file& wf, std::vector<uint8_t>& data)
 {
     convert_dpcm_impl(wf,
         [&](int s) { bin_write_u8(data, static_cast<uint8_t>(s)); },
@@ -311,6 +417,21 @@ void enable_dpcm_lookahead_fast()
     dpcm_lookahead_fast = true;
 }
 
+void enable_dpcm_trellis()
+{
+    dpcm_trellis = true;
+}
+
+void set_dpcm_jobs(size_t jobs)
+{
+    dpcm_jobs = jobs;
+}
+
+void enable_skip_unchanged_outputs()
+{
+    skip_unchanged_outputs = true;
+}
+
 void disable_dpcm_padding()
 {
     dpcm_include_padding = false;
@@ -351,6 +472,29 @@ void set_wav_rate(uint32_t rate)
     wav_rate_override = true;
 }
 
+static void write_output(const std::string& out_file_str, const std::string& data, bool binary)
+{
+    const std::ios::openmode mode = binary ? std::ios::binary : std::ios::openmode();
+
+    if (skip_unchanged_outputs) {
+        std::ifstream existing(out_file_str, std::ios::in | mode);
+        if (existing.is_open()) {
+            std::ostringstream current;
+            current << existing.rdbuf();
+            if (current.str() == data)
+                return;
+        }
+    }
+
+    std::ofstream fout(out_file_str, std::ios::out | mode);
+    if (!fout.is_open()) {
+        perror("ofstream");
+        throw std::runtime_error("unable to open output file");
+    }
+    fout.write(data.data(), data.size());
+    fout.close();
+}
+
 void convert(const std::string& wav_file_str, const std::string& out_file_str,
         const std::string& sym, cmp_type ct, out_type ot)
 {
@@ -430,20 +574,10 @@ void convert(const std::string& wav_file_str, const std::string& out_file_str,
             throw std::runtime_error("convert: invalid compression type");
 
         // Write binary file
-        std::ofstream fout(out_file_str, std::ios::out | std::ios::binary);
-        if (!fout.is_open()) {
-            perror("ofstream");
-            throw std::runtime_error("unable to open output file");
-        }
-        fout.write(reinterpret_cast<const char*>(bin_data.data()), bin_data.size());
-        fout.close();
+        write_output(out_file_str, std::string(bin_data.begin(), bin_data.end()), true);
     } else {
         // Assembly output mode
-        std::ofstream fout(out_file_str, std::ios::out);
-        if (!fout.is_open()) {
-            perror("ofstream");
-            throw std::runtime_error("unable to open output file");
-        }
+        std::ostringstream fout;
 
         agb_out(fout, "    .section .rodata\n");
         agb_out(fout, "    .global %s\n", sym.c_str());
@@ -461,6 +595,6 @@ void convert(const std::string& wav_file_str, const std::string& out_file_str,
             throw std::runtime_error("convert: invalid compression type");
 
         agb_out(fout, "\n\n    .end\n");
-        fout.close();
+        write_output(out_file_str, fout.str(), false);
     }
 }
@@ -14,6 +14,9 @@ enum class out_type {
 
 void enable_dpcm_verbose();
 void enable_dpcm_lookahead_fast();
+void enable_dpcm_trellis();
+void set_dpcm_jobs(size_t jobs);
+void enable_skip_unchanged_outputs();
 void disable_dpcm_padding();
 void set_dpcm_lookahead(size_t lookahead);
 void set_wav_loop_start(uint32_t start);
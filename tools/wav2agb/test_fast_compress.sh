@@ -7,3 +7,6 @@ do
     echo lookahead="$l" fast:
     wav2agb "$1" -f -l "$l" --verbose
 done
+
+echo trellis:
+wav2agb "$1" -t --verbose
@@ -5,6 +5,9 @@
 #include <cassert>
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
 
 #include "converter.h"
 #include "wav_file.h"
@@ -13,12 +16,14 @@ static void usage() {
     fprintf(stderr, "wav2agb\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Usage: wav2agb [options] <input.wav> [<output>]\n");
+    fprintf(stderr, "       wav2agb --batch [options] <input.wav>...\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "-s, --symbol <sym>       | symbol name for wave header (default: file name)\n");
     fprintf(stderr, "-l, --lookahead <amount> | DPCM compression lookahead 1..8 (default: 3)\n");
     fprintf(stderr, "-c, --compress           | compress output with DPCM\n");
     fprintf(stderr, "-f, --fast-compress      | compress output with DPCM fast\n");
+    fprintf(stderr, "-t, --trellis            | compress output with DPCM, minimum error per block\n");
     fprintf(stderr, "--no-pad                 | omit trailing padding in compressed output\n");
     fprintf(stderr, "-b, --binary             | output raw binary instead of assembly\n");
     fprintf(stderr, "--loop-start <pos>       | override loop start (integer)\n");
@@ -27,6 +32,8 @@ static void usage() {
     fprintf(stderr, "--key <key>              | override midi key (int)\n");
     fprintf(stderr, "--rate <rate>            | override base samplerate (int)\n");
     fprintf(stderr, "--set-agbl <loop-end>    | adds the custom agbl chunk to the given input .wav file\n");
+    fprintf(stderr, "--batch                  | convert every input next to itself, leaving unchanged outputs alone\n");
+    fprintf(stderr, "-j, --jobs <amount>      | number of threads (default: one per core)\n");
     exit(1);
 }
 
@@ -110,6 +117,58 @@ static std::string arg_input_file;
 static std::string arg_output_file;
 static bool arg_set_agbl = false;
 static int32_t arg_agbl_value = 0;
+static bool arg_batch = false;
+static std::vector<std::string> arg_batch_files;
+static size_t arg_jobs = 0;
+
+static std::string default_output_file(const std::string& input_file) {
+    if (arg_output_type == out_type::binary)
+        return filename_without_ext(input_file) + ".bin";
+    return filename_without_ext(input_file) + ".s";
+}
+
+static std::string default_symbol(const std::string& output_file) {
+    std::string sym = filename_without_dir(filename_without_ext(output_file));
+    fix_str(sym);
+    return sym;
+}
+
+// Converts the files on a pool of threads, each taking the next file when
+// it finishes one. The files are spread over the threads rather than their
+// blocks, so each conversion runs single-threaded.
+static int convert_batch() {
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+
+    set_dpcm_jobs(1);
+    enable_skip_unchanged_outputs();
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < arg_batch_files.size()) {
+            const std::string& input_file = arg_batch_files[i];
+            std::string output_file = default_output_file(input_file);
+            try {
+                convert(input_file, output_file, default_symbol(output_file), arg_compress, arg_output_type);
+            } catch (const std::exception& e) {
+                fprintf(stderr, "%s: %s\n", input_file.c_str(), e.what());
+                failed = true;
+            }
+        }
+    };
+
+    size_t jobs = arg_jobs != 0 ? arg_jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min(jobs, arg_batch_files.size());
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < jobs; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    return failed ? 1 : 0;
+}
 
 int main(int argc, char *argv[]) {
     try {
@@ -128,6 +187,9 @@ int main(int argc, char *argv[]) {
             } else if (st == "-f" || st == "--compress-fast") {
                 arg_compress = cmp_type::dpcm;
                 enable_dpcm_lookahead_fast();
+            } else if (st == "-t" || st == "--trellis") {
+                arg_compress = cmp_type::dpcm;
+                enable_dpcm_trellis();
             } else if (st == "--no-pad") {
                 disable_dpcm_padding();
             } else if (st == "-b" || st == "--binary") {
@@ -167,6 +229,13 @@ int main(int argc, char *argv[]) {
                     die("--rate: missing parameter");
                 uint32_t rate = static_cast<uint32_t>(std::stoul(argv[i], nullptr, 10));
                 set_wav_rate(rate);
+            } else if (st == "--batch") {
+                arg_batch = true;
+            } else if (st == "-j" || st == "--jobs") {
+                if (++i >= argc)
+                    die("-j: missing parameter\n");
+                arg_jobs = std::stoul(argv[i], nullptr, 10);
+                set_dpcm_jobs(arg_jobs);
             } else if (st == "--set-agbl") {
                 if (++i >= argc)
                     die("--set-agbl: missing parameter");
@@ -177,7 +246,9 @@ int main(int argc, char *argv[]) {
                     if (++i >= argc)
                         die("--: missing file name\n");
                 }
-                if (!arg_input_file_read) {
+                if (arg_batch) {
+                    arg_batch_files.push_back(argv[i]);
+                } else if (!arg_input_file_read) {
                     arg_input_file = argv[i];
                     if (arg_input_file.size() < 1)
                         die("empty input file name\n");
@@ -193,6 +264,14 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        if (arg_batch) {
+            if (arg_set_agbl || arg_sym.size() != 0)
+                die("--batch can't be combined with --set-agbl or -s\n");
+            if (arg_batch_files.empty())
+                die("No input files specified\n");
+            return convert_batch();
+        }
+
         // check arguments
         if (!arg_input_file_read) {
             die("No input file specified\n");
@@ -202,22 +281,19 @@ int main(int argc, char *argv[]) {
             // create output file name if none is provided
             if (arg_set_agbl) {
                 arg_output_file = arg_input_file;
-            } else if (arg_output_type == out_type::binary) {
-                arg_output_file = filename_without_ext(arg_input_file) + ".bin";
             } else {
-                arg_output_file = filename_without_ext(arg_input_file) + ".s";
+                arg_output_file = default_output_file(arg_input_file);
             }
             arg_output_file_read = true;
         }
 
         if (arg_sym.size() == 0) {
-            arg_sym = filename_without_dir(filename_without_ext(arg_output_file));
-            fix_str(arg_sym);
+            arg_sym = default_symbol(arg_output_file);
         }
 
         if (arg_set_agbl) {
             // Parse the WAV file once to get both chunks and metadata
-            wav_file wav(arg_input_file);
+            wav_file wav(arg_input_file, true);
 
             // Calculate actual loop-end value
             uint32_t loop_end_value;
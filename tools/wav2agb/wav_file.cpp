@@ -6,13 +6,18 @@
 #include <algorithm>
 #include <fstream>
 
-static uint32_t read_u32(std::ifstream& ifs)
-{
-    uint8_t lenBytes[4];
-    ifs.read(reinterpret_cast<char *>(lenBytes), sizeof(lenBytes));
-    uint32_t retval = lenBytes[0] | (lenBytes[1] << 8) | (lenBytes[2] << 16) | (lenBytes[3] << 24);
-    return retval;
-}
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 static void write_u32(std::ofstream& ofs, uint32_t value)
 {
@@ -24,43 +29,23 @@ static void write_u32(std::ofstream& ofs, uint32_t value)
     ofs.write(reinterpret_cast<char *>(bytes), sizeof(bytes));
 }
 
-//static uint16_t read_u16(std::ifstream& ifs)
-//{
-//    uint8_t lenBytes[2];
-//    ifs.read(reinterpret_cast<char *>(lenBytes), sizeof(lenBytes));
-//    uint16_t retval = uint16_t(lenBytes[0] | (lenBytes[1] << 8));
-//    return retval;
-//}
-
-static std::string read_str(std::ifstream& ifs, size_t len)
-{
-    std::vector<char> buf(len);
-    ifs.read(buf.data(), buf.size());
-    return std::string(buf.data(), buf.size());
-}
-
-static std::vector<uint8_t> read_arr(std::ifstream& ifs, size_t len)
+static uint16_t arr_u16(const uint8_t *arr, size_t size, size_t pos)
 {
-    std::vector<uint8_t> buf(len);
-    ifs.read(reinterpret_cast<char *>(buf.data()), buf.size());
-    return buf;
-}
-
-static uint16_t arr_u16(const std::vector<uint8_t>& arr, size_t pos)
-{
-    uint16_t val = uint16_t(arr.at(pos) | (arr.at(pos + 1) << 8));
+    if (pos + 2 > size)
+        throw std::out_of_range("ERROR: chunk too short");
+    uint16_t val = uint16_t(arr[pos] | (arr[pos + 1] << 8));
     return val;
 }
 
-static uint32_t arr_u32(const std::vector<uint8_t>& arr, size_t pos)
+static uint32_t arr_u32(const uint8_t *arr, size_t size, size_t pos)
 {
-    uint32_t val = uint32_t(arr.at(pos) | (arr.at(pos + 1) << 8) |
-            (arr.at(pos + 2) << 16) | (arr.at(pos + 3) << 24));
+    if (pos + 4 > size)
+        throw std::out_of_range("ERROR: chunk too short");
+    uint32_t val = uint32_t(arr[pos] | (arr[pos + 1] << 8) |
+            (arr[pos + 2] << 16) | (uint32_t(arr[pos + 3]) << 24));
     return val;
 }
 
-static const size_t loadChunkSize = 2048;
-
 uint32_t wav_file::fmt_size() const
 {
     if (fmt == format_type::u8)
@@ -79,58 +64,83 @@ uint32_t wav_file::fmt_size() const
         throw std::runtime_error("INTERNAL ERROR: invalid format type");
 }
 
-wav_file::wav_file(const std::string& path) : loadBuffer(loadChunkSize)
+wav_file::wav_file(const std::string& path, bool keepChunks)
 {
-    ifs.exceptions(std::ios::badbit | std::ios::eofbit);
-    ifs.open(path, std::ios::binary);
-    if (!ifs.good())
-        throw std::runtime_error("failed to open file: " + path + ", reason: " + strerror(errno));
+#ifdef _WIN32
+    std::ifstream ifs(path, std::ios::binary);
     if (!ifs.is_open())
         throw std::runtime_error("failed to open file: " + path + ", reason: " + strerror(errno));
+    ownedData.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    fileData = ownedData.data();
+    fileSize = ownedData.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("failed to open file: " + path + ", reason: " + strerror(errno));
 
-    ifs.seekg(0, ifs.end);
-    std::streampos len = ifs.tellg();
-    ifs.seekg(0, ifs.beg);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("failed to open file: " + path + ", reason: " + strerror(err));
+    }
+
+    fileSize = st.st_size;
+    if (fileSize > 0) {
+        void *mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            throw std::runtime_error("failed to map file: " + path + ", reason: " + strerror(err));
+        }
+        mappedData = mapped;
+        fileData = static_cast<const uint8_t *>(mapped);
+    }
+    close(fd);
+#endif
+
+    const size_t len = fileSize;
 
-    std::string chunkId = read_str(ifs, 4);
-    if (chunkId != "RIFF")
+    if (len < 12 || memcmp(fileData, "RIFF", 4) != 0)
         throw std::runtime_error("RIFF ID invalid");
-    uint32_t mainChunkLen = read_u32(ifs);
-    if (mainChunkLen + 8 != len)
+    uint32_t mainChunkLen = arr_u32(fileData, len, 4);
+    if (size_t(mainChunkLen) + 8 != len)
         throw std::runtime_error("RIFF chunk len (=" +
                 std::to_string(mainChunkLen) +
                 ") doesn't match file len (=" +
                 std::to_string(len) +
                 ")");
-    std::string riffType = read_str(ifs, 4);
-    if (riffType != "WAVE")
+    if (memcmp(fileData + 8, "WAVE", 4) != 0)
         throw std::runtime_error("WAVE ID invalid");
 
     bool dataChunkFound = false;
     bool fmtChunkFound = false;
+    size_t dataChunkLen = 0;
     // search all chunks
-    std::streampos curPos;
-    while ((curPos = ifs.tellg()) + std::streampos(8) <= len) {
-        chunkId = read_str(ifs, 4);
-        uint32_t chunkLen = read_u32(ifs);
-        if (curPos + std::streampos(8) + std::streampos(chunkLen) > len)
+    size_t curPos = 12;
+    while (curPos + 8 <= len) {
+        std::string chunkId(reinterpret_cast<const char *>(fileData + curPos), 4);
+        uint32_t chunkLen = arr_u32(fileData, len, curPos + 4);
+        if (curPos + 8 + size_t(chunkLen) > len)
             throw std::runtime_error("ERROR: chunk goes beyond end of file: offset=" + std::to_string(curPos));
 
-        std::vector<uint8_t> chunkData = read_arr(ifs, chunkLen);
-        WavChunk chunk;
-        chunk.id = chunkId;
-        chunk.data = chunkData;
-        this->chunks.push_back(chunk);
+        const uint8_t *chunkData = fileData + curPos + 8;
+        if (keepChunks) {
+            WavChunk chunk;
+            chunk.id = chunkId;
+            chunk.data.assign(chunkData, chunkData + chunkLen);
+            this->chunks.push_back(chunk);
+        }
 
         if (chunkId == "fmt ") {
             fmtChunkFound = true;
-            uint16_t fmtTag = arr_u16(chunkData, 0);
-            uint16_t numChannels = arr_u16(chunkData, 2);
+            uint16_t fmtTag = arr_u16(chunkData, chunkLen, 0);
+            uint16_t numChannels = arr_u16(chunkData, chunkLen, 2);
             if (numChannels != 1)
                 throw std::runtime_error("ERROR: input file is NOT mono");
-            this->sampleRate = arr_u32(chunkData, 4);
-            uint16_t block_align = arr_u16(chunkData, 12);
-            uint16_t bits_per_sample = arr_u16(chunkData, 14);
+            this->sampleRate = arr_u32(chunkData, chunkLen, 4);
+            uint16_t block_align = arr_u16(chunkData, chunkLen, 12);
+            uint16_t bits_per_sample = arr_u16(chunkData, chunkLen, 14);
             if (fmtTag == 1) {
                 // integer
                 if (block_align == 1 && bits_per_sample == 8)
@@ -156,47 +166,44 @@ wav_file::wav_file(const std::string& path) : loadBuffer(loadChunkSize)
             }
         } else if (chunkId == "data") {
             dataChunkFound = true;
-            // For data chunk, we need to track position in the file for later reading
-            // The data was already read into chunkData and saved to chunks vector
-            // But we need to calculate the position for the readData function
-            // Since we already read the data, we're now past it in the file
-            dataChunkPos = curPos + std::streampos(8); // Skip chunk ID and size
-            dataChunkEndPos = dataChunkPos + std::streampos(chunkLen);
+            sampleData = chunkData;
+            dataChunkLen = chunkLen;
         } else if (chunkId == "smpl") {
-            uint32_t midiUnityNote = arr_u32(chunkData, 12);
+            uint32_t midiUnityNote = arr_u32(chunkData, chunkLen, 12);
             this->midiKey = static_cast<uint8_t>(std::min(midiUnityNote, 127u));
-            uint32_t midiPitchFraction = arr_u32(chunkData, 16);
+            uint32_t midiPitchFraction = arr_u32(chunkData, chunkLen, 16);
             // the values below convert the uint32_t range to 0.0 to 100.0 range
             this->tuning = static_cast<double>(midiPitchFraction) / (4294967296.0 * 100.0);
-            uint32_t numLoops = arr_u32(chunkData, 28);
+            uint32_t numLoops = arr_u32(chunkData, chunkLen, 28);
             if (numLoops > 1)
                 throw std::runtime_error("ERROR: too many loops in smpl chunk");
             if (numLoops == 1) {
-                uint32_t loopType = arr_u32(chunkData, 36 + 4);
+                uint32_t loopType = arr_u32(chunkData, chunkLen, 36 + 4);
                 if (loopType != 0)
                     throw std::runtime_error("ERROR: loop type not supported: " + std::to_string(loopType));
-                this->loopStart = arr_u32(chunkData, 36 + 8);
+                this->loopStart = arr_u32(chunkData, chunkLen, 36 + 8);
                 // sampler chunks tell the last sample to be played (so including rather than excluding), thus +1
-                this->loopEnd = arr_u32(chunkData, 36 + 12) + 1;
+                this->loopEnd = arr_u32(chunkData, chunkLen, 36 + 12) + 1;
                 this->loopEnabled = true;
             }
         } else if (chunkId == "agbp") {
             // Custom chunk: exact GBA pitch value (sample_rate * 1024)
             // This allows perfect round-trip conversion without period-based precision loss
             if (chunkLen >= 4) {
-                this->agbPitch = arr_u32(chunkData, 0);
+                this->agbPitch = arr_u32(chunkData, chunkLen, 0);
             }
         } else if (chunkId == "agbl") {
             // Custom chunk: exact loop end override (handles off-by-one from original game)
             if (chunkLen >= 4) {
-                this->agbLoopEnd = arr_u32(chunkData, 0);
+                this->agbLoopEnd = arr_u32(chunkData, chunkLen, 0);
             }
         }
 
+        curPos += 8 + size_t(chunkLen);
         /* https://en.wikipedia.org/wiki/Resource_Interchange_File_Format#Explanation
          * If chunk size is odd, skip the pad byte */
         if ((chunkLen % 2) == 1)
-            ifs.seekg(1, ifs.cur);
+            curPos += 1;
     }
 
     if (!fmtChunkFound)
@@ -204,105 +211,137 @@ wav_file::wav_file(const std::string& path) : loadBuffer(loadChunkSize)
     if (!dataChunkFound)
         throw std::runtime_error("ERROR: data chunk not found");
 
-    this->numSamples = static_cast<uint32_t>(dataChunkEndPos - dataChunkPos) / fmt_size();
+    this->numSamples = static_cast<uint32_t>(dataChunkLen / fmt_size());
     this->loopEnd = std::min(this->loopEnd, this->numSamples);
 }
 
 wav_file::~wav_file()
 {
-    ifs.close();
+#ifndef _WIN32
+    if (mappedData != nullptr)
+        munmap(mappedData, fileSize);
+#endif
 }
 
-void wav_file::readData(size_t location, double *data, size_t len)
+// Sample conversion kernels. The SSE2 paths convert four samples per step
+// and give the same doubles as the scalar loops, which also finish off the
+// tail: every scale factor is a power of two, so multiplying is exact.
+
+static void convert_u8(const uint8_t *src, double *dst, size_t count)
 {
-    while (len-- > 0) {
-        if (loadedChunk != location - (location % loadChunkSize)) {
-            loadedChunk = location - (location % loadChunkSize);
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128d bias = _mm_set1_pd(128.0);
+    const __m128d scale = _mm_set1_pd(1.0 / 128.0);
+    for (; i + 4 <= count; i += 4) {
+        int32_t packed;
+        memcpy(&packed, src + i, sizeof(packed));
+        __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+        __m128d lo = _mm_cvtepi32_pd(v);
+        __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_sub_pd(lo, bias), scale));
+        _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_sub_pd(hi, bias), scale));
+    }
+#endif
+    for (; i < count; i++)
+        dst[i] = (double(src[i]) - 128.0) / 128.0;
+}
 
-            std::streampos blockpos = this->dataChunkPos + std::streampos(loadedChunk * fmt_size());
-            std::streampos endblockpos = this->dataChunkEndPos;
-            size_t actualChunkSize = std::min(loadChunkSize, static_cast<size_t>(endblockpos - blockpos) / fmt_size());
+static void convert_s16(const uint8_t *src, double *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d scale = _mm_set1_pd(1.0 / 32768.0);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i * 2));
+        v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_cvtepi32_pd(v), scale));
+        _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), scale));
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t s = int16_t(src[i * 2] | (src[i * 2 + 1] << 8));
+        dst[i] = double(s) / 32768.0;
+    }
+}
 
-            if (actualChunkSize == 0) {
-                std::fill(loadBuffer.begin(), loadBuffer.end(), 0.0);
-                goto load_sample;
-            }
+static void convert_s24(const uint8_t *src, double *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        int32_t s = int32_t(uint32_t(src[i * 3]) << 8 | uint32_t(src[i * 3 + 1]) << 16 | uint32_t(src[i * 3 + 2]) << 24);
+        s >>= 8;
+        dst[i] = double(s) / 8388608.0;
+    }
+}
 
-            ifs.seekg(blockpos, ifs.beg);
-            std::vector<uint8_t> ld(actualChunkSize * fmt_size());
-            ifs.read(reinterpret_cast<char *>(ld.data()), ld.size());
-
-            if (fmt == format_type::u8) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    loadBuffer[i] = (double(ld[i]) - 128.0) / 128.0;
-                }
-            } else if (fmt == format_type::s16) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    int32_t s =
-                        (ld[i * fmt_size() + 0] << 0) |
-                        (ld[i * fmt_size() + 1] << 8);
-                    s <<= 16;
-                    s >>= 16;
-                    loadBuffer[i] = double(s) / 32768.0;
-                }
-            } else if (fmt == format_type::s24) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    int32_t s =
-                        (ld[i * fmt_size() + 0] << 0) |
-                        (ld[i * fmt_size() + 1] << 8) |
-                        (ld[i * fmt_size() + 2] << 16);
-                    s <<= 8;
-                    s >>= 8;
-                    loadBuffer[i] = double(s) / 8388608.0;
-                }
-            } else if (fmt == format_type::s32) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    int32_t s =
-                        (ld[i * fmt_size() + 0] << 0) |
-                        (ld[i * fmt_size() + 1] << 8) |
-                        (ld[i * fmt_size() + 2] << 16) |
-                        (ld[i * fmt_size() + 3] << 24);
-                    loadBuffer[i] = double(s) / 2147483648.0;
-                }
-            } else if (fmt == format_type::f32) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    union {
-                        uint32_t s;
-                        float f;
-                    } u;
-                    u.s = 
-                        (ld[i * fmt_size() + 0] << 0) |
-                        (ld[i * fmt_size() + 1] << 8) |
-                        (ld[i * fmt_size() + 2] << 16) |
-                        (ld[i * fmt_size() + 3] << 24);
-                    loadBuffer[i] = u.f;
-                }
-            } else if (fmt == format_type::f64) {
-                for (size_t i = 0; i < actualChunkSize; i++) {
-                    union {
-                        uint64_t s;
-                        double d;
-                    } u;
-                    u.s = 
-                        (uint64_t(ld[i * fmt_size() + 0]) << 0) |
-                        (uint64_t(ld[i * fmt_size() + 1]) << 8) |
-                        (uint64_t(ld[i * fmt_size() + 2]) << 16) |
-                        (uint64_t(ld[i * fmt_size() + 3]) << 24) |
-                        (uint64_t(ld[i * fmt_size() + 4]) << 32) |
-                        (uint64_t(ld[i * fmt_size() + 5]) << 40) |
-                        (uint64_t(ld[i * fmt_size() + 6]) << 48) |
-                        (uint64_t(ld[i * fmt_size() + 7]) << 56);
-                    loadBuffer[i] = u.d;
-                }
-            }
-            for (size_t i = actualChunkSize; i < loadChunkSize; i++) {
-                loadBuffer[i] = 0.0;
-            }
+static void convert_s32(const uint8_t *src, double *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128d scale = _mm_set1_pd(1.0 / 2147483648.0);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_cvtepi32_pd(v), scale));
+        _mm_storeu_pd(dst + i + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2))), scale));
+    }
+#endif
+    for (; i < count; i++) {
+        int32_t s = int32_t(src[i * 4] | (src[i * 4 + 1] << 8) | (src[i * 4 + 2] << 16) | (uint32_t(src[i * 4 + 3]) << 24));
+        dst[i] = double(s) / 2147483648.0;
+    }
+}
+
+static void convert_f32(const uint8_t *src, double *dst, size_t count)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(reinterpret_cast<const float *>(src + i * 4));
+        _mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t bits = src[i * 4] | (src[i * 4 + 1] << 8) | (src[i * 4 + 2] << 16) | (uint32_t(src[i * 4 + 3]) << 24);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        dst[i] = f;
+    }
+}
+
+static void convert_f64(const uint8_t *src, double *dst, size_t count)
+{
+#ifdef __SSE2__
+    // x86 is little-endian like the file, so the samples are already doubles.
+    memcpy(dst, src, count * sizeof(double));
+#else
+    for (size_t i = 0; i < count; i++) {
+        uint64_t bits = 0;
+        for (int b = 7; b >= 0; b--)
+            bits = (bits << 8) | src[i * 8 + b];
+        memcpy(&dst[i], &bits, sizeof(double));
+    }
+#endif
+}
+
+void wav_file::readData(size_t location, double *data, size_t len) const
+{
+    size_t available = location < numSamples ? std::min<size_t>(len, numSamples - location) : 0;
+
+    if (available > 0) {
+        const uint8_t *src = sampleData + location * fmt_size();
+        switch (fmt) {
+        case format_type::u8:  convert_u8(src, data, available); break;
+        case format_type::s16: convert_s16(src, data, available); break;
+        case format_type::s24: convert_s24(src, data, available); break;
+        case format_type::s32: convert_s32(src, data, available); break;
+        case format_type::f32: convert_f32(src, data, available); break;
+        case format_type::f64: convert_f64(src, data, available); break;
         }
-load_sample:
-        *data++ = loadBuffer[location % loadChunkSize];
-        location++;
     }
+
+    std::fill(data + available, data + len, 0.0);
 }
 
 // In the future, if wav2agb gains the ability to construct .wav files from .bin files,
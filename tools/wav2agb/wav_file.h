@@ -1,7 +1,6 @@
 #pragma once
 
 #include <string>
-#include <fstream>
 #include <vector>
 #include <limits>
 #include <cstdint>
@@ -18,20 +17,27 @@ void write_wav_with_agbl_chunk(const std::string& output_path,
                                 std::vector<WavChunk>& chunks,
                                 uint32_t loop_end_value);
 
+// The file is memory-mapped (read whole on Windows), and readData converts
+// samples straight out of the mapping, so any number of threads can read
+// from one wav_file at once.
 class wav_file {
 public:
-    wav_file(const std::string& path);
+    // keepChunks copies every chunk into chunks, for rewriting the file.
+    wav_file(const std::string& path, bool keepChunks = false);
     ~wav_file();
+    wav_file(const wav_file&) = delete;
+    wav_file& operator=(const wav_file&) = delete;
 
-    void readData(size_t location, double *data, size_t len);
+    // Converts samples [location, location + len) to the -1..1 range;
+    // samples past the end of the data read as 0.
+    void readData(size_t location, double *data, size_t len) const;
 private:
-    std::ifstream ifs;
-    std::streampos dataChunkPos;
-    std::streampos dataChunkEndPos;
-    size_t loadedChunk = WAV_INVALID_VAL;
+    const uint8_t *fileData = nullptr;
+    size_t fileSize = 0;
+    void *mappedData = nullptr;
+    std::vector<uint8_t> ownedData;
+    const uint8_t *sampleData = nullptr;
 
-    std::vector<double> loadBuffer;
-    size_t loadBufferBlock = std::numeric_limits<size_t>::max();
     enum class format_type {
         u8, s16, s24, s32,
         f32, f64,